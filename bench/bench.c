@@ -0,0 +1,1054 @@
+/**
+ * @file bench.c
+ * @author Abishek Ramdas
+ * @brief Microbenchmarks of the data path and helper primitives
+ *
+ * Every benchmark times a number of operations of one primitive in
+ * isolation, after warm-up runs, and repeats the measurement. Results
+ * are written as JSON: per benchmark the ns per operation (min, median
+ * and max over the repetitions) and the operations per second at the
+ * median.
+ */
+
+#define _GNU_SOURCE // struct mmsghdr
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "../graph.h"
+#include "../net.h"
+#include "../comm.h"
+#include "../layer2.h"
+#include "../utils.h"
+#include "../pkt_buf.h"
+#include "../timer.h"
+#include "../traffic_gen.h"
+#include "../gluethread/glthread.h"
+
+extern graph_t * build_linear_topo(unsigned int n_nodes);
+
+#define BENCH_REPS_DEFAULT 5
+#define BENCH_WARMUP_DEFAULT 1
+#define BENCH_REPS_MAX 100
+#define BENCH_PKT_SIZE 64          ///< data link packet size of the comm benchmarks
+#define BENCH_LARGE_PKT_SIZE 1400  ///< data link packet size of the large frame runs
+#define BENCH_HDRS_SIZE 34         ///< headers sent in front of the payload by send_pkt_out_iov
+#define BENCH_TX_WINDOW 64         ///< packets in flight per interface
+#define BENCH_DELIVERY_TIMEOUT_MS 1000 ///< wait for packets in flight without progress
+#define BENCH_MAX_SCALE_SIZES 16
+
+/**
+ * Runs n_ops operations of a benchmark.
+ * Returns the number of operations that failed, -1 if the run could not
+ * be done at all.
+ */
+typedef int64_t (*bench_fn_t)(void *ctx, uint64_t n_ops);
+
+// Settings from the command line
+static unsigned int bench_reps = BENCH_REPS_DEFAULT;
+static unsigned int bench_warmup = BENCH_WARMUP_DEFAULT;
+static uint64_t bench_scale = 1; ///< multiplier of the operations per run
+static const char *bench_filter = NULL;
+static unsigned int scale_sizes[BENCH_MAX_SCALE_SIZES] = { 1000, 10000, 50000 };
+static unsigned int n_scale_sizes = 3;
+static FILE *bench_out;
+static unsigned int n_results;
+
+static const char *transport_str(comm_transport_t transport){
+    return (transport == COMM_TRANSPORT_SHM) ? "shm" : "udp";
+}
+
+static const char *io_engine_str(void){
+    if(comm_get_transport() == COMM_TRANSPORT_SHM){
+        return "none";
+    }
+    return (comm_get_io_engine() == COMM_IO_URING) ? "uring" : "epoll";
+}
+
+static int bench_selected(const char *name){
+    return bench_filter == NULL || strstr(name, bench_filter) != NULL;
+}
+
+static int cmp_u64(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Start the JSON object of a result.
+ *
+ * @param  name: benchmark name
+ * @param  params: JSON members describing the run, may be empty
+ */
+static void bench_result_begin(const char *name, const char *params){
+    fprintf(bench_out, "%s\n    {\"name\": \"%s\", \"transport\": \"%s\", \"io_engine\": \"%s\"",
+            n_results++ ? "," : "", name, transport_str(comm_get_transport()),
+            io_engine_str());
+    if(params[0] != '\0'){
+        fprintf(bench_out, ", %s", params);
+    }
+}
+
+/**
+ * @brief Record a benchmark that could not run.
+ */
+static void bench_error(const char *name, const char *params, const char *error){
+    bench_result_begin(name, params);
+    fprintf(bench_out, ", \"error\": \"%s\"}", error);
+    fprintf(stderr, "%-36s %s\n", name, error);
+}
+
+/**
+ * @brief Write the result of timed runs.
+ *
+ * @param  name: benchmark name
+ * @param  params: JSON members describing the run, may be empty
+ * @param  samples: ns taken by each of the bench_reps runs, sorted in place
+ * @param  n_ops: operations per run
+ * @param  failed: operations that failed over all runs
+ * @param  extra: JSON members appended to the result, may be empty
+ */
+static void bench_report(const char *name, const char *params, uint64_t *samples,
+                         uint64_t n_ops, int64_t failed, const char *extra){
+    qsort(samples, bench_reps, sizeof(samples[0]), cmp_u64);
+
+    double min_ns = (double)samples[0] / n_ops;
+    double median_ns = (double)samples[bench_reps / 2] / n_ops;
+    double max_ns = (double)samples[bench_reps - 1] / n_ops;
+    double ops_per_sec = (median_ns > 0) ? 1e9 / median_ns : 0;
+    bench_result_begin(name, params);
+    fprintf(bench_out, ", \"ops\": %lu, \"repetitions\": %u, \"warmup\": %u,"
+            " \"ns_per_op\": %.2f, \"ns_per_op_min\": %.2f, \"ns_per_op_max\": %.2f,"
+            " \"ops_per_sec\": %.0f, \"failed_ops\": %ld",
+            (unsigned long)n_ops, bench_reps, bench_warmup, median_ns, min_ns, max_ns,
+            ops_per_sec, (long)failed);
+    if(extra[0] != '\0'){
+        fprintf(bench_out, ", %s", extra);
+    }
+    fprintf(bench_out, "}");
+    fflush(bench_out);
+    fprintf(stderr, "%-36s %10.2f ns/op %14.0f ops/s\n", name, median_ns, ops_per_sec);
+}
+
+/**
+ * @brief Time a benchmark and write its result.
+ *
+ * The benchmark is run bench_warmup times untimed, then bench_reps
+ * times timed, each run doing n_ops operations.
+ *
+ * @param  name: benchmark name, matched against the filter
+ * @param  params: JSON members describing the run, may be empty
+ * @param  fn: benchmark
+ * @param  ctx: state passed to fn
+ * @param  n_ops: operations per run
+ * @return 0: Success
+ *        -1: Fail, the benchmark could not run
+ */
+static int bench_run(const char *name, const char *params, bench_fn_t fn,
+                     void *ctx, uint64_t n_ops){
+    uint64_t samples[BENCH_REPS_MAX];
+    int64_t failed = 0;
+
+    n_ops *= bench_scale;
+    for(unsigned int i=0; i<bench_warmup; i++){
+        if(fn(ctx, n_ops) < 0){
+            bench_error(name, params, "benchmark failed");
+            return -1;
+        }
+    }
+    for(unsigned int i=0; i<bench_reps; i++){
+        uint64_t start_ns = timer_now_ns();
+        int64_t ret = fn(ctx, n_ops);
+        samples[i] = timer_now_ns() - start_ns;
+        if(ret < 0){
+            bench_error(name, params, "benchmark failed");
+            return -1;
+        }
+        failed += ret;
+    }
+    bench_report(name, params, samples, n_ops, failed, "");
+    return 0;
+}
+
+/*
+ * Helper primitives
+ */
+
+typedef struct bench_glthread_ {
+    glthread_t base;
+    glthread_t *elems;
+    unsigned int n_elems;
+} bench_glthread_t;
+
+static int64_t bench_glthread_add_remove(void *ctx, uint64_t n_ops){
+    bench_glthread_t *b = ctx;
+    for(uint64_t i=0; i<n_ops; i++){
+        glthread_t *elem = &b->elems[i % b->n_elems];
+        glthread_add_next(&b->base, elem);
+        remove_glthread(elem);
+    }
+    return 0;
+}
+
+static int64_t bench_glthread_iterate(void *ctx, uint64_t n_ops){
+    bench_glthread_t *b = ctx;
+    glthread_t *curr;
+    volatile uint64_t n = 0;
+    // One operation visits one element
+    for(uint64_t i=0; i<n_ops; i+=b->n_elems){
+        ITERATE_GLTHREAD_BEGIN(&b->base, curr){
+            n++;
+        } ITERATE_GLTHREAD_END(&b->base, curr);
+    }
+    return 0;
+}
+
+static int64_t bench_apply_mask(void *ctx, uint64_t n_ops){
+    (void)ctx;
+    char ip[16] = "192.168.200.2";
+    char prefix[17];
+    for(uint64_t i=0; i<n_ops; i++){
+        apply_mask(ip, 24, prefix);
+    }
+    return 0;
+}
+
+static int64_t bench_convert_ip(void *ctx, uint64_t n_ops){
+    (void)ctx;
+    char ip[16] = "192.168.200.2";
+    volatile unsigned int ip_num;
+    for(uint64_t i=0; i<n_ops; i++){
+        ip_num = convert_ip_from_str_to_int(ip);
+    }
+    (void)ip_num;
+    return 0;
+}
+
+typedef struct bench_topo_ {
+    graph_t *topo;
+    char (*names)[NODE_NAME_SIZE];
+    unsigned int n_nodes;
+    node_t *node;
+    char ip[16];
+} bench_topo_t;
+
+static int64_t bench_get_node_by_name(void *ctx, uint64_t n_ops){
+    bench_topo_t *b = ctx;
+    int64_t failed = 0;
+    for(uint64_t i=0; i<n_ops; i++){
+        if(get_node_by_node_name(b->topo, b->names[i % b->n_nodes]) == NULL){
+            failed++;
+        }
+    }
+    return failed;
+}
+
+static int64_t bench_matching_subnet_if(void *ctx, uint64_t n_ops){
+    bench_topo_t *b = ctx;
+    int64_t failed = 0;
+    for(uint64_t i=0; i<n_ops; i++){
+        if(node_get_matching_subnet_interface(b->node, b->ip) == NULL){
+            failed++;
+        }
+    }
+    return failed;
+}
+
+typedef struct bench_arp_ {
+    arp_tbl_t *arp_tbl;
+    uint32_t *keys;        ///< IP addresses in the table
+    unsigned int n_entries;
+    uint64_t next;         ///< churn: next key to delete and add back
+} bench_arp_t;
+
+static int64_t bench_arp_lookup(void *ctx, uint64_t n_ops){
+    bench_arp_t *b = ctx;
+    int64_t failed = 0;
+    // Keys are looked up in a scattered order
+    for(uint64_t i=0; i<n_ops; i++){
+        uint32_t key = b->keys[(i * 2654435761u) % b->n_entries];
+        if(lookup_arp_tbl_entry(b->arp_tbl, key) == NULL){
+            failed++;
+        }
+    }
+    return failed;
+}
+
+static int64_t bench_arp_churn(void *ctx, uint64_t n_ops){
+    bench_arp_t *b = ctx;
+    mac_addr_t mac = { 0 };
+    int64_t failed = 0;
+    // One operation deletes an entry and adds it back, the table
+    // stays at the same size
+    for(uint64_t i=0; i<n_ops; i++){
+        uint32_t key = b->keys[(b->next++ * 2654435761u) % b->n_entries];
+        if(delete_arp_tbl_entry(b->arp_tbl, key) < 0 ||
+           add_arp_tbl_entry(b->arp_tbl, key, &mac, 0) == NULL){
+            failed++;
+        }
+    }
+    return failed;
+}
+
+typedef struct bench_arp_sweep_ {
+    arp_tbl_t *arp_tbl;
+    uint32_t max_entries;
+    uint64_t next;         ///< next host of the segment to learn
+} bench_arp_sweep_t;
+
+#define BENCH_ARP_SWEEP_HOSTS 65536 ///< hosts of the swept LAN segment, a /16
+
+static int64_t bench_arp_sweep(void *ctx, uint64_t n_ops){
+    bench_arp_sweep_t *b = ctx;
+    mac_addr_t mac = { 0 };
+    int64_t failed = 0;
+    // Every host of the segment is learned in turn, as from a scan: past
+    // max_entries each new host evicts the least recently refreshed
+    for(uint64_t i=0; i<n_ops; i++){
+        uint32_t host = b->next++ % BENCH_ARP_SWEEP_HOSTS;
+        mac.mac = host;
+        if(add_arp_tbl_entry(b->arp_tbl, htonl(0x0a000000 + host), &mac, 0) == NULL){
+            failed++;
+        }
+    }
+    return failed;
+}
+
+static int64_t bench_arp_sweep_age(void *ctx, uint64_t n_ops){
+    bench_arp_sweep_t *b = ctx;
+    int64_t failed = 0;
+    // One operation learns a host; the table is then aged past the
+    // expiry of every entry, so each host is also expired once
+    b->arp_tbl = create_arp_tbl();
+    if(b->arp_tbl == NULL){
+        return -1;
+    }
+    arp_tbl_set_max_entries(b->arp_tbl, b->max_entries);
+    b->next = 0;
+    failed = bench_arp_sweep(b, n_ops);
+    if(arp_tbl_age(b->arp_tbl, timer_now_ns() + b->arp_tbl->expire_ns) != 0){
+        failed++;
+    }
+    destroy_arp_tbl(b->arp_tbl);
+    b->arp_tbl = NULL;
+    return failed;
+}
+
+static int64_t bench_eth_hdr_push_pop(void *ctx, uint64_t n_ops){
+    char *buf = ctx;
+    pkt_buf_t pb;
+    int64_t failed = 0;
+    for(uint64_t i=0; i<n_ops; i++){
+        pkt_buf_init(&pb, buf, PKT_BUF_SIZE);
+        pkt_buf_put(&pb, BENCH_PKT_SIZE);
+        pb.l2.dst_mac = MAC_ADDR_BROADCAST;
+        pb.l2.vlan_tci = (i & 1) ? 100 : 0;
+        if(eth_hdr_push(&pb) == NULL || eth_hdr_pop(&pb) == NULL ||
+           pb.len != BENCH_PKT_SIZE){
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/**
+ * @brief Run the benchmarks of the helper primitives.
+ */
+static void bench_helpers(void){
+    char params[128];
+
+    if(bench_selected("glthread")){
+        bench_glthread_t b;
+        b.n_elems = 1024;
+        b.elems = calloc(b.n_elems, sizeof(glthread_t));
+        if(b.elems == NULL){
+            perror("calloc");
+            return;
+        }
+        init_glthread(&b.base);
+        if(bench_selected("glthread_add_next_remove")){
+            bench_run("glthread_add_next_remove", "", bench_glthread_add_remove, &b, 1000000);
+        }
+        for(unsigned int i=0; i<b.n_elems; i++){
+            glthread_add_next(&b.base, &b.elems[i]);
+        }
+        snprintf(params, sizeof(params), "\"list_len\": %u", b.n_elems);
+        if(bench_selected("glthread_iterate")){
+            bench_run("glthread_iterate", params, bench_glthread_iterate, &b, 1024 * 1024);
+        }
+        free(b.elems);
+    }
+
+    if(bench_selected("apply_mask")){
+        bench_run("apply_mask", "", bench_apply_mask, NULL, 1000000);
+    }
+    if(bench_selected("convert_ip_from_str_to_int")){
+        bench_run("convert_ip_from_str_to_int", "", bench_convert_ip, NULL, 1000000);
+    }
+
+    if(bench_selected("get_node_by_node_name") ||
+       bench_selected("node_get_matching_subnet_interface")){
+        // Lookups do not use the transport, the shared memory one is
+        // the cheapest to set up
+        comm_transport_t transport = comm_get_transport();
+        comm_set_transport(COMM_TRANSPORT_SHM);
+        bench_topo_t b = { .n_nodes = 1000 };
+        b.topo = build_linear_topo(b.n_nodes);
+        b.names = calloc(b.n_nodes, NODE_NAME_SIZE);
+        if(b.topo == NULL || b.names == NULL){
+            bench_error("get_node_by_node_name", "", "cannot build topology");
+            destroy_graph(b.topo);
+            free(b.names);
+            comm_set_transport(transport);
+            return;
+        }
+        // Look up every node, the cost grows with the node's position
+        for(unsigned int i=0; i<b.n_nodes; i++){
+            snprintf(b.names[i], NODE_NAME_SIZE, "N%u", i);
+        }
+        snprintf(params, sizeof(params), "\"nodes\": %u", b.n_nodes);
+        if(bench_selected("get_node_by_node_name")){
+            bench_run("get_node_by_node_name", params, bench_get_node_by_name, &b, 100000);
+        }
+        // IP in the subnet of the last interface of a node in the chain
+        b.node = get_node_by_node_name(b.topo, "N1");
+        interface_t *last_if = get_node_if_by_name(b.node, "eth1");
+        strcpy(b.ip, IF_IP(last_if).ip_addr);
+        snprintf(params, sizeof(params), "\"interfaces\": 2");
+        if(bench_selected("node_get_matching_subnet_interface")){
+            bench_run("node_get_matching_subnet_interface", params,
+                      bench_matching_subnet_if, &b, 1000000);
+        }
+        destroy_graph(b.topo);
+        free(b.names);
+        comm_set_transport(transport);
+    }
+
+    if(bench_selected("arp_tbl_entry")){
+        // Lookups should cost the same whatever the size of the table
+        static const unsigned int sizes[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+        for(unsigned int s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++){
+            bench_arp_t b = { .n_entries = sizes[s] };
+            mac_addr_t mac = { 0 };
+            b.arp_tbl = create_arp_tbl();
+            b.keys = calloc(b.n_entries, sizeof(uint32_t));
+            if(b.arp_tbl == NULL || b.keys == NULL){
+                destroy_arp_tbl(b.arp_tbl);
+                free(b.keys);
+                return;
+            }
+            arp_tbl_set_max_entries(b.arp_tbl, b.n_entries);
+            // Hosts of one subnet, as a node would learn them
+            for(unsigned int i=0; i<b.n_entries; i++){
+                b.keys[i] = htonl(0x0a000000 + i);
+                mac.mac = i;
+                add_arp_tbl_entry(b.arp_tbl, b.keys[i], &mac, 0);
+            }
+            snprintf(params, sizeof(params), "\"entries\": %u", b.n_entries);
+            if(bench_selected("lookup_arp_tbl_entry")){
+                bench_run("lookup_arp_tbl_entry", params, bench_arp_lookup, &b, 1000000);
+            }
+            if(bench_selected("delete_add_arp_tbl_entry")){
+                bench_run("delete_add_arp_tbl_entry", params, bench_arp_churn, &b, 1000000);
+            }
+            destroy_arp_tbl(b.arp_tbl);
+            free(b.keys);
+        }
+    }
+
+    if(bench_selected("arp_sweep_learn") || bench_selected("arp_sweep_age")){
+        // A /16 swept through tables of the default size and of one
+        // entry per host
+        static const uint32_t max_entries[] = { ARP_TBL_DEFAULT_MAX_ENTRIES, BENCH_ARP_SWEEP_HOSTS };
+        for(unsigned int s=0; s<sizeof(max_entries)/sizeof(max_entries[0]); s++){
+            bench_arp_sweep_t b = { .max_entries = max_entries[s] };
+            snprintf(params, sizeof(params), "\"hosts\": %u, \"max_entries\": %u",
+                     BENCH_ARP_SWEEP_HOSTS, b.max_entries);
+            if(bench_selected("arp_sweep_learn")){
+                b.arp_tbl = create_arp_tbl();
+                if(b.arp_tbl == NULL){
+                    return;
+                }
+                arp_tbl_set_max_entries(b.arp_tbl, b.max_entries);
+                bench_run("arp_sweep_learn", params, bench_arp_sweep, &b, 1000000);
+                destroy_arp_tbl(b.arp_tbl);
+            }
+            if(bench_selected("arp_sweep_age")){
+                bench_run("arp_sweep_age", params, bench_arp_sweep_age, &b, BENCH_ARP_SWEEP_HOSTS);
+            }
+        }
+    }
+
+    if(bench_selected("eth_hdr_push_pop")){
+        static char buf[PKT_BUF_SIZE];
+        snprintf(params, sizeof(params), "\"pkt_size\": %u", BENCH_PKT_SIZE);
+        bench_run("eth_hdr_push_pop", params, bench_eth_hdr_push_pop, buf, 1000000);
+    }
+}
+
+/*
+ * Data path
+ */
+
+/**
+ * @brief Fill a data link packet that the receiving node drops silently.
+ *
+ * The packet carries a traffic generator header of no running generator.
+ */
+static void bench_fill_pkt(char *pkt, uint32_t seq){
+    traffic_gen_hdr_t hdr = {
+        .magic = TRAFFIC_GEN_MAGIC,
+        .slot = TRAFFIC_GEN_MAX,
+        .seq = seq,
+    };
+    memset(pkt, 0, BENCH_PKT_SIZE);
+    memcpy(pkt, &hdr, sizeof(hdr));
+}
+
+/**
+ * Interfaces sent out of by a benchmark. Each interface may only have
+ * BENCH_TX_WINDOW packets in flight, so the transport never drops and
+ * every operation is a packet handled by the receiving node.
+ */
+typedef struct bench_send_ {
+    graph_t *topo;
+    node_t *node;          ///< node flooding, send_pkt_flood only
+    unsigned int n_out_ifs;
+    interface_t **out_ifs; ///< interfaces sent out of, in turn
+    interface_t **peers;   ///< interface across the link of each
+    uint64_t *sent;        ///< packets sent out of each interface
+    uint64_t *acked;       ///< of which received or given up on
+    uint64_t *lost;        ///< given up on
+    char pkt[BENCH_LARGE_PKT_SIZE];
+    uint32_t pkt_size;
+    int use_iov;           ///< send headers and payload as separate pieces
+    struct iovec iov[2];
+} bench_send_t;
+
+/**
+ * @brief Wait until an interface has at most a number of packets in flight.
+ *
+ * Packets still in flight after BENCH_DELIVERY_TIMEOUT_MS without any
+ * progress are given up on.
+ *
+ * @param  b: benchmark state
+ * @param  i: index of the interface in b->out_ifs
+ * @param  max_in_flight: packets allowed in flight
+ * @return packets given up on
+ */
+static uint64_t bench_tx_wait(bench_send_t *b, unsigned int i, uint64_t max_in_flight){
+    comm_stats_total_t total;
+    uint64_t progress_ns = 0;
+    uint64_t last_acked = b->acked[i];
+
+    for(;;){
+        comm_stats_read(&b->peers[i]->stats, &total);
+        b->acked[i] = total.rx_pkts + b->lost[i];
+        if(b->sent[i] - b->acked[i] <= max_in_flight){
+            return 0;
+        }
+        uint64_t now_ns = timer_now_ns();
+        if(progress_ns == 0 || b->acked[i] != last_acked){
+            last_acked = b->acked[i];
+            progress_ns = now_ns;
+        } else if(now_ns - progress_ns > BENCH_DELIVERY_TIMEOUT_MS * 1000000ULL){
+            uint64_t lost = b->sent[i] - b->acked[i];
+            b->lost[i] += lost;
+            b->acked[i] = b->sent[i];
+            return lost;
+        }
+        // Let the receiver threads run, they may share the CPU
+        sched_yield();
+    }
+}
+
+/**
+ * @brief Wait for the packets in flight on all interfaces.
+ *
+ * @return packets given up on
+ */
+static uint64_t bench_tx_drain(bench_send_t *b){
+    uint64_t lost = 0;
+    for(unsigned int i=0; i<b->n_out_ifs; i++){
+        lost += bench_tx_wait(b, i, 0);
+    }
+    return lost;
+}
+
+static int64_t bench_send_pkt_out(void *ctx, uint64_t n_ops){
+    bench_send_t *b = ctx;
+    int64_t failed = 0;
+    for(uint64_t n=0; n<n_ops; n++){
+        unsigned int i = n % b->n_out_ifs;
+        if(b->sent[i] - b->acked[i] >= BENCH_TX_WINDOW){
+            failed += bench_tx_wait(b, i, BENCH_TX_WINDOW - 1);
+        }
+        int ret = b->use_iov ? send_pkt_out_iov(b->iov, 2, b->out_ifs[i]) :
+                               send_pkt_out(b->pkt, b->pkt_size, b->out_ifs[i]);
+        if(ret < 0){
+            failed++;
+        } else {
+            b->sent[i]++;
+        }
+    }
+    return failed + bench_tx_drain(b);
+}
+
+static int64_t bench_send_pkt_flood(void *ctx, uint64_t n_ops){
+    bench_send_t *b = ctx;
+    int if_tx_status[MAX_INTERFACES_PER_NODE];
+    int64_t failed = 0;
+    for(uint64_t n=0; n<n_ops; n++){
+        for(unsigned int i=0; i<b->n_out_ifs; i++){
+            if(b->sent[i] - b->acked[i] >= BENCH_TX_WINDOW){
+                failed += bench_tx_wait(b, i, BENCH_TX_WINDOW - 1);
+            }
+        }
+        if(send_pkt_flood(b->node, NULL, b->pkt, b->pkt_size, if_tx_status) < 0){
+            failed++;
+        }
+        for(unsigned int i=0; i<b->n_out_ifs; i++){
+            if(if_tx_status[b->out_ifs[i]->ifindex] == 0){
+                b->sent[i]++;
+            }
+        }
+    }
+    return failed + bench_tx_drain(b);
+}
+
+/**
+ * @brief Build a chain topology for the data path benchmarks and start
+ *        its receiver threads.
+ *
+ * The interfaces sent out of are those of the flooding node if given,
+ * else every interface facing the next node in the chain.
+ *
+ * @param  b: benchmark state to fill
+ * @param  n_nodes: nodes in the chain
+ * @param  flood_node: name of the flooding node, or NULL
+ * @param  pkt_size: bytes of the data link packets sent
+ * @return 0: Success
+ *        -1: Fail
+ */
+static int bench_send_setup(bench_send_t *b, unsigned int n_nodes, char *flood_node,
+                            uint32_t pkt_size){
+    glthread_t *curr;
+
+    memset(b, 0, sizeof(*b));
+    b->pkt_size = pkt_size;
+    bench_fill_pkt(b->pkt, 0);
+    // Headers and payload of the packet as separate pieces
+    b->iov[0].iov_base = b->pkt;
+    b->iov[0].iov_len = BENCH_HDRS_SIZE;
+    b->iov[1].iov_base = b->pkt + BENCH_HDRS_SIZE;
+    b->iov[1].iov_len = pkt_size - BENCH_HDRS_SIZE;
+    b->topo = build_linear_topo(n_nodes);
+    if(b->topo == NULL){
+        return -1;
+    }
+    // Open the sockets left to the parallel bring-up
+    if(comm_bringup(b->topo, NULL) < 0){
+        destroy_graph(b->topo);
+        return -1;
+    }
+    b->out_ifs = calloc(n_nodes, sizeof(interface_t *));
+    b->peers = calloc(n_nodes, sizeof(interface_t *));
+    b->sent = calloc(n_nodes, sizeof(uint64_t));
+    b->acked = calloc(n_nodes, sizeof(uint64_t));
+    b->lost = calloc(n_nodes, sizeof(uint64_t));
+    if(b->out_ifs == NULL || b->peers == NULL || b->sent == NULL ||
+       b->acked == NULL || b->lost == NULL){
+        perror("calloc");
+        goto fail;
+    }
+
+    ITERATE_GLTHREAD_BEGIN(&b->topo->node_list, curr){
+        node_t *node = graph_glue_to_node(curr);
+        // Nodes or interfaces whose transport could not be set up make
+        // sends fail, the run would not measure the transport
+        if(comm_get_transport() == COMM_TRANSPORT_UDP && node->comm_udp_server_sock_fd < 0){
+            goto fail;
+        }
+        for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
+            interface_t *intf = node->interfaces[i];
+            if(intf == NULL){
+                continue;
+            }
+            if(comm_get_transport() == COMM_TRANSPORT_UDP && intf->comm_tx_sock_fd < 0){
+                goto fail;
+            }
+            if(flood_node != NULL ? strcmp(node->node_name, flood_node) != 0 :
+                                    strcmp(intf->interface_name, "eth1") != 0){
+                continue;
+            }
+            link_t *link = intf->link;
+            b->out_ifs[b->n_out_ifs] = intf;
+            b->peers[b->n_out_ifs] = (&link->if1 == intf) ? &link->if2 : &link->if1;
+            b->n_out_ifs++;
+        }
+    } ITERATE_GLTHREAD_END(&b->topo->node_list, curr);
+    if(flood_node != NULL){
+        b->node = get_node_by_node_name(b->topo, flood_node);
+    }
+
+    if(b->n_out_ifs == 0 || network_start_pkt_receiver_thread(b->topo) < 0){
+        goto fail;
+    }
+    return 0;
+
+fail:
+    destroy_graph(b->topo);
+    free(b->out_ifs);
+    free(b->peers);
+    free(b->sent);
+    free(b->acked);
+    free(b->lost);
+    return -1;
+}
+
+static void bench_send_teardown(bench_send_t *b){
+    destroy_graph(b->topo);
+    free(b->out_ifs);
+    free(b->peers);
+    free(b->sent);
+    free(b->acked);
+    free(b->lost);
+}
+
+typedef struct bench_recv_ {
+    node_t *node;
+    interface_t *rx_if;
+    char *bufs;
+    struct iovec iovs[COMM_RX_BURST_DEFAULT];
+    struct mmsghdr msgs[COMM_RX_BURST_DEFAULT];
+    char eth_hdr[sizeof(ethernet_hdr_t)];
+} bench_recv_t;
+
+static int64_t bench_comm_pkt_recv(void *ctx, uint64_t n_ops){
+    bench_recv_t *b = ctx;
+    int64_t failed = 0;
+    // One operation is one packet, handed over in bursts like recvmmsg
+    for(uint64_t i=0; i<n_ops; i+=COMM_RX_BURST_DEFAULT){
+        // Each packet is a comm header followed by an ethernet frame
+        comm_hdr_t hdr = {
+            .ifindex = b->rx_if->ifindex,
+            .tx_ns = timer_now_ns(),
+        };
+        for(unsigned int m=0; m<COMM_RX_BURST_DEFAULT; m++){
+            char *p = b->iovs[m].iov_base;
+            memcpy(p, &hdr, sizeof(hdr));
+            memcpy(p + sizeof(hdr), b->eth_hdr, sizeof(b->eth_hdr));
+            bench_fill_pkt(p + sizeof(hdr) + sizeof(b->eth_hdr), i + m);
+        }
+        if(_comm_pkt_recv(b->node, b->msgs, COMM_RX_BURST_DEFAULT) < 0){
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/**
+ * @brief Time to ready of a chain of n_nodes nodes: the topology is
+ *        built, its sockets opened and its receiver threads started.
+ *
+ * One operation is one node. Tearing the topology down is not timed.
+ *
+ * @param  mode: name of the bring-up mode set
+ * @param  n_nodes: nodes of the chain
+ */
+static void bench_bringup(const char *mode, unsigned int n_nodes){
+    uint64_t samples[BENCH_REPS_MAX];
+    comm_bringup_stats_t stats = { 0 };
+    char params[160];
+    char extra[200];
+    struct rlimit rl;
+
+    snprintf(params, sizeof(params), "\"bringup\": \"%s\", \"nodes\": %u", mode, n_nodes);
+    // A listen socket per node and a TX socket per interface
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if(3ULL * n_nodes + 64 > rl.rlim_cur){
+        bench_error("bringup", params, "more file descriptors than RLIMIT_NOFILE");
+        return;
+    }
+    for(unsigned int i=0; i<bench_warmup + bench_reps; i++){
+        uint64_t start_ns = timer_now_ns();
+        graph_t *topo = build_linear_topo(n_nodes);
+        int ret = (topo == NULL) ? -1 : comm_bringup(topo, &stats);
+        if(ret == 0){
+            ret = network_start_pkt_receiver_thread(topo);
+        }
+        uint64_t ready_ns = timer_now_ns() - start_ns;
+        if(ret == 0){
+            network_stop_pkt_receiver_thread();
+        }
+        if(topo != NULL){
+            destroy_graph(topo);
+        }
+        if(ret < 0){
+            bench_error("bringup", params, "cannot build topology");
+            return;
+        }
+        if(i >= bench_warmup){
+            samples[i - bench_warmup] = ready_ns;
+        }
+    }
+    qsort(samples, bench_reps, sizeof(samples[0]), cmp_u64);
+    snprintf(extra, sizeof(extra), "\"workers\": %u, \"listen_ms\": %.2f, \"tx_ms\": %.2f,"
+             " \"ready_ms\": %.2f", stats.n_workers, stats.listen_ns / 1e6,
+             stats.tx_ns / 1e6, samples[bench_reps / 2] / 1e6);
+    bench_report("bringup", params, samples, n_nodes, 0, extra);
+}
+
+/**
+ * @brief Run the benchmarks of the data path on the current transport.
+ */
+static void bench_data_path(void){
+    char params[160];
+    bench_send_t b;
+
+    // Packets per second across one link, end to end. Large frames
+    // are also sent as headers and payload in separate pieces.
+    static const struct {
+        const char *name;
+        uint32_t pkt_size;
+        int use_iov;
+    } sends[] = {
+        { "send_pkt_out", BENCH_PKT_SIZE, 0 },
+        { "send_pkt_out", BENCH_LARGE_PKT_SIZE, 0 },
+        { "send_pkt_out_iov", BENCH_LARGE_PKT_SIZE, 1 },
+    };
+    for(unsigned int s=0; s<sizeof(sends)/sizeof(sends[0]); s++){
+        if(!bench_selected(sends[s].name)){
+            continue;
+        }
+        snprintf(params, sizeof(params), "\"pkt_size\": %u, \"nodes\": 2, \"tx_window\": %u",
+                 sends[s].pkt_size, BENCH_TX_WINDOW);
+        if(bench_send_setup(&b, 2, NULL, sends[s].pkt_size) < 0){
+            bench_error(sends[s].name, params, "cannot build topology");
+            continue;
+        }
+        b.use_iov = sends[s].use_iov;
+        bench_run(sends[s].name, params, bench_send_pkt_out, &b, 100000);
+        bench_send_teardown(&b);
+    }
+
+    if(bench_selected("send_pkt_flood")){
+        snprintf(params, sizeof(params), "\"pkt_size\": %u, \"interfaces\": 2, \"tx_window\": %u",
+                 BENCH_PKT_SIZE, BENCH_TX_WINDOW);
+        if(bench_send_setup(&b, 3, "N1", BENCH_PKT_SIZE) < 0){
+            bench_error("send_pkt_flood", params, "cannot build topology");
+        } else {
+            bench_run("send_pkt_flood", params, bench_send_pkt_flood, &b, 50000);
+            bench_send_teardown(&b);
+        }
+    }
+
+    if(bench_selected("_comm_pkt_recv") && comm_get_transport() == COMM_TRANSPORT_UDP){
+        // Receive path without the socket: the node's receiver thread
+        // is not started, packets are handed over as recvmmsg would
+        snprintf(params, sizeof(params), "\"pkt_size\": %u, \"burst\": %u",
+                 BENCH_PKT_SIZE, COMM_RX_BURST_DEFAULT);
+        graph_t *topo = build_linear_topo(2);
+        bench_recv_t r;
+        r.bufs = calloc(COMM_RX_BURST_DEFAULT, PKT_BUF_SIZE);
+        if(topo == NULL || r.bufs == NULL){
+            bench_error("_comm_pkt_recv", params, "cannot build topology");
+        } else {
+            r.node = get_node_by_node_name(topo, "N1");
+            r.rx_if = get_node_if_by_name(r.node, "eth0");
+            // Addressed to the interface, so the frames are not filtered out
+            pkt_l2_t l2 = { .dst_mac = IF_MAC(r.rx_if).mac };
+            eth_hdr_build(&l2, r.eth_hdr);
+            for(unsigned int m=0; m<COMM_RX_BURST_DEFAULT; m++){
+                r.iovs[m].iov_base = r.bufs + (size_t)m * PKT_BUF_SIZE + PKT_BUF_HEADROOM;
+                r.iovs[m].iov_len = PKT_BUF_DATA_SIZE;
+                memset(&r.msgs[m], 0, sizeof(r.msgs[m]));
+                r.msgs[m].msg_hdr.msg_iov = &r.iovs[m];
+                r.msgs[m].msg_hdr.msg_iovlen = 1;
+                r.msgs[m].msg_len = sizeof(comm_hdr_t) + sizeof(r.eth_hdr) + BENCH_PKT_SIZE;
+            }
+            bench_run("_comm_pkt_recv", params, bench_comm_pkt_recv, &r, 1024 * 1024);
+        }
+        destroy_graph(topo);
+        free(r.bufs);
+    }
+
+    if(bench_selected("rx_scale")){
+        // Packets sent over every link of a long chain in turn, all
+        // nodes have to be served by the receiver threads
+        struct rlimit rl;
+        getrlimit(RLIMIT_NOFILE, &rl);
+        for(unsigned int s=0; s<n_scale_sizes; s++){
+            unsigned int n_nodes = scale_sizes[s];
+            snprintf(params, sizeof(params), "\"pkt_size\": %u, \"nodes\": %u, \"tx_window\": %u",
+                     BENCH_PKT_SIZE, n_nodes, BENCH_TX_WINDOW);
+            // A listen socket per node and a TX socket per interface,
+            // or an eventfd per node
+            uint64_t fds_needed = (comm_get_transport() == COMM_TRANSPORT_UDP) ?
+                3ULL * n_nodes : n_nodes;
+            if(fds_needed + 64 > rl.rlim_cur){
+                bench_error("rx_scale", params, "more file descriptors than RLIMIT_NOFILE");
+                continue;
+            }
+            if(bench_send_setup(&b, n_nodes, NULL, BENCH_PKT_SIZE) < 0){
+                bench_error("rx_scale", params, "cannot build topology");
+                continue;
+            }
+            bench_run("rx_scale", params, bench_send_pkt_out, &b, 100000);
+            bench_send_teardown(&b);
+        }
+    }
+
+    if(bench_selected("bringup") && comm_get_transport() == COMM_TRANSPORT_UDP){
+        static const struct {
+            const char *name;
+            comm_bringup_t mode;
+        } modes[] = {
+            { "sequential", COMM_BRINGUP_SEQUENTIAL },
+            { "parallel", COMM_BRINGUP_PARALLEL },
+        };
+        for(unsigned int m=0; m<sizeof(modes)/sizeof(modes[0]); m++){
+            comm_set_bringup(modes[m].mode, 0);
+            for(unsigned int s=0; s<n_scale_sizes; s++){
+                bench_bringup(modes[m].name, scale_sizes[s]);
+            }
+        }
+        comm_set_bringup(COMM_BRINGUP_PARALLEL, 0);
+    }
+}
+
+static void usage(const char *prog){
+    printf("Usage: %s [-r reps] [-w warmups] [-x scale] [-f filter] [-t udp|shm|all]\n"
+           "          [-e epoll|uring] [-n nodes,...] [-o file]\n", prog);
+    printf("  -r  timed repetitions of each benchmark (1-%d, default %d)\n",
+           BENCH_REPS_MAX, BENCH_REPS_DEFAULT);
+    printf("  -w  untimed warm-up runs of each benchmark (default %d)\n", BENCH_WARMUP_DEFAULT);
+    printf("  -x  multiply the operations of every run (default 1)\n");
+    printf("  -f  only run benchmarks whose name contains filter\n");
+    printf("  -t  transport of the data path benchmarks, all runs them on udp\n"
+           "      with epoll, udp with io_uring and shm (default udp)\n");
+    printf("  -e  I/O engine of the udp transport (default epoll)\n");
+    printf("  -n  node counts of the rx_scale and bringup benchmarks (default 1000,10000,50000)\n");
+    printf("  -o  write the JSON results to file instead of stdout\n");
+}
+
+int main(int argc, char **argv){
+    int opt;
+    int all_transports = 0;
+    const char *out_path = NULL;
+
+    while((opt = getopt(argc, argv, "r:w:x:f:t:e:n:o:")) != -1){
+        switch(opt){
+        case 'r':
+            bench_reps = atoi(optarg);
+            if(bench_reps == 0 || bench_reps > BENCH_REPS_MAX){
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'w':
+            bench_warmup = atoi(optarg);
+            break;
+        case 'x':
+            bench_scale = strtoull(optarg, NULL, 10);
+            if(bench_scale == 0){
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'f':
+            bench_filter = optarg;
+            break;
+        case 't':
+            if(strcmp(optarg, "udp") == 0){
+                comm_set_transport(COMM_TRANSPORT_UDP);
+            } else if(strcmp(optarg, "shm") == 0){
+                comm_set_transport(COMM_TRANSPORT_SHM);
+            } else if(strcmp(optarg, "all") == 0){
+                all_transports = 1;
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'e':
+            if(strcmp(optarg, "epoll") == 0){
+                comm_set_io_engine(COMM_IO_EPOLL);
+            } else if(strcmp(optarg, "uring") == 0){
+                comm_set_io_engine(COMM_IO_URING);
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'n': {
+            n_scale_sizes = 0;
+            char *tok = strtok(optarg, ",");
+            while(tok != NULL && n_scale_sizes < BENCH_MAX_SCALE_SIZES){
+                scale_sizes[n_scale_sizes++] = atoi(tok);
+                tok = strtok(NULL, ",");
+            }
+            break;
+        }
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    bench_out = stdout;
+    if(out_path != NULL){
+        bench_out = fopen(out_path, "w");
+        if(bench_out == NULL){
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Large topologies need a socket or eventfd per node
+    struct rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max){
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    // Topologies are built one after the other. A fixed mmap threshold
+    // keeps the shm rings of a new topology out of the heap freed by
+    // the last one, where calloc would touch all of their memory.
+    mallopt(M_MMAP_THRESHOLD, 128 * 1024);
+    // Kernel picked ports, chains longer than the UDP port range fit
+    comm_set_bringup(COMM_BRINGUP_PARALLEL, 0);
+    if(pkt_buf_pool_init(PKT_BUF_POOL_DEFAULT_SIZE) < 0){
+        return EXIT_FAILURE;
+    }
+
+    fprintf(bench_out, "{\n  \"benchmarks\": [");
+    bench_helpers();
+    if(all_transports){
+        comm_set_transport(COMM_TRANSPORT_UDP);
+        comm_set_io_engine(COMM_IO_EPOLL);
+        bench_data_path();
+        comm_set_io_engine(COMM_IO_URING);
+        bench_data_path();
+        comm_set_transport(COMM_TRANSPORT_SHM);
+        comm_set_io_engine(COMM_IO_EPOLL);
+        bench_data_path();
+    } else {
+        bench_data_path();
+    }
+    fprintf(bench_out, "\n  ]\n}\n");
+
+    if(bench_out != stdout){
+        fclose(bench_out);
+    }
+    return 0;
+}
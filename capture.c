@@ -0,0 +1,260 @@
+/**
+ * @file capture.c
+ * @author Abishek Ramdas
+ * @brief Packet capture of interfaces to pcap files
+ *
+ * The data path only copies packets into a bounded multi-producer
+ * ring (one sequence number per slot, producers claim slots with a
+ * compare and swap). A writer thread per capture drains the ring and
+ * writes the packets through a large stdio buffer, flushing it when the
+ * ring runs empty, so no thread on the data path makes a system call.
+ */
+
+#include "capture.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CAPTURE_FILE_BUF_SIZE (1 << 20)
+
+// pcap file format, nanosecond timestamps
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_VERSION_MAJOR 2
+#define PCAP_VERSION_MINOR 4
+
+typedef struct pcap_file_hdr_ {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} pcap_file_hdr_t;
+
+typedef struct pcap_rec_hdr_ {
+    uint32_t ts_sec;
+    uint32_t ts_nsec;
+    uint32_t caplen;
+    uint32_t len;
+} pcap_rec_hdr_t;
+
+static inline capture_slot_t *
+capture_slot(capture_t *c, uint64_t pos){
+    return (capture_slot_t *)(c->slots + (size_t)(pos % CAPTURE_RING_SLOTS) * c->slot_size);
+}
+
+/**
+ * @brief Copy a packet onto the ring of a capture.
+ *
+ * Called from the data path by any thread, once it saw the interface
+ * captured.
+ *
+ * @param  cp: capture point of the interface
+ * @param  iov: pieces of the ethernet frame, in order
+ * @param  iovcnt: number of pieces
+ */
+void capture_enqueue(capture_point_t *cp, const struct iovec *iov, int iovcnt){
+    __atomic_fetch_add(&cp->refs, 1, __ATOMIC_SEQ_CST);
+    capture_t *c = __atomic_load_n(&cp->capture, __ATOMIC_SEQ_CST);
+    if(c == NULL){
+        goto done;
+    }
+    if(c->max_pkts != 0 && __atomic_load_n(&c->n_captured, __ATOMIC_RELAXED) >= c->max_pkts){
+        goto done;
+    }
+
+    capture_slot_t *slot;
+    uint64_t pos = __atomic_load_n(&c->enqueue_pos, __ATOMIC_RELAXED);
+    for(;;){
+        slot = capture_slot(c, pos);
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+        if(diff == 0){
+            if(__atomic_compare_exchange_n(&c->enqueue_pos, &pos, pos + 1, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+                break;
+            }
+        } else if(diff < 0){
+            // Writer is a full ring behind
+            __atomic_fetch_add(&c->n_dropped, 1, __ATOMIC_RELAXED);
+            goto done;
+        } else {
+            pos = __atomic_load_n(&c->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    slot->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    uint32_t len = 0, caplen = 0;
+    for(int i=0; i<iovcnt; i++){
+        uint32_t n = iov[i].iov_len;
+        if(n > c->snaplen - caplen){
+            n = c->snaplen - caplen;
+        }
+        memcpy((char *)(slot + 1) + caplen, iov[i].iov_base, n);
+        caplen += n;
+        len += iov[i].iov_len;
+    }
+    slot->len = len;
+    slot->caplen = caplen;
+    __atomic_fetch_add(&c->n_captured, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+done:
+    __atomic_fetch_sub(&cp->refs, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Write the packets on the ring to the file.
+ *
+ * @return number of packets taken off the ring
+ */
+static unsigned int capture_drain(capture_t *c){
+    unsigned int n = 0;
+    for(;;){
+        capture_slot_t *slot = capture_slot(c, c->dequeue_pos);
+        if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != c->dequeue_pos + 1){
+            break;
+        }
+        // Producers may overshoot the packet limit by a few packets
+        if(c->max_pkts == 0 || c->n_written < c->max_pkts){
+            pcap_rec_hdr_t rec = {
+                .ts_sec = (uint32_t)(slot->ts_ns / 1000000000ULL),
+                .ts_nsec = (uint32_t)(slot->ts_ns % 1000000000ULL),
+                .caplen = slot->caplen,
+                .len = slot->len,
+            };
+            if(fwrite(&rec, sizeof(rec), 1, c->file) != 1 ||
+               fwrite(slot + 1, slot->caplen, 1, c->file) != 1){
+                perror("Capture write");
+            }
+            c->n_written++;
+        }
+        __atomic_store_n(&slot->seq, c->dequeue_pos + CAPTURE_RING_SLOTS, __ATOMIC_RELEASE);
+        c->dequeue_pos++;
+        n++;
+    }
+    return n;
+}
+
+static void *capture_writer_thread(void *arg){
+    capture_t *c = (capture_t *)arg;
+    for(;;){
+        int stop = __atomic_load_n(&c->stop, __ATOMIC_ACQUIRE);
+        if(capture_drain(c) != 0){
+            continue;
+        }
+        fflush(c->file);
+        if(stop){
+            break;
+        }
+        usleep(CAPTURE_WRITER_IDLE_US);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Start capturing the packets of an interface to a pcap file.
+ *
+ * @param  cp: capture point of the interface
+ * @param  path: pcap file to create, overwritten if it exists
+ * @param  snaplen: bytes kept of each packet, 0 or above
+ *                  CAPTURE_SNAPLEN_MAX for CAPTURE_SNAPLEN_MAX
+ * @param  max_pkts: packets to capture, 0 for no limit
+ * @return 0: Success
+ *        -1: Fail
+ */
+int capture_start(capture_point_t *cp, const char *path, uint32_t snaplen, uint64_t max_pkts){
+    if(__atomic_load_n(&cp->capture, __ATOMIC_SEQ_CST) != NULL){
+        printf("Interface is already being captured\n");
+        return -1;
+    }
+    if(snaplen == 0 || snaplen > CAPTURE_SNAPLEN_MAX){
+        snaplen = CAPTURE_SNAPLEN_MAX;
+    }
+
+    capture_t *c = aligned_alloc(64, sizeof(capture_t));
+    if(c == NULL){
+        perror("aligned_alloc");
+        return -1;
+    }
+    memset(c, 0, sizeof(*c));
+    strncpy(c->path, path, sizeof(c->path) - 1);
+    c->snaplen = snaplen;
+    c->max_pkts = max_pkts;
+    // Keep every slot on its own cache lines
+    c->slot_size = (sizeof(capture_slot_t) + snaplen + 63) & ~63u;
+    c->slots = aligned_alloc(64, (size_t)CAPTURE_RING_SLOTS * c->slot_size);
+    if(c->slots == NULL){
+        perror("aligned_alloc");
+        free(c);
+        return -1;
+    }
+    for(uint64_t i=0; i<CAPTURE_RING_SLOTS; i++){
+        capture_slot(c, i)->seq = i;
+    }
+
+    c->file = fopen(path, "wb");
+    if(c->file == NULL){
+        perror("fopen");
+        goto fail;
+    }
+    setvbuf(c->file, NULL, _IOFBF, CAPTURE_FILE_BUF_SIZE);
+    pcap_file_hdr_t hdr = {
+        .magic = PCAP_MAGIC_NSEC,
+        .version_major = PCAP_VERSION_MAJOR,
+        .version_minor = PCAP_VERSION_MINOR,
+        .snaplen = snaplen,
+        .linktype = CAPTURE_LINKTYPE,
+    };
+    if(fwrite(&hdr, sizeof(hdr), 1, c->file) != 1){
+        perror("Capture write");
+        fclose(c->file);
+        goto fail;
+    }
+
+    if(pthread_create(&c->writer, NULL, capture_writer_thread, c) != 0){
+        perror("pthread_create");
+        fclose(c->file);
+        goto fail;
+    }
+    __atomic_store_n(&cp->capture, c, __ATOMIC_SEQ_CST);
+    return 0;
+
+fail:
+    free(c->slots);
+    free(c);
+    return -1;
+}
+
+/**
+ * @brief Stop capturing an interface.
+ *
+ * Waits for the threads copying packets of the interface, then for the
+ * writer to write what is left on the ring, and closes the file.
+ *
+ * @param  cp: capture point of the interface
+ * @return 0: Success
+ *        -1: Fail, the interface is not being captured
+ */
+int capture_stop(capture_point_t *cp){
+    capture_t *c = __atomic_exchange_n(&cp->capture, NULL, __ATOMIC_SEQ_CST);
+    if(c == NULL){
+        return -1;
+    }
+    while(__atomic_load_n(&cp->refs, __ATOMIC_SEQ_CST) != 0){
+        sched_yield();
+    }
+
+    __atomic_store_n(&c->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(c->writer, NULL);
+    fclose(c->file);
+    printf("Capture to %s stopped: %lu packets written, %lu dropped\n", c->path,
+           (unsigned long)c->n_written, (unsigned long)c->n_dropped);
+    free(c->slots);
+    free(c);
+    return 0;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file capture.h
+ * @author Abishek Ramdas
+ * @brief Packet capture of interfaces to pcap files
+ */
+
+#ifndef __MY_CAPTURE_H
+#define __MY_CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define CAPTURE_RING_SLOTS 1024 ///< packets buffered between the data path and the writer
+#define CAPTURE_SNAPLEN_MAX 2066 ///< largest snap length, a full comm packet behind a tagged ethernet header
+#define CAPTURE_WRITER_IDLE_US 1000 ///< writer sleep when the ring is empty
+
+// Captured packets are the ethernet frames exchanged over the links: the
+// packet behind the ethernet header it is sent with, 802.1Q tag
+// included, without FCS. Data link packets of the nodes have ETH_TYPE_DATA_LINK.
+#define CAPTURE_LINKTYPE 1 ///< LINKTYPE_ETHERNET
+
+/**
+ * Header of a ring slot, followed by snaplen bytes of packet
+ */
+typedef struct capture_slot_ {
+    uint64_t seq;     ///< ring position the slot is ready for
+    uint64_t ts_ns;   ///< CLOCK_REALTIME time the packet was captured
+    uint32_t caplen;  ///< bytes of packet stored in the slot
+    uint32_t len;     ///< bytes of the packet on the link
+} capture_slot_t;
+
+/**
+ * Capture of one interface. Packets are copied into a bounded lock-free
+ * ring by any thread sending or receiving on the interface and written
+ * to the file by the capture's writer thread.
+ */
+typedef struct capture_ {
+    char path[64];
+    FILE *file;
+    uint32_t snaplen;
+    uint64_t max_pkts;     ///< packets to capture, 0 for no limit
+    char *slots;           ///< CAPTURE_RING_SLOTS slots of slot_size bytes
+    uint32_t slot_size;
+    uint64_t enqueue_pos __attribute__((aligned(64))); ///< next slot producers claim
+    uint64_t n_captured;   ///< packets put on the ring
+    uint64_t n_dropped;    ///< packets lost, ring was full
+    uint64_t dequeue_pos __attribute__((aligned(64))); ///< next slot the writer drains
+    uint64_t n_written;    ///< packets written to the file
+    int stop;              ///< set to make the writer drain the ring and exit
+    pthread_t writer;
+} capture_t;
+
+/**
+ * Where an interface's capture is attached. Threads on the data path
+ * take a reference while they use the capture so it can be stopped and
+ * freed under them.
+ */
+typedef struct capture_point_ {
+    capture_t *capture; ///< NULL when not capturing
+    uint32_t refs;      ///< threads using capture
+} capture_point_t;
+
+int capture_start(capture_point_t *cp, const char *path, uint32_t snaplen, uint64_t max_pkts);
+int capture_stop(capture_point_t *cp);
+void capture_enqueue(capture_point_t *cp, const struct iovec *iov, int iovcnt);
+
+#endif
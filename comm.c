@@ -4,6 +4,7 @@
  * @brief Methods to setup communication between nodes
  */
 
+#define _GNU_SOURCE // recvmmsg
 #include "comm.h"
 #include "gluethread/glthread.h"
 #include "graph.h"
@@ -15,256 +16,2719 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
 #include "gluethread/glthread.h"
 #include "net.h"
 #include "layer2.h"
+#include "spsc_ring.h"
+#include "uring.h"
+#include "pkt_buf.h"
+#include "timer.h"
+#include "lat_hist.h"
+#include "capture.h"
+#include "traffic_gen.h"
+#include "l2switch.h"
 
-// packet format is 32 bytes of header with interface name
-// rest 2016 bytes of payload
-#define MAX_COMM_PKT_SIZE 2048
+// Index of the next node created, in order of creation. Every
+// process of a partitioned topology builds the same nodes in the same
+// order, so a node has the same index in all of them.
+static unsigned int comm_next_node_index = 0;
 
-// static variable global to this file indicating next available port
-static uint32_t next_free_port = 40000;
+// Partitioning of the topology across processes. Set with
+// comm_set_partition before any node is created.
+static unsigned int comm_n_partitions = 1;
+static unsigned int comm_local_partition = 0;
+static uint32_t comm_partition_ip[COMM_MAX_PARTITIONS]; ///< network byte order, 0 for loopback
 
 /**
- * @brief Returns a new unused port number.
+ * Endpoint configured for a node by name
+ */
+typedef struct comm_endpoint_ {
+    char node_name[NODE_NAME_SIZE];
+    uint32_t ip;            ///< network byte order
+    uint16_t port;
+    unsigned int partition;
+} comm_endpoint_t;
+
+static comm_endpoint_t *comm_endpoints = NULL;
+static unsigned int comm_n_endpoints = 0;
+static unsigned int comm_endpoints_size = 0;
+
+// How UDP sockets are opened. Set with comm_set_bringup before any
+// node is created.
+static comm_bringup_t comm_bringup_mode = COMM_BRINGUP_SEQUENTIAL;
+static unsigned int comm_bringup_workers = 1;
+static comm_bringup_stats_t comm_last_bringup;
+static int comm_brought_up = 0; ///< sockets of nodes created from now on open right away
+
+
+// Transport carrying comm packets between nodes. Set with
+// comm_set_transport before any node is created.
+static comm_transport_t comm_transport = COMM_TRANSPORT_UDP;
+static unsigned int comm_nodes_initialized = 0;
+
+/**
+ * @brief Select the transport used to carry packets between nodes.
+ *
+ * @param  transport: COMM_TRANSPORT_UDP or COMM_TRANSPORT_SHM
+ * @return 0: Success
+ *        -1: Fail, nodes already use the current transport
+ */
+int comm_set_transport(comm_transport_t transport){
+    if(comm_nodes_initialized != 0){
+        printf("Transport cannot be changed once nodes are created\n");
+        return -1;
+    }
+    if(transport == COMM_TRANSPORT_SHM && comm_n_partitions > 1){
+        printf("Shared memory transport cannot cross processes, topology is partitioned\n");
+        return -1;
+    }
+    comm_transport = transport;
+    return 0;
+}
+
+comm_transport_t comm_get_transport(void){
+    return comm_transport;
+}
+
+/**
+ * @brief Select how the UDP sockets of the topology are opened.
+ *
+ * With the parallel bring-up nodes and links are created without
+ * sockets. comm_bringup, called by network_start_pkt_receiver_thread,
+ * then opens the listen sockets of all nodes and the TX sockets of all
+ * interfaces on worker threads. Either way listen sockets are bound to
+ * the port picked by comm_node_endpoint.
+ *
+ * @param  mode: COMM_BRINGUP_SEQUENTIAL or COMM_BRINGUP_PARALLEL
+ * @param  n_workers: worker threads of the parallel bring-up, up to
+ *                    COMM_BRINGUP_MAX_WORKERS, 0 for one per online CPU
+ * @return 0: Success
+ *        -1: Fail, nodes are already created
+ */
+int comm_set_bringup(comm_bringup_t mode, unsigned int n_workers){
+    if(comm_nodes_initialized != 0){
+        printf("Bring-up mode cannot be changed once nodes are created\n");
+        return -1;
+    }
+    if(n_workers > COMM_BRINGUP_MAX_WORKERS){
+        printf("Bring-up workers must be 0 to %d\n", COMM_BRINGUP_MAX_WORKERS);
+        return -1;
+    }
+    if(n_workers == 0){
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = (n_cpus < 1) ? 1 :
+                    (n_cpus > COMM_BRINGUP_MAX_WORKERS) ? COMM_BRINGUP_MAX_WORKERS :
+                    (unsigned int)n_cpus;
+    }
+    comm_bringup_mode = mode;
+    comm_bringup_workers = n_workers;
+    return 0;
+}
+
+/**
+ * @brief Split the topology across processes.
+ *
+ * Every process builds the whole topology but only runs the nodes of
+ * its own partition: it binds their listen sockets, receives their
+ * packets and sends from their interfaces. Packets towards nodes of
+ * other partitions are sent to their endpoint. Unless configured with
+ * comm_set_node_endpoint, node number i (in order of creation) is in
+ * partition i % n_partitions and listens on the host of its partition,
+ * port COMM_BASE_PORT + i. The port is fixed since the other processes
+ * must be able to work it out, so it must not be one the kernel hands
+ * out to the TX sockets.
+ *
+ * @param  index: partition run by this process
+ * @param  n_partitions: number of processes, 1 to COMM_MAX_PARTITIONS
+ * @return 0: Success
+ *        -1: Fail
+ */
+int comm_set_partition(unsigned int index, unsigned int n_partitions){
+    if(comm_nodes_initialized != 0){
+        printf("Partition cannot be changed once nodes are created\n");
+        return -1;
+    }
+    if(n_partitions == 0 || n_partitions > COMM_MAX_PARTITIONS || index >= n_partitions){
+        printf("Partition must be index/count with count 1 to %d and index below count\n",
+               COMM_MAX_PARTITIONS);
+        return -1;
+    }
+    if(n_partitions > 1 && comm_transport != COMM_TRANSPORT_UDP){
+        printf("Only the UDP transport can be partitioned\n");
+        return -1;
+    }
+    comm_n_partitions = n_partitions;
+    comm_local_partition = index;
+    return 0;
+}
+
+/**
+ * @brief Set the host whose address the nodes of a partition listen on.
+ *
+ * Partitions default to 127.0.0.1. Giving each partition its own
+ * loopback alias (127.0.0.2, ...) or the address of another host
+ * keeps the processes apart.
+ *
+ * @param  partition: partition index
+ * @param  host: IPv4 address
+ * @return 0: Success
+ *        -1: Fail
+ */
+int comm_set_partition_host(unsigned int partition, const char *host){
+    struct in_addr addr;
+    if(partition >= COMM_MAX_PARTITIONS){
+        printf("Partition %u out of range\n", partition);
+        return -1;
+    }
+    if(inet_pton(AF_INET, host, &addr) != 1){
+        printf("Invalid host address %s\n", host);
+        return -1;
+    }
+    comm_partition_ip[partition] = addr.s_addr;
+    return 0;
+}
+
+/**
+ * @brief Set the endpoint and partition of a node before it is created.
+ *
+ * @param  node_name: name of the node
+ * @param  host: IPv4 address the node listens on
+ * @param  port: UDP port the node listens on
+ * @param  partition: partition running the node
+ * @return 0: Success
+ *        -1: Fail
+ */
+int comm_set_node_endpoint(const char *node_name, const char *host, uint16_t port,
+                           unsigned int partition){
+    struct in_addr addr;
+    if(inet_pton(AF_INET, host, &addr) != 1 || port == 0){
+        printf("Invalid endpoint %s:%u of node %s\n", host, port, node_name);
+        return -1;
+    }
+    if(partition >= COMM_MAX_PARTITIONS){
+        printf("Partition %u of node %s out of range\n", partition, node_name);
+        return -1;
+    }
+    comm_endpoint_t *ep = NULL;
+    for(unsigned int i=0; i<comm_n_endpoints; i++){
+        if(strncmp(comm_endpoints[i].node_name, node_name, NODE_NAME_SIZE) == 0){
+            ep = &comm_endpoints[i];
+            break;
+        }
+    }
+    if(ep == NULL){
+        if(comm_n_endpoints == comm_endpoints_size){
+            unsigned int size = comm_endpoints_size ? 2 * comm_endpoints_size : 64;
+            comm_endpoint_t *eps = realloc(comm_endpoints, size * sizeof(*eps));
+            if(eps == NULL){
+                perror("realloc");
+                return -1;
+            }
+            comm_endpoints = eps;
+            comm_endpoints_size = size;
+        }
+        ep = &comm_endpoints[comm_n_endpoints++];
+        memset(ep, 0, sizeof(*ep));
+        strncpy(ep->node_name, node_name, NODE_NAME_SIZE - 1);
+    }
+    ep->ip = addr.s_addr;
+    ep->port = port;
+    ep->partition = partition;
+    return 0;
+}
+
+/**
+ * @brief Read node endpoints from a file.
+ *
+ * Each line is "<node-name> <host>:<port> <partition>". Empty lines
+ * and lines starting with # are skipped.
+ *
+ * @param  path: endpoints file
+ * @return 0: Success
+ *        -1: Fail
+ */
+int comm_load_endpoints(const char *path){
+    char line[256];
+    char name[NODE_NAME_SIZE];
+    char host[INET_ADDRSTRLEN];
+    unsigned int port, partition;
+    unsigned int line_no = 0;
+
+    FILE *f = fopen(path, "r");
+    if(f == NULL){
+        perror("fopen");
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f) != NULL){
+        line_no++;
+        char *p = line + strspn(line, " \t");
+        if(*p == '#' || *p == '\n' || *p == '\0'){
+            continue;
+        }
+        if(sscanf(p, "%31s %15[0-9.]:%u %u", name, host, &port, &partition) != 4 ||
+           port > UINT16_MAX ||
+           comm_set_node_endpoint(name, host, port, partition) < 0){
+            printf("%s:%u: expected <node-name> <host>:<port> <partition>\n", path, line_no);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/**
+ * @brief Check a fixed listen port against the ephemeral port range.
+ *
+ * The TX sockets are bound by connect() to a port of
+ * net.ipv4.ip_local_port_range. A listen port in that range may
+ * already be taken by one of them when its node is created, so a
+ * warning is printed, once.
+ *
+ * @param  port: fixed listen port of a node
+ */
+static void comm_check_fixed_port(uint16_t port){
+    static int range_read = 0;
+    static unsigned int range_lo, range_hi;
+    static int warned = 0;
+
+    if(!range_read){
+        range_read = 1;
+        FILE *f = fopen("/proc/sys/net/ipv4/ip_local_port_range", "r");
+        if(f == NULL || fscanf(f, "%u %u", &range_lo, &range_hi) != 2){
+            range_lo = 1;
+            range_hi = 0;
+        }
+        if(f != NULL){
+            fclose(f);
+        }
+    }
+    if(!warned && port >= range_lo && port <= range_hi){
+        warned = 1;
+        printf("Listen port %u is in the ephemeral port range %u-%u, "
+               "TX sockets may take it\n", port, range_lo, range_hi);
+    }
+}
+
+/**
+ * @brief Work out the endpoint and partition of a node being created.
+ *
+ * Nodes of a topology run by a single process listen on a port picked
+ * by the kernel when the socket is bound, so they never collide with
+ * the ports the kernel hands out to the TX sockets. Nodes of a
+ * partitioned topology, or configured with an endpoint, listen on a
+ * fixed port.
+ *
+ * @param  node: node being created
+ * @return 0: Success
+ *        -1: Fail, the node is configured in a partition that does not exist
+ */
+static int comm_node_endpoint(node_t *node){
+    unsigned int index = comm_next_node_index++;
+    node->comm_partition = index % comm_n_partitions;
+    node->comm_server_ip = comm_partition_ip[node->comm_partition];
+    node->comm_server_listen_port = 0;
+    if(comm_n_partitions > 1){
+        node->comm_server_listen_port = COMM_BASE_PORT + index;
+    }
+    for(unsigned int i=0; i<comm_n_endpoints; i++){
+        comm_endpoint_t *ep = &comm_endpoints[i];
+        if(strncmp(ep->node_name, node->node_name, NODE_NAME_SIZE) == 0){
+            node->comm_partition = ep->partition;
+            node->comm_server_ip = ep->ip;
+            node->comm_server_listen_port = ep->port;
+            break;
+        }
+    }
+    if(node->comm_server_listen_port != 0){
+        comm_check_fixed_port(node->comm_server_listen_port);
+    }
+    if(node->comm_server_ip == 0){
+        node->comm_server_ip = htonl(INADDR_LOOPBACK);
+    }
+    if(node->comm_partition >= comm_n_partitions){
+        printf("Node %s is in partition %u, topology has %u partitions\n",
+               node->node_name, node->comm_partition, comm_n_partitions);
+        node->comm_local = 0;
+        return -1;
+    }
+    node->comm_local = (node->comm_partition == comm_local_partition);
+    return 0;
+}
+
+// Format of the comm header. Set with comm_set_hdr_format before
+// any node is created.
+static comm_hdr_format_t comm_hdr_format = COMM_HDR_BINARY;
+
+/**
+ * @brief Select the format of the comm header.
+ *
+ * The binary header is 16 bytes and lets the receiver index straight
+ * into the node's interfaces. The name header carries the RX interface
+ * name in 32 bytes and is only meant for reading packet dumps. Both
+ * end with the time the packet was sent, and are followed by the
+ * ethernet header of the frame.
+ *
+ * @param  format: COMM_HDR_BINARY or COMM_HDR_NAME
+ * @return 0: Success
+ *        -1: Fail, nodes are already created
+ */
+int comm_set_hdr_format(comm_hdr_format_t format){
+    if(comm_nodes_initialized != 0){
+        printf("Comm header format cannot be changed once nodes are created\n");
+        return -1;
+    }
+    comm_hdr_format = format;
+    return 0;
+}
+
+/**
+ * @brief Size in bytes of the comm header in front of every comm packet.
+ */
+static inline uint32_t comm_hdr_size(void){
+    return (comm_hdr_format == COMM_HDR_NAME) ? COMM_HDR_NAME_SIZE : sizeof(comm_hdr_t);
+}
+
+/**
+ * @brief Largest payload of a comm packet, room is left for the
+ *        ethernet header with an 802.1Q tag.
+ */
+static inline uint32_t comm_payload_max(void){
+    return MAX_COMM_PKT_SIZE - comm_hdr_size() - sizeof(ethernet_vlan_hdr_t);
+}
+
+/**
+ * @brief L2 addresses, ethertype and 802.1Q tag a packet is sent on a
+ *        link with.
+ *
+ * Addresses not given in l2 (0, or l2 NULL for data link packets) are
+ * those of the interfaces at both ends of the link.
+ *
+ * @param  wire_l2: filled with the L2 addresses of the packet
+ * @param  l2: L2 addresses of the packet, NULL for data link packets
+ * @param  from_if: interface the packet is sent out of
+ * @param  to_if: interface at the other end of the link
+ */
+static inline void comm_l2_resolve(pkt_l2_t *wire_l2, const pkt_l2_t *l2,
+                                   interface_t *from_if, interface_t *to_if){
+    wire_l2->ethertype = l2 ? l2->ethertype : 0;
+    wire_l2->dst_mac = (l2 && l2->dst_mac) ? l2->dst_mac : IF_MAC(to_if).mac;
+    wire_l2->src_mac = (l2 && l2->src_mac) ? l2->src_mac : IF_MAC(from_if).mac;
+    wire_l2->vlan_tci = l2 ? l2->vlan_tci : 0;
+}
+
+/**
+ * @brief Write the comm header of a packet sent on an interface.
+ *
+ * @param  hdr: where to write comm_hdr_size() bytes of header
+ * @param  from_if: sending interface
+ * @param  to_if: interface at the other end of the link
+ */
+static void comm_hdr_fill(char *hdr, interface_t *from_if, interface_t *to_if){
+    uint64_t now_ns = timer_now_ns();
+    if(comm_hdr_format == COMM_HDR_NAME){
+        strncpy(hdr, to_if->interface_name, IF_NAME_SIZE);
+        memcpy(hdr + IF_NAME_SIZE, &now_ns, sizeof(now_ns));
+        return;
+    }
+    comm_hdr_t *ch = (comm_hdr_t *)hdr;
+    ch->ifindex = to_if->ifindex;
+    ch->flags = 0;
+    // Receiver threads and the CLI may send on the same interface
+    ch->seq = __atomic_fetch_add(&from_if->comm_tx_seq, 1, __ATOMIC_RELAXED);
+    ch->tx_ns = now_ns;
+}
+
+/**
+ * @brief Write the comm header of a packet sent on an interface,
+ *        followed by its ethernet header in wire format.
+ *
+ * @param  hdr: where to write the headers, COMM_PKT_HDR_MAX_SIZE bytes
+ *              at most
+ * @param  from_if: sending interface
+ * @param  to_if: interface at the other end of the link
+ * @param  l2: L2 addresses, ethertype and tag, NULL for a data link
+ *             packet from from_if to to_if
+ * @return bytes of the headers
+ */
+static uint32_t comm_pkt_hdr_fill(char *hdr, interface_t *from_if, interface_t *to_if,
+                                  const pkt_l2_t *l2){
+    pkt_l2_t wire_l2;
+    uint32_t hdr_size = comm_hdr_size();
+    comm_hdr_fill(hdr, from_if, to_if);
+    comm_l2_resolve(&wire_l2, l2, from_if, to_if);
+    return hdr_size + eth_hdr_build(&wire_l2, hdr + hdr_size);
+}
+
+/**
+ * @brief Total bytes of a packet given in pieces.
+ */
+static inline size_t comm_iov_len(const struct iovec *iov, int iovcnt){
+    size_t len = 0;
+    for(int i=0; i<iovcnt; i++){
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
+/**
+ * @brief Copy the pieces of a packet one after the other into dst.
+ */
+static inline void comm_iov_gather(char *dst, const struct iovec *iov, int iovcnt){
+    for(int i=0; i<iovcnt; i++){
+        memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+        dst += iov[i].iov_len;
+    }
+}
+
+// I/O engine driving the UDP sockets. Set with comm_set_io_engine
+// before the receiver threads start.
+static comm_io_engine_t comm_io_engine = COMM_IO_EPOLL;
+
+// Number of comm packets drained from a socket by one recvmmsg call.
+// Set with comm_set_rx_burst_size before the receiver thread starts.
+static unsigned int rx_burst_size = COMM_RX_BURST_DEFAULT;
+
+/**
+ * @brief Set the number of packets the receiver drains per socket read.
+ *
+ * @param  burst_size: packets per recvmmsg call, 1 to COMM_RX_BURST_MAX
+ * @return 0: Success
+ *        -1: Fail, burst size out of range
+ */
+int comm_set_rx_burst_size(unsigned int burst_size){
+    if(burst_size == 0 || burst_size > COMM_RX_BURST_MAX){
+        printf("RX burst size must be between 1 and %d\n", COMM_RX_BURST_MAX);
+        return -1;
+    }
+    rx_burst_size = burst_size;
+    return 0;
+}
+
+/**
+ * @brief Get a latency histogram, allocating it on first use.
+ *
+ * Only the receiver thread recording into the histogram allocates it,
+ * the CLI reads the pointer without locking.
+ *
+ * @param  hp: where the histogram pointer is kept
+ * @return histogram, NULL if it could not be allocated
+ */
+static lat_hist_t *comm_lat_hist_get(lat_hist_t **hp){
+    lat_hist_t *h = __atomic_load_n(hp, __ATOMIC_ACQUIRE);
+    if(h == NULL && (h = lat_hist_create()) != NULL){
+        __atomic_store_n(hp, h, __ATOMIC_RELEASE);
+    }
+    return h;
+}
+
+/**
+ * @brief Record the send to receive latency of a packet.
+ *
+ * Counted for the receiving node and for the direction of the link
+ * leading to the receive interface.
+ *
+ * @param  node: receiving node
+ * @param  rx_if: receive interface
+ * @param  latency_ns: time from comm_hdr_fill at the sender to now
+ */
+static void comm_record_latency(node_t *node, interface_t *rx_if, uint64_t latency_ns){
+    link_t *link = rx_if->link;
+    unsigned int dir = (&link->if1 == rx_if) ? 0 : 1;
+    lat_hist_t *h;
+
+    if((h = comm_lat_hist_get(&node->lat_hist)) != NULL){
+        lat_hist_record(h, latency_ns);
+    }
+    if((h = comm_lat_hist_get(&link->lat_hist[dir])) != NULL){
+        lat_hist_record(h, latency_ns);
+    }
+}
+
+// Timer queue of the receiver thread running on this thread. Holds
+// the packets crossing emulated links until they reach the other end,
+// and the aging timers of the ARP tables of the thread's nodes.
+static __thread timer_queue_t *rx_emu_timers = NULL;
+
+/**
+ * @brief Timer queue of the receiver thread calling
+ *
+ * Timers on it run on the same thread, in between packets.
+ *
+ * @return timer queue, NULL if not called from a receiver thread
+ */
+timer_queue_t *comm_rx_timers(void){
+    return rx_emu_timers;
+}
+
+/**
+ * @brief Deliver a packet that reached the end of an emulated link.
+ *
+ * Timer callback, runs on the receiver thread of the receiving node.
+ *
+ * @param  arg: receive interface
+ * @param  data: packet buffer from the pool holding the data link packet
+ */
+static void _comm_emu_deliver(void *arg, void *data){
+    interface_t *rx_if = (interface_t *)arg;
+    pkt_buf_t *pb = (pkt_buf_t *)data;
+    data_link_pkt_receive(rx_if->attached_node, rx_if, pb);
+    pkt_buf_free(pb);
+}
+
+/**
+ * @brief Free a packet still in flight on an emulated link, or drop
+ *        an ARP or MAC table aging timer.
+ *
+ * Timer cancel callback, used when the receiver threads stop.
+ */
+static void _comm_emu_discard(timer_event_t *ev){
+    if(ev->cb == _comm_emu_deliver){
+        pkt_buf_free((pkt_buf_t *)ev->data);
+    } else {
+        arp_timer_cancel(ev);
+        l2_switch_age_cancel(ev);
+    }
+}
+
+/**
+ * @brief Put a received packet through the impairments of its link.
+ *
+ * Each copy of the packet that is not lost is copied into a pool buffer,
+ * since the receive buffer is reused once this returns, and held on the
+ * thread's timer queue until it reaches the other end of the link.
+ *
+ * @param  rx_if: receive interface
+ * @param  pb: packet buffer holding the data link packet
+ * @return 0: Success
+ *        -1: Fail
+ */
+static int _comm_emu_recv(interface_t *rx_if, pkt_buf_t *pb){
+    link_t *link = rx_if->link;
+    unsigned int dir = (&link->if1 == rx_if) ? 0 : 1;
+    uint64_t deliver_ns[2];
+
+    if(rx_emu_timers == NULL){
+        // Not on a receiver thread, nothing can hold the packet
+        return data_link_pkt_receive(rx_if->attached_node, rx_if, pb);
+    }
+
+    unsigned int n_copies = link_emu_schedule(&link->emu, dir, pb->len,
+                                              timer_now_ns(), deliver_ns);
+    for(unsigned int i=0; i<n_copies; i++){
+        pkt_buf_t *copy = pkt_buf_alloc();
+        if(copy == NULL){
+            link_emu_drop_no_buf(&link->emu, dir);
+            continue;
+        }
+        memcpy(pkt_buf_put(copy, pb->len), pb->data, pb->len);
+        copy->tx_ns = pb->tx_ns;
+        copy->l2 = pb->l2;
+        if(timer_queue_add(rx_emu_timers, deliver_ns[i], _comm_emu_deliver,
+                           rx_if, copy) < 0){
+            pkt_buf_free(copy);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Parse the comm header of a received packet
+ *
+ * Extracts the rx interface and TX timestamp of the packet from the
+ * comm header, which is then pulled off the packet buffer in place.
+ * The ethernet header that follows is popped into pb->l2 (see
+ * eth_hdr_pop): the buffer holds the data link packet.
+ *
+ * @param  node: node on which the packet is received
+ * @param  pb: packet buffer holding the comm packet
+ * @return rx interface of the packet
+ *         NULL if the packet is dropped
+ */
+static interface_t *_comm_pkt_parse(node_t *node, pkt_buf_t *pb){
+    uint32_t hdr_size = comm_hdr_size();
+    if(pb->len < hdr_size){
+        comm_stats_rx_drop(&node->stats, COMM_DROP_TRUNCATED);
+        return NULL;
+    }
+
+    // extract the rx interface of the packet
+    interface_t *rx_if;
+    if(comm_hdr_format == COMM_HDR_NAME){
+        char *rx_if_name = pb->data; // we can do this because we have \0 character at end of if name.
+        rx_if = get_node_if_by_name(node, rx_if_name);
+        if(rx_if == NULL){
+            comm_stats_rx_drop(&node->stats, COMM_DROP_UNKNOWN_IF);
+            return NULL;
+        }
+        memcpy(&pb->tx_ns, pb->data + IF_NAME_SIZE, sizeof(pb->tx_ns));
+    } else {
+        comm_hdr_t *ch = (comm_hdr_t *)pb->data;
+        if(ch->ifindex >= MAX_INTERFACES_PER_NODE ||
+           (rx_if = node->interfaces[ch->ifindex]) == NULL){
+            comm_stats_rx_drop(&node->stats, COMM_DROP_UNKNOWN_IF);
+            return NULL;
+        }
+        pb->tx_ns = ch->tx_ns;
+    }
+    pkt_buf_pull(pb, hdr_size);
+    if(eth_hdr_pop(pb) == NULL){
+        comm_stats_rx_drop(&node->stats, COMM_DROP_MALFORMED);
+        return NULL;
+    }
+    return rx_if;
+}
+
+/**
+ * @brief Hand a qualified data link packet to the link emulation of its
+ *        interface, or to the data link layer
+ */
+static int _comm_pkt_deliver(node_t *node, interface_t *rx_if, pkt_buf_t *pb){
+    if(link_emu_enabled(&rx_if->link->emu)){
+        return _comm_emu_recv(rx_if, pb);
+    }
+    data_link_pkt_receive(node, rx_if, pb);
+    return 0;
+}
+
+/**
+ * @brief Receive comm packet
+ *
+ * extracts the rx interface from the comm header and forwards payload
+ * to data link receiver module, unless the interface does not take
+ * the frame (see l2_recv_qualify_at_if).
+ *
+ * @param  node: node on which the packet is received
+ * @param  pb: packet buffer holding the comm packet
+ * @return 0: Success, the packet was delivered or filtered out
+ *        -1: Fail
+ */
+static int _comm_pkt_recv_one(node_t *node, pkt_buf_t *pb){
+    interface_t *rx_if = _comm_pkt_parse(node, pb);
+    if(rx_if == NULL){
+        return -1;
+    }
+    if(!l2_recv_qualify_at_if(rx_if, pb->l2.dst_mac)){
+        return 0;
+    }
+    return _comm_pkt_deliver(node, rx_if, pb);
+}
+
+/**
+ * @brief Receive a burst of comm packets
+ *
+ * Each message was received at PKT_BUF_HEADROOM into its buffer, the
+ * buffers are wrapped as packet buffers and processed in place. The
+ * comm headers of the whole burst are parsed first, then the frames of
+ * each run of packets to the same interface are qualified together
+ * with l2_recv_qualify_burst before being delivered.
+ *
+ * @param  node: node on which the packets are received
+ * @param  msgs: messages filled in by recvmmsg
+ * @param  n_msgs: number of messages received
+ * @return 0: all packets delivered to data link layer, or filtered out
+ *        -1: at least one packet could not be delivered
+ */
+int _comm_pkt_recv(node_t *node, struct mmsghdr *msgs, unsigned int n_msgs){
+    int ret = 0;
+    pkt_buf_t pb[COMM_RX_BURST_MAX];
+    interface_t *rx_ifs[COMM_RX_BURST_MAX];
+    uint64_t dst_macs[COMM_RX_BURST_MAX];
+
+    for(unsigned int base=0; base<n_msgs; base+=COMM_RX_BURST_MAX){
+        unsigned int n = n_msgs - base;
+        unsigned int n_parsed = 0;
+        if(n > COMM_RX_BURST_MAX){
+            n = COMM_RX_BURST_MAX;
+        }
+        for(unsigned int i=0; i<n; i++){
+            struct mmsghdr *msg = &msgs[base + i];
+            char *buf = (char *)msg->msg_hdr.msg_iov[0].iov_base - PKT_BUF_HEADROOM;
+            pkt_buf_init(&pb[n_parsed], buf, PKT_BUF_SIZE);
+            pb[n_parsed].len = msg->msg_len;
+            if((rx_ifs[n_parsed] = _comm_pkt_parse(node, &pb[n_parsed])) == NULL){
+                ret = -1;
+                continue;
+            }
+            dst_macs[n_parsed] = pb[n_parsed].l2.dst_mac;
+            n_parsed++;
+        }
+        unsigned int run_end;
+        for(unsigned int run=0; run<n_parsed; run=run_end){
+            for(run_end=run+1; run_end<n_parsed && rx_ifs[run_end] == rx_ifs[run]; run_end++);
+            uint64_t accept = l2_recv_qualify_burst(rx_ifs[run], &dst_macs[run], run_end - run);
+            for(; accept != 0; accept &= accept - 1){
+                unsigned int i = run + __builtin_ctzll(accept);
+                if(_comm_pkt_deliver(node, rx_ifs[i], &pb[i]) < 0){
+                    ret = -1;
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Wake up the RX shard of a node after packets were put on its rings.
+ *
+ * Only the first packet after the node started draining its rings
+ * writes to the eventfd, later ones see the wakeup already pending.
+ *
+ * @param  node: node whose rings have new packets
+ */
+static void comm_shm_wakeup(node_t *node){
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_exchange_n(&node->comm_shm_wakeup_pending, 1, __ATOMIC_SEQ_CST) == 0){
+        uint64_t one = 1;
+        if(write(node->comm_shm_event_fd, &one, sizeof(one)) < 0){
+            perror("eventfd write");
+        }
+    }
+}
+
+/**
+ * @brief Drain the RX rings of all interfaces of a node.
+ *
+ * Called by the node's RX shard thread when the node's eventfd fires.
+ * Every interface has a ring per thread that sent to it.
+ * At most one ring's worth of packets is taken from each ring so a busy
+ * link cannot starve the other nodes of the shard; if packets are left
+ * the node wakes itself up again.
+ *
+ * @param  node: node whose rings are drained
+ * @param  n_bytes: set to the number of comm packet bytes received
+ * @return number of comm packets received
+ */
+static unsigned int _comm_shm_recv(node_t *node, uint64_t *n_bytes){
+    uint64_t cnt;
+    unsigned int n_pkts = 0;
+    int pending = 0;
+
+    *n_bytes = 0;
+    if(read(node->comm_shm_event_fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN){
+        perror("eventfd read");
+    }
+    // Clear the pending flag before looking at the rings, a packet
+    // published after this point wakes the node up again.
+    __atomic_store_n(&node->comm_shm_wakeup_pending, 0, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
+        interface_t *intf = node->interfaces[i];
+        if(intf == NULL){
+            continue;
+        }
+        for(int r=0; r<MAX_RX_RINGS_PER_INTF; r++){
+            // Published by the sender that created the ring
+            spsc_ring_t *ring = __atomic_load_n(&intf->comm_rx_rings[r], __ATOMIC_ACQUIRE);
+            if(ring == NULL){
+                continue;
+            }
+            char *slot;
+            uint32_t len;
+            pkt_buf_t pb;
+            for(uint32_t j=0; j<ring->n_slots; j++){
+                if((slot = spsc_ring_peek(ring, &len)) == NULL){
+                    break;
+                }
+                // The comm packet sits at PKT_BUF_HEADROOM in the slot
+                pkt_buf_init(&pb, slot, ring->slot_size);
+                pb.len = len;
+                _comm_pkt_recv_one(node, &pb);
+                spsc_ring_release(ring);
+                n_pkts++;
+                *n_bytes += len;
+            }
+            if(spsc_ring_peek(ring, &len) != NULL){
+                pending = 1;
+            }
+        }
+    }
+    if(pending){
+        comm_shm_wakeup(node);
+    }
+    return n_pkts;
+}
+
+/**
+ * @brief Number of file descriptors open in the process.
+ */
+static unsigned int comm_open_fds(void){
+    unsigned int n = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    if(dir == NULL){
+        return 0;
+    }
+    while(readdir(dir) != NULL){
+        n++;
+    }
+    closedir(dir);
+    return n;
+}
+
+/**
+ * @brief Raise the soft limit of open file descriptors.
+ *
+ * @param  n_fds: limit wanted, raised to the hard limit at most
+ * @return 0: Success
+ *        -1: Fail, the hard limit is below n_fds
+ */
+static int comm_raise_nofile(rlim_t n_fds){
+    struct rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) < 0){
+        perror("getrlimit");
+        return -1;
+    }
+    if(rl.rlim_cur >= n_fds){
+        return 0;
+    }
+    int ret = 0;
+    if(rl.rlim_max != RLIM_INFINITY && rl.rlim_max < n_fds){
+        printf("%lu file descriptors needed, RLIMIT_NOFILE hard limit is %lu\n",
+               (unsigned long)n_fds, (unsigned long)rl.rlim_max);
+        n_fds = rl.rlim_max;
+        ret = -1;
+    }
+    rl.rlim_cur = n_fds;
+    if(setrlimit(RLIMIT_NOFILE, &rl) < 0){
+        perror("setrlimit");
+        return -1;
+    }
+    return ret;
+}
+
+/**
+ * @brief Open a UDP socket, raising the file descriptor limit if it
+ *        is what stops it.
+ *
+ * @return socket: Success
+ *         -1: Fail
+ */
+static int comm_udp_socket(void){
+    int sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(sockfd < 0 && errno == EMFILE){
+        struct rlimit rl;
+        if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max &&
+           comm_raise_nofile(rl.rlim_cur * 2 < rl.rlim_max ? rl.rlim_cur * 2 : rl.rlim_max) == 0){
+            sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        }
+    }
+    return sockfd;
+}
+
+/**
+ * @brief Initialize a UDP server socket on a node to recieve messages for that node.
+ *
+ * Each node is assigned a free port number and a UDP socket
+ * is bound to that port number to receive data for that node.
+ *
+ * @param  node: pointer to node whose data structures are filled
+ * @return  0: Success
+ *         <0: Fail
+ */
+int init_comm_server_socket(node_t *node){
+    int sockfd;
+    struct sockaddr_in server_addr;
+    uint32_t server_listen_port = node->comm_server_listen_port;
+
+    if ((sockfd = comm_udp_socket()) < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    // Fill server information
+    server_addr.sin_family = AF_INET; // IPv4
+    server_addr.sin_addr.s_addr = node->comm_server_ip; // Endpoint of the node
+    server_addr.sin_port = htons(server_listen_port); // Port number
+
+    // Bind the socket to its source port and source IPs
+    if (bind(sockfd, (const struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        perror("Bind failed");
+        close(sockfd);
+        return -1;
+    }
+    if(server_listen_port == 0){
+        // Record the port the kernel picked
+        socklen_t addr_len = sizeof(server_addr);
+        if(getsockname(sockfd, (struct sockaddr *)&server_addr, &addr_len) < 0){
+            perror("getsockname");
+            close(sockfd);
+            return -1;
+        }
+        node->comm_server_listen_port = ntohs(server_addr.sin_port);
+    }
+
+    // store the socket fd into the node data structure
+    node->comm_udp_server_sock_fd = sockfd;
+
+    return 0; //success
+}
+
+/**
+ * @brief Initialize the TX socket of an interface.
+ *
+ * A UDP socket is created and connected to the listen port of the
+ * node at the other end of the interface's link. The socket lives as
+ * long as the link, so sending a packet is a single send() call.
+ *
+ * @param  intf: pointer to interface whose TX socket is created
+ * @return  0: Success
+ *         <0: Fail
+ */
+int init_comm_tx_socket(interface_t *intf){
+    int sockfd;
+    struct sockaddr_in dst_addr;
+
+    intf->comm_tx_sock_fd = -1;
+    if(!intf->attached_node->comm_local){
+        // Sent from by the process running the node
+        return 0;
+    }
+    node_t *nbr_node = get_nbr_node(intf);
+    if(nbr_node == NULL){
+        printf("No neighbour node across interface %s\n", intf->interface_name);
+        return -1;
+    }
+
+    if(nbr_node->comm_server_listen_port == 0){
+        printf("Neighbour node %s across interface %s has no listen port yet\n",
+               nbr_node->node_name, intf->interface_name);
+        return -1;
+    }
+
+    if ((sockfd = comm_udp_socket()) < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    // The neighbour node runs in this or another process, its
+    // endpoint identifies it.
+    memset(&dst_addr, 0, sizeof(dst_addr));
+    dst_addr.sin_family = AF_INET;
+    dst_addr.sin_port = htons(nbr_node->comm_server_listen_port);
+    dst_addr.sin_addr.s_addr = nbr_node->comm_server_ip;
+
+    if (connect(sockfd, (const struct sockaddr *)&dst_addr, sizeof(dst_addr)) < 0) {
+        perror("Connect failed");
+        close(sockfd);
+        return -1;
+    }
+
+    intf->comm_tx_sock_fd = sockfd;
+    return 0; //success
+}
+
+/**
+ * @brief Initialize the comm state of a node for the selected transport.
+ *
+ * With the UDP transport the node gets a listen socket, opened later by
+ * comm_bringup with the parallel bring-up. With the shared memory
+ * transport it gets an eventfd through which senders wake up its
+ * receiver thread.
+ *
+ * @param  node: pointer to node whose data structures are filled
+ * @return  0: Success
+ *         <0: Fail
+ */
+int init_comm_node(node_t *node){
+    comm_nodes_initialized++;
+    node->comm_udp_server_sock_fd = -1;
+    node->comm_shm_event_fd = -1;
+    node->comm_shm_wakeup_pending = 0;
+    if(comm_node_endpoint(node) < 0){
+        return -1;
+    }
+    if(!node->comm_local){
+        // Run by another process
+        return 0;
+    }
+
+    if(comm_transport == COMM_TRANSPORT_SHM){
+        node->comm_shm_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(node->comm_shm_event_fd < 0){
+            perror("eventfd");
+            return -1;
+        }
+        return 0;
+    }
+    if(comm_bringup_mode == COMM_BRINGUP_PARALLEL && !comm_brought_up){
+        // Opened by comm_bringup
+        return 0;
+    }
+    return init_comm_server_socket(node);
+}
+
+/**
+ * @brief Initialize the comm state of an interface for the selected transport.
+ *
+ * With the UDP transport the interface gets its connected TX socket,
+ * opened later by comm_bringup with the parallel bring-up.
+ * With the shared memory transport its RX rings start empty, each
+ * thread of the node across the link that sends towards this interface
+ * creates its ring on its first packet.
+ *
+ * @param  intf: pointer to interface whose link is wired
+ * @return  0: Success
+ *         <0: Fail
+ */
+int init_comm_intf(interface_t *intf){
+    intf->comm_tx_sock_fd = -1;
+    for(int r=0; r<MAX_RX_RINGS_PER_INTF; r++){
+        intf->comm_rx_rings[r] = NULL;
+    }
+    intf->comm_rx_shared_lock = 0;
+
+    if(comm_transport == COMM_TRANSPORT_SHM){
+        // Rings are created by the senders on their first packet
+        return 0;
+    }
+    if(comm_bringup_mode == COMM_BRINGUP_PARALLEL && !comm_brought_up){
+        // Opened by comm_bringup
+        return 0;
+    }
+    return init_comm_tx_socket(intf);
+}
+
+/**
+ * @brief Release the comm state of a node.
+ *
+ * The receiver threads must be stopped before.
+ *
+ * @param  node: pointer to node being destroyed
+ */
+void destroy_comm_node(node_t *node){
+    if(node->comm_udp_server_sock_fd >= 0){
+        close(node->comm_udp_server_sock_fd);
+        node->comm_udp_server_sock_fd = -1;
+    }
+    if(node->comm_shm_event_fd >= 0){
+        close(node->comm_shm_event_fd);
+        node->comm_shm_event_fd = -1;
+    }
+    // Fixed ports are handed out again once every node is gone
+    if(--comm_nodes_initialized == 0){
+        comm_next_node_index = 0;
+        comm_brought_up = 0;
+    }
+}
+
+/**
+ * @brief Release the comm state of an interface.
+ *
+ * The receiver threads must be stopped before.
+ *
+ * @param  intf: pointer to interface whose link is being destroyed
+ */
+void destroy_comm_intf(interface_t *intf){
+    capture_stop(&intf->capture);
+    if(intf->comm_tx_sock_fd >= 0){
+        close(intf->comm_tx_sock_fd);
+        intf->comm_tx_sock_fd = -1;
+    }
+    for(int r=0; r<MAX_RX_RINGS_PER_INTF; r++){
+        spsc_ring_destroy(intf->comm_rx_rings[r]);
+        intf->comm_rx_rings[r] = NULL;
+    }
+}
+
+/**
+ * RX shard: one receiver thread with its own epoll set.
+ *
+ * Every node is owned by exactly one shard, so all packets received by
+ * a node are processed on the same thread. Load counters are written by
+ * the shard thread only and read without locking by the CLI.
+ */
+typedef struct comm_rx_shard_ {
+    unsigned int shard_id;
+    int epoll_fd;
+    int stop_fd;            ///< eventfd signalled to stop the shard thread
+    pthread_t thread;
+    unsigned int n_nodes;   ///< nodes assigned to this shard
+    uint64_t epoll_wakeups; ///< epoll_wait calls that returned events
+    uint64_t rx_bursts;     ///< recvmmsg calls that returned packets
+    uint64_t rx_pkts;       ///< comm packets received
+    uint64_t rx_bytes;      ///< comm packet bytes received
+    // io_uring engine: multishot receives of all nodes of the shard
+    // complete on this ring, into buffers of the shard's buffer ring.
+    int use_uring;
+    uring_t rx_uring;
+    uring_buf_ring_t rx_uring_bufs;
+    // Packets in flight on emulated links towards the shard's nodes
+    timer_queue_t emu_timers;
+} __attribute__((aligned(64))) comm_rx_shard_t;
+
+static comm_rx_shard_t rx_shards[COMM_MAX_RX_SHARDS];
+// Number of receiver threads. Set with comm_set_rx_shards before the
+// receiver threads start.
+static unsigned int n_rx_shards = 1;
+static unsigned int n_rx_shards_running = 0;
+// Held for reading while another thread adds a timer to a shard, for
+// writing while the shards start or stop
+static pthread_rwlock_t rx_shards_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Single writer counter update, readers only need a consistent value
+#define SHARD_STAT_ADD(counter, val) \
+    __atomic_store_n(&(counter), (counter) + (val), __ATOMIC_RELAXED)
+#define SHARD_STAT_READ(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+/**
+ * @brief Set the number of receiver threads.
+ *
+ * @param  n_shards: number of RX shards, 1 to COMM_MAX_RX_SHARDS
+ * @return 0: Success
+ *        -1: Fail, out of range or receiver threads already running
+ */
+int comm_set_rx_shards(unsigned int n_shards){
+    if(n_shards == 0 || n_shards > COMM_MAX_RX_SHARDS){
+        printf("Number of RX shards must be between 1 and %d\n", COMM_MAX_RX_SHARDS);
+        return -1;
+    }
+    if(n_rx_shards_running != 0){
+        printf("RX shards cannot be changed once the receiver threads run\n");
+        return -1;
+    }
+    n_rx_shards = n_shards;
+    return 0;
+}
+
+/**
+ * @brief Select the I/O engine driving the nodes' UDP sockets.
+ *
+ * @param  engine: COMM_IO_EPOLL or COMM_IO_URING
+ * @return 0: Success
+ *        -1: Fail, receiver threads already running
+ */
+int comm_set_io_engine(comm_io_engine_t engine){
+    if(n_rx_shards_running != 0){
+        printf("I/O engine cannot be changed once the receiver threads run\n");
+        return -1;
+    }
+    comm_io_engine = engine;
+    return 0;
+}
+
+comm_io_engine_t comm_get_io_engine(void){
+    return comm_io_engine;
+}
+
+/**
+ * io_uring engine TX context of a thread.
+ *
+ * Comm packets are built in the context's buffers and queued as send
+ * SQEs on the TX sockets of the interfaces. A flush submits the whole
+ * batch and waits for all of it in one io_uring_enter call, after
+ * which the buffers can be reused.
+ */
+typedef struct comm_uring_tx_ {
+    uring_t ring;
+    unsigned int n_pending;
+    char (*bufs)[MAX_COMM_PKT_SIZE];
+    int *status_out[COMM_URING_TX_BATCH]; ///< where to report each send's result
+    interface_t *intf[COMM_URING_TX_BATCH]; ///< sending interface of each send
+    uint32_t len[COMM_URING_TX_BATCH]; ///< data link packet bytes of each send
+} comm_uring_tx_t;
+
+static __thread comm_uring_tx_t *uring_tx = NULL;
+// Set on receiver threads: sends are only queued and go out in one
+// batch at the end of each receive loop iteration.
+static __thread int uring_tx_deferred = 0;
+
+static comm_uring_tx_t *comm_uring_tx_get(void){
+    if(uring_tx != NULL){
+        return uring_tx;
+    }
+    comm_uring_tx_t *tx = calloc(1, sizeof(comm_uring_tx_t));
+    if(tx == NULL){
+        perror("calloc");
+        return NULL;
+    }
+    tx->bufs = calloc(COMM_URING_TX_BATCH, MAX_COMM_PKT_SIZE);
+    if(tx->bufs == NULL){
+        perror("calloc");
+        free(tx);
+        return NULL;
+    }
+    if(uring_init(&tx->ring, COMM_URING_TX_BATCH) < 0){
+        free(tx->bufs);
+        free(tx);
+        return NULL;
+    }
+    uring_tx = tx;
+    return tx;
+}
+
+/**
+ * @brief Free this thread's io_uring TX ring, if it has one.
+ */
+static void comm_uring_tx_release(void){
+    comm_uring_tx_t *tx = uring_tx;
+    if(tx == NULL){
+        return;
+    }
+    uring_exit(&tx->ring);
+    free(tx->bufs);
+    free(tx);
+    uring_tx = NULL;
+}
+
+/**
+ * @brief Send all comm packets queued on this thread's io_uring.
+ *
+ * @return 0: every queued packet was sent
+ *        -1: at least one send failed
+ */
+static int comm_uring_tx_flush(void){
+    comm_uring_tx_t *tx = uring_tx;
+    struct io_uring_cqe *cqe;
+    int ret = 0;
+
+    if(tx == NULL || tx->n_pending == 0){
+        return 0;
+    }
+
+    if(uring_submit_and_wait(&tx->ring, tx->n_pending) < 0){
+        // Nothing went out, the SQEs are dropped with the batch
+        tx->ring.sqe_tail = *tx->ring.sq_tail;
+        for(unsigned int i=0; i<tx->n_pending; i++){
+            comm_stats_tx_drop(&tx->intf[i]->stats, COMM_DROP_TX_ERROR);
+            if(tx->status_out[i] != NULL){
+                *tx->status_out[i] = -1;
+            }
+        }
+        tx->n_pending = 0;
+        return -1;
+    }
+
+    for(unsigned int n=0; n<tx->n_pending; ){
+        if((cqe = uring_peek_cqe(&tx->ring)) == NULL){
+            uring_submit_and_wait(&tx->ring, tx->n_pending - n);
+            continue;
+        }
+        unsigned int slot = (unsigned int)cqe->user_data;
+        int res = cqe->res;
+        uring_cqe_seen(&tx->ring);
+        if(res < 0){
+            printf("Sending packet failed on interface %s: %s\n",
+                   tx->intf[slot]->interface_name, strerror(-res));
+            comm_stats_tx_drop(&tx->intf[slot]->stats, COMM_DROP_TX_ERROR);
+            ret = -1;
+        } else {
+            comm_stats_tx(&tx->intf[slot]->stats, tx->len[slot]);
+        }
+        if(tx->status_out[slot] != NULL){
+            *tx->status_out[slot] = (res < 0) ? -1 : 0;
+        }
+        n++;
+    }
+    tx->n_pending = 0;
+    return ret;
+}
+
+/**
+ * @brief Queue a comm packet for sending on this thread's io_uring.
+ *
+ * The pieces of the packet are copied after the comm and ethernet
+ * headers into one of the context's buffers, which stay in use until
+ * the flush.
+ *
+ * @param  from_if: sending interface
+ * @param  to_if: interface at the other end of the link
+ * @param  iov: pieces of the packet to send
+ * @param  iovcnt: number of pieces
+ * @param  pkt_size: size in bytes of packet to send
+ * @param  l2: L2 addresses, ethertype and tag, NULL for a data link packet
+ * @param  status_out: optional, set to 0 or -1 once the packet is flushed
+ * @return 0: Success
+ *        -1: Fail
+ */
+static int _send_pkt_out_uring(interface_t *from_if, interface_t *to_if,
+                               const struct iovec *iov, int iovcnt,
+                               size_t pkt_size, const pkt_l2_t *l2, int *status_out){
+    comm_uring_tx_t *tx = comm_uring_tx_get();
+    if(tx == NULL){
+        comm_stats_tx_drop(&from_if->stats, COMM_DROP_NO_BUF);
+        return -1;
+    }
+    if(tx->n_pending == COMM_URING_TX_BATCH){
+        comm_uring_tx_flush();
+    }
+
+    unsigned int slot = tx->n_pending;
+    char *buf = tx->bufs[slot];
+    uint32_t hdr_size = comm_pkt_hdr_fill(buf, from_if, to_if, l2);
+    comm_iov_gather(buf + hdr_size, iov, iovcnt);
+
+    struct io_uring_sqe *sqe = uring_get_sqe(&tx->ring);
+    if(sqe == NULL){
+        printf("io_uring TX queue is full\n");
+        comm_stats_tx_drop(&from_if->stats, COMM_DROP_TX_ERROR);
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = from_if->comm_tx_sock_fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = hdr_size + pkt_size;
+    sqe->user_data = slot;
+    tx->status_out[slot] = status_out;
+    tx->intf[slot] = from_if;
+    tx->len[slot] = pkt_size;
+    tx->n_pending++;
+    return 0;
+}
+
+/**
+ * @brief Queue a multishot receive on a node's socket.
+ *
+ * The receive stays armed and completes once per datagram, each time
+ * into a buffer picked from the shard's buffer ring, until the kernel
+ * terminates it (for instance when it ran out of buffers).
+ *
+ * @param  shard: RX shard of the node
+ * @param  node: node whose socket is armed
+ * @return 0: Success
+ *        -1: Fail
+ */
+static int _comm_uring_arm_recv(comm_rx_shard_t *shard, node_t *node){
+    struct io_uring_sqe *sqe = uring_get_sqe(&shard->rx_uring);
+    if(sqe == NULL){
+        // SQ full, push what is queued to the kernel first
+        uring_submit_and_wait(&shard->rx_uring, 0);
+        if((sqe = uring_get_sqe(&shard->rx_uring)) == NULL){
+            printf("Unable to arm receive on node %s\n", node->node_name);
+            return -1;
+        }
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = node->comm_udp_server_sock_fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = shard->rx_uring_bufs.bgid;
+    sqe->user_data = (uint64_t)(uintptr_t)node;
+    return 0;
+}
+
+/**
+ * @brief Queue a poll on the timerfd of a shard's timer queue.
+ *
+ * The completion carries the shard itself as user data, which tells it
+ * apart from the receives that carry a node.
+ *
+ * @param  shard: RX shard whose timers are polled
+ * @return 0: Success
+ *        -1: Fail
+ */
+static int _comm_uring_arm_timer(comm_rx_shard_t *shard){
+    struct io_uring_sqe *sqe = uring_get_sqe(&shard->rx_uring);
+    if(sqe == NULL){
+        uring_submit_and_wait(&shard->rx_uring, 0);
+        if((sqe = uring_get_sqe(&shard->rx_uring)) == NULL){
+            printf("Unable to arm timer on RX shard %u\n", shard->shard_id);
+            return -1;
+        }
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = shard->emu_timers.timer_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = (uint64_t)(uintptr_t)shard;
+    return 0;
+}
+
+/**
+ * @brief Queue a poll on the stop eventfd of a shard.
+ *
+ * @param  shard: RX shard to stop once the eventfd is signalled
+ * @return 0: Success
+ *        -1: Fail
+ */
+static int _comm_uring_arm_stop(comm_rx_shard_t *shard){
+    struct io_uring_sqe *sqe = uring_get_sqe(&shard->rx_uring);
+    if(sqe == NULL){
+        uring_submit_and_wait(&shard->rx_uring, 0);
+        if((sqe = uring_get_sqe(&shard->rx_uring)) == NULL){
+            printf("Unable to arm stop on RX shard %u\n", shard->shard_id);
+            return -1;
+        }
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = shard->stop_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = (uint64_t)(uintptr_t)&shard->stop_fd;
+    return 0;
+}
+
+/**
+ * @brief Cancel every request pending on a shard's io_uring.
+ *
+ * Waits for the cancellation to complete, so the sockets of the nodes
+ * are no longer used by the ring once this returns and can be closed
+ * and their ports bound again right away.
+ *
+ * @param  shard: RX shard whose requests are cancelled
+ */
+static void _comm_uring_cancel_all(comm_rx_shard_t *shard){
+    uring_t *ring = &shard->rx_uring;
+    struct io_uring_cqe *cqe;
+
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if(sqe == NULL){
+        uring_submit_and_wait(ring, 0);
+        if((sqe = uring_get_sqe(ring)) == NULL){
+            return;
+        }
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_ANY;
+    sqe->user_data = 0;
+
+    // Cancelled requests complete with -ECANCELED before the
+    // cancellation itself, whose user data is 0
+    int done = 0;
+    while(!done){
+        if(uring_submit_and_wait(ring, 1) < 0){
+            return;
+        }
+        while((cqe = uring_peek_cqe(ring)) != NULL){
+            if(cqe->user_data == 0){
+                done = 1;
+            }
+            uring_cqe_seen(ring);
+        }
+    }
+}
+
+/**
+ * @brief Receive loop of a shard using the io_uring engine.
+ *
+ * One io_uring_enter call submits re-armed receives and waits for the
+ * next completions. Every completion is a received comm packet in a
+ * provided buffer, which is given back to the buffer ring once the
+ * packet is processed. Packets sent while processing are flushed as
+ * one batch per loop iteration. Returns once the shard is stopped.
+ *
+ * @param  shard: RX shard of this thread
+ */
+static void _comm_uring_rx_loop(comm_rx_shard_t *shard){
+    uring_t *ring = &shard->rx_uring;
+    uring_buf_ring_t *bring = &shard->rx_uring_bufs;
+    struct io_uring_cqe *cqe;
+
+    int stop = 0;
+
+    uring_tx_deferred = 1;
+    while(!stop){
+        if(uring_submit_and_wait(ring, 1) < 0){
+            break;
+        }
+        SHARD_STAT_ADD(shard->epoll_wakeups, 1);
+
+        unsigned int n_pkts = 0;
+        unsigned int n_recycled = 0;
+        uint64_t n_bytes = 0;
+        while((cqe = uring_peek_cqe(ring)) != NULL){
+            node_t *rx_node = (node_t *)(uintptr_t)cqe->user_data;
+            int res = cqe->res;
+            unsigned int flags = cqe->flags;
+            uring_cqe_seen(ring);
+
+            if((void *)rx_node == (void *)&shard->stop_fd){
+                stop = 1;
+                continue;
+            }
+            if((void *)rx_node == (void *)shard){
+                // Packets on emulated links are due
+                timer_queue_fired(&shard->emu_timers);
+                _comm_uring_arm_timer(shard);
+                continue;
+            }
+
+            if(flags & IORING_CQE_F_BUFFER){
+                uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                if(res > 0){
+                    pkt_buf_t pb;
+                    pkt_buf_init(&pb, uring_buf_ring_buf(bring, bid), PKT_BUF_SIZE);
+                    pb.len = res;
+                    _comm_pkt_recv_one(rx_node, &pb);
+                    n_pkts++;
+                    n_bytes += res;
+                }
+                uring_buf_ring_add(bring, bid);
+                n_recycled++;
+            } else if(res < 0 && res != -ENOBUFS){
+                printf("Receive on node %s failed: %s\n", rx_node->node_name, strerror(-res));
+            }
+
+            // Multishot receive ended, arm it again
+            if(!(flags & IORING_CQE_F_MORE)){
+                _comm_uring_arm_recv(shard, rx_node);
+            }
+        }
+        if(n_recycled > 0){
+            uring_buf_ring_advance(bring);
+        }
+        timer_queue_arm(&shard->emu_timers);
+        if(n_pkts > 0){
+            SHARD_STAT_ADD(shard->rx_bursts, 1);
+            SHARD_STAT_ADD(shard->rx_pkts, n_pkts);
+            SHARD_STAT_ADD(shard->rx_bytes, n_bytes);
+        }
+        comm_uring_tx_flush();
+    }
+    uring_tx_deferred = 0;
+    _comm_uring_cancel_all(shard);
+}
+
+/**
+ * @brief Thread function that monitors the comm sockets of a shard's nodes.
+ *
+ * Server thread running on local host that monitors the UDP sockets of
+ * the nodes assigned to its shard for data reception. With the shared
+ * memory transport it monitors the nodes' eventfds and drains their
+ * rings instead. With the io_uring engine it runs _comm_uring_rx_loop.
+ *
+ * @param  arg: RX shard of this thread
+ * @return NULL
+ *
+ */
+void* __network_start_pkt_receiver_thread(void* arg) {
+    comm_rx_shard_t *shard = (comm_rx_shard_t *) arg;
+    int epoll_fd = shard->epoll_fd;
+    struct epoll_event events[MAX_EVENTS];
+
+    rx_emu_timers = &shard->emu_timers;
+    if(shard->use_uring){
+        _comm_uring_rx_loop(shard);
+        goto exit;
+    }
+
+    // Receive buffers of one burst are allocated once and reused for
+    // every socket read. Packets are received after PKT_BUF_HEADROOM so
+    // headers can be pushed in front of them in place.
+    char (*rx_bufs)[PKT_BUF_SIZE] = calloc(COMM_RX_BURST_MAX, PKT_BUF_SIZE);
+    if(rx_bufs == NULL){
+        perror("calloc");
+        goto exit;
+    }
+    struct iovec rx_iovs[COMM_RX_BURST_MAX];
+    struct mmsghdr rx_msgs[COMM_RX_BURST_MAX];
+    memset(rx_msgs, 0, sizeof(rx_msgs));
+    for(int i=0; i<COMM_RX_BURST_MAX; i++){
+        rx_iovs[i].iov_base = rx_bufs[i] + PKT_BUF_HEADROOM;
+        rx_iovs[i].iov_len = MAX_COMM_PKT_SIZE;
+        rx_msgs[i].msg_hdr.msg_iov = &rx_iovs[i];
+        rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // thread polls on the sockets waiting for any readable data until
+    // it is stopped
+    int stop = 0;
+    while (!stop) {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n == -1) {
+            if(errno == EINTR){
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        SHARD_STAT_ADD(shard->epoll_wakeups, 1);
+
+        for (int i = 0; i < n; ++i) {
+            if(events[i].data.ptr == &shard->stop_fd){
+                stop = 1;
+                continue;
+            }
+            if(events[i].data.ptr == shard){
+                // Packets on emulated links are due
+                timer_queue_fired(&shard->emu_timers);
+                continue;
+            }
+            node_t *rx_node = (node_t *)events[i].data.ptr;
+            int sockfd = rx_node->comm_udp_server_sock_fd;
+
+            if(comm_transport == COMM_TRANSPORT_SHM){
+                uint64_t n_bytes;
+                unsigned int n_pkts = _comm_shm_recv(rx_node, &n_bytes);
+                if(n_pkts > 0){
+                    SHARD_STAT_ADD(shard->rx_bursts, 1);
+                    SHARD_STAT_ADD(shard->rx_pkts, n_pkts);
+                    SHARD_STAT_ADD(shard->rx_bytes, n_bytes);
+                }
+                continue;
+            }
+
+            // Drain up to a burst of comm packets from the socket in one
+            // call. Whatever is left keeps the socket readable and is
+            // picked up on the next epoll_wait.
+            int n_msgs = recvmmsg(sockfd, rx_msgs, rx_burst_size, MSG_DONTWAIT, NULL);
+            if (n_msgs > 0) {
+                uint64_t burst_bytes = 0;
+                for(int j=0; j<n_msgs; j++){
+                    burst_bytes += rx_msgs[j].msg_len;
+                }
+                SHARD_STAT_ADD(shard->rx_bursts, 1);
+                SHARD_STAT_ADD(shard->rx_pkts, n_msgs);
+                SHARD_STAT_ADD(shard->rx_bytes, burst_bytes);
+
+                // recv comm packets by the node.
+                if(_comm_pkt_recv(rx_node, rx_msgs, n_msgs) < 0 ){
+                    printf("Unable to recv packet\n");
+                }
+            }
+        }
+        timer_queue_arm(&shard->emu_timers);
+    }
+    free(rx_bufs);
+
+exit:
+    // Give back what this thread holds, the shard itself is freed by
+    // the thread stopping it
+    rx_emu_timers = NULL;
+    comm_uring_tx_release();
+    pkt_buf_cache_release();
+    return NULL;
+}
+
+/**
+ * @brief Release everything a shard holds. The shard thread must not be running.
+ *
+ * Packets still in flight on emulated links are dropped.
+ *
+ * @param  shard: RX shard to clean up
+ */
+static void _comm_rx_shard_cleanup(comm_rx_shard_t *shard){
+    timer_queue_cancel_all(&shard->emu_timers, _comm_emu_discard);
+    timer_queue_destroy(&shard->emu_timers);
+    if(shard->use_uring){
+        uring_buf_ring_exit(&shard->rx_uring, &shard->rx_uring_bufs);
+        uring_exit(&shard->rx_uring);
+        shard->use_uring = 0;
+    }
+    if(shard->stop_fd >= 0){
+        close(shard->stop_fd);
+        shard->stop_fd = -1;
+    }
+    if(shard->epoll_fd >= 0){
+        close(shard->epoll_fd);
+        shard->epoll_fd = -1;
+    }
+}
+
+/**
+ * @brief Stop a running shard thread and wait for it to exit.
+ *
+ * @param  shard: RX shard whose thread is stopped
+ */
+static void _comm_rx_shard_stop(comm_rx_shard_t *shard){
+    uint64_t one = 1;
+    if(write(shard->stop_fd, &one, sizeof(one)) < 0){
+        perror("eventfd write");
+    }
+    pthread_join(shard->thread, NULL);
+}
+
+/**
+ * @brief Set up the epoll or io_uring, the timer queue and the stop
+ *        eventfd of a shard.
+ *
+ * @param  shard: RX shard to set up
+ * @param  use_uring: set up the io_uring engine instead of epoll
+ * @return 0: Success
+ *        -1: Fail, the shard must be cleaned up
+ */
+static int _comm_rx_shard_init(comm_rx_shard_t *shard, int use_uring){
+    shard->epoll_fd = epoll_create1(0);
+    if (shard->epoll_fd == -1) {
+        perror("epoll_create1");
+        return -1;
+    }
+    shard->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(shard->stop_fd < 0){
+        perror("eventfd");
+        return -1;
+    }
+    if(use_uring){
+        if(uring_init(&shard->rx_uring, COMM_URING_ENTRIES) < 0){
+            printf("Unable to set up io_uring for RX shard %u\n", shard->shard_id);
+            return -1;
+        }
+        shard->use_uring = 1;
+        if(uring_buf_ring_init(&shard->rx_uring, &shard->rx_uring_bufs, 0,
+                               COMM_URING_RX_BUFS, PKT_BUF_SIZE,
+                               PKT_BUF_HEADROOM) < 0){
+            printf("Unable to set up io_uring for RX shard %u\n", shard->shard_id);
+            return -1;
+        }
+    }
+
+    // Timer queue holding packets in flight on emulated links. The
+    // shard itself is the event data of its timerfd, the address of its
+    // stop_fd is the event data of the stop eventfd.
+    if(timer_queue_init(&shard->emu_timers, COMM_EMU_TIMERS) < 0){
+        return -1;
+    }
+    if(shard->use_uring){
+        if(_comm_uring_arm_timer(shard) < 0 || _comm_uring_arm_stop(shard) < 0){
+            return -1;
+        }
+        return 0;
+    }
+
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data.ptr = shard
+    };
+    if(epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->emu_timers.timer_fd, &ev) == -1){
+        perror("epoll_ctl");
+        return -1;
+    }
+    ev.data.ptr = &shard->stop_fd;
+    if(epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->stop_fd, &ev) == -1){
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sockets opened by the workers of a bring-up phase. Workers claim
+ * COMM_BRINGUP_CHUNK items at a time until all are claimed.
+ */
+typedef struct comm_bringup_work_ {
+    void **items;          ///< nodes or interfaces
+    unsigned int n_items;
+    int is_intf;           ///< items are interfaces, else nodes
+    unsigned int next;     ///< first item not claimed yet
+    unsigned int n_failed;
+} comm_bringup_work_t;
+
+static void *comm_bringup_worker(void *arg){
+    comm_bringup_work_t *work = (comm_bringup_work_t *)arg;
+    unsigned int n_failed = 0;
+    unsigned int first;
+
+    while((first = __atomic_fetch_add(&work->next, COMM_BRINGUP_CHUNK,
+                                      __ATOMIC_RELAXED)) < work->n_items){
+        unsigned int last = first + COMM_BRINGUP_CHUNK;
+        if(last > work->n_items){
+            last = work->n_items;
+        }
+        for(unsigned int i=first; i<last; i++){
+            int ret = work->is_intf ?
+                init_comm_tx_socket((interface_t *)work->items[i]) :
+                init_comm_server_socket((node_t *)work->items[i]);
+            if(ret < 0){
+                n_failed++;
+            }
+        }
+    }
+    __atomic_fetch_add(&work->n_failed, n_failed, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+/**
+ * @brief Open the sockets of one bring-up phase on the worker threads.
+ *
+ * The calling thread works along with the workers. If a worker cannot
+ * be started the remaining ones, or the calling thread alone, do its
+ * share.
+ *
+ * @return number of sockets that could not be opened
+ */
+static unsigned int comm_bringup_phase(void **items, unsigned int n_items,
+                                       int is_intf, unsigned int n_workers){
+    comm_bringup_work_t work = {
+        .items = items,
+        .n_items = n_items,
+        .is_intf = is_intf,
+    };
+    pthread_t threads[COMM_BRINGUP_MAX_WORKERS];
+    unsigned int n_chunks = (n_items + COMM_BRINGUP_CHUNK - 1) / COMM_BRINGUP_CHUNK;
+    unsigned int n_threads = 0;
+
+    if(n_workers > n_chunks){
+        n_workers = n_chunks;
+    }
+    for(unsigned int i=1; i<n_workers; i++){
+        if(pthread_create(&threads[n_threads], NULL, comm_bringup_worker, &work) != 0){
+            perror("pthread_create");
+            break;
+        }
+        n_threads++;
+    }
+    comm_bringup_worker(&work);
+    for(unsigned int i=0; i<n_threads; i++){
+        pthread_join(threads[i], NULL);
+    }
+    return work.n_failed;
+}
+
+/**
+ * @brief Open the UDP sockets left to the parallel bring-up.
+ *
+ * Opens the listen sockets of all nodes run by this process, then the
+ * TX sockets of their interfaces, which need the listen port of the
+ * node across the link. Both phases run on the worker threads set with
+ * comm_set_bringup. The limit of open file descriptors is raised
+ * beforehand to fit all the sockets. Nodes and links created
+ * afterwards get their sockets right away. Does nothing with the
+ * sequential bring-up or the shared memory transport.
+ *
+ * @param  topo: pointer to the graph topology
+ * @param  stats: filled with the sockets opened and the time taken,
+ *                may be NULL
+ * @return 0: Success
+ *        -1: Fail, some sockets could not be opened
+ */
+int comm_bringup(graph_t *topo, comm_bringup_stats_t *stats){
+    glthread_t *curr;
+    node_t *node;
+    unsigned int n_nodes = 0;
+    unsigned int n_intfs = 0;
+    void **nodes = NULL;
+    void **intfs = NULL;
+    int ret = -1;
+
+    if(stats != NULL){
+        memset(stats, 0, sizeof(*stats));
+    }
+    if(comm_bringup_mode != COMM_BRINGUP_PARALLEL ||
+       comm_transport != COMM_TRANSPORT_UDP){
+        return 0;
+    }
+
+    ITERATE_GLTHREAD_BEGIN(&topo->node_list, curr){
+        node = graph_glue_to_node(curr);
+        if(!node->comm_local){
+            continue;
+        }
+        n_nodes++;
+        for(int i=0; i<MAX_INTERFACES_PER_NODE && node->interfaces[i]; i++){
+            n_intfs++;
+        }
+    } ITERATE_GLTHREAD_END(&topo->node_list, curr);
+
+    nodes = calloc(n_nodes + 1, sizeof(void *));
+    intfs = calloc(n_intfs + 1, sizeof(void *));
+    if(nodes == NULL || intfs == NULL){
+        printf("Cannot allocate bring-up of %u nodes\n", n_nodes);
+        goto out;
+    }
+    n_nodes = 0;
+    n_intfs = 0;
+    ITERATE_GLTHREAD_BEGIN(&topo->node_list, curr){
+        node = graph_glue_to_node(curr);
+        if(!node->comm_local){
+            continue;
+        }
+        if(node->comm_udp_server_sock_fd < 0){
+            nodes[n_nodes++] = node;
+        }
+        for(int i=0; i<MAX_INTERFACES_PER_NODE && node->interfaces[i]; i++){
+            if(node->interfaces[i]->comm_tx_sock_fd < 0){
+                intfs[n_intfs++] = node->interfaces[i];
+            }
+        }
+    } ITERATE_GLTHREAD_END(&topo->node_list, curr);
+    if(n_nodes == 0 && n_intfs == 0){
+        // Already brought up
+        ret = 0;
+        goto out;
+    }
+
+    // Raise the limit once up front rather than on EMFILE in the workers
+    if(comm_raise_nofile(comm_open_fds() + n_nodes + n_intfs + COMM_BRINGUP_FD_SPARE) < 0){
+        printf("Not enough file descriptors for %u listen and %u TX sockets\n",
+               n_nodes, n_intfs);
+        goto out;
+    }
+
+    comm_last_bringup.n_workers = comm_bringup_workers;
+    comm_last_bringup.n_listen = n_nodes;
+    comm_last_bringup.n_tx = n_intfs;
+    uint64_t start_ns = timer_now_ns();
+    unsigned int n_failed = comm_bringup_phase(nodes, n_nodes, 0, comm_bringup_workers);
+    uint64_t listen_ns = timer_now_ns();
+    comm_last_bringup.listen_ns = listen_ns - start_ns;
+    if(n_failed != 0){
+        printf("%u of %u listen sockets could not be opened\n", n_failed, n_nodes);
+        goto out;
+    }
+    n_failed = comm_bringup_phase(intfs, n_intfs, 1, comm_bringup_workers);
+    comm_last_bringup.tx_ns = timer_now_ns() - listen_ns;
+    if(n_failed != 0){
+        printf("%u of %u TX sockets could not be opened\n", n_failed, n_intfs);
+        goto out;
+    }
+    comm_brought_up = 1;
+    ret = 0;
+
+out:
+    if(stats != NULL && (n_nodes != 0 || n_intfs != 0)){
+        *stats = comm_last_bringup;
+    }
+    free(nodes);
+    free(intfs);
+    return ret;
+}
+
+/**
+ * @brief Launch the threads that monitor data reception on each node's socket
+ *
+ * Once the topology is created, the sockets left to the parallel
+ * bring-up are opened, then the nodes are distributed round robin
+ * over the RX shards and one receiver thread is launched per shard.
+ * Each shard thread epolls on the sockets of its nodes only, or with
+ * the io_uring engine waits on multishot receives armed on them. The
+ * threads run until network_stop_pkt_receiver_thread is called.
+ *
+ * @param  topo: pointer to the graph topology
+ * @return 0: Success
+ *        -1: Fail, no receiver thread is running
+ *
+ */
+int network_start_pkt_receiver_thread(graph_t *topo){
+    glthread_t *curr = NULL;
+    node_t *node = NULL;
+    unsigned int node_idx = 0;
+    unsigned int n_started = 0;
+
+    if(n_rx_shards_running != 0){
+        printf("Receiver threads are already running\n");
+        return -1;
+    }
+
+    if(comm_bringup(topo, NULL) < 0){
+        return -1;
+    }
+
+    int use_uring = (comm_io_engine == COMM_IO_URING);
+    if(use_uring && comm_transport != COMM_TRANSPORT_UDP){
+        printf("io_uring engine only drives the UDP transport, using epoll\n");
+        use_uring = 0;
+    }
+
+    for(unsigned int i=0; i<n_rx_shards; i++){
+        comm_rx_shard_t *shard = &rx_shards[i];
+        memset(shard, 0, sizeof(*shard));
+        shard->shard_id = i;
+        shard->epoll_fd = -1;
+        shard->stop_fd = -1;
+        shard->emu_timers.timer_fd = -1;
+    }
+    for(unsigned int i=0; i<n_rx_shards; i++){
+        if(_comm_rx_shard_init(&rx_shards[i], use_uring) < 0){
+            goto fail;
+        }
+    }
+
+    // Assign each node to a shard and add its comm socket to the
+    // shard's epoll for monitoring
+    ITERATE_GLTHREAD_BEGIN(&topo->node_list, curr){
+        node = graph_glue_to_node(curr);
+        if(!node->comm_local){
+            // Received by the process running the node
+            continue;
+        }
+        comm_rx_shard_t *shard = &rx_shards[node_idx % n_rx_shards];
+        int node_rx_fd = (comm_transport == COMM_TRANSPORT_SHM) ?
+            node->comm_shm_event_fd : node->comm_udp_server_sock_fd;
+        node_idx++;
+        node->rx_shard = shard->shard_id;
+        shard->n_nodes++;
+
+        if(shard->use_uring){
+            if(_comm_uring_arm_recv(shard, node) < 0){
+                goto fail;
+            }
+            continue;
+        }
+
+        // Add the node's socket (or eventfd) to epoll. The node itself is
+        // the event data so the receiving node is known without any lookup.
+        struct epoll_event ev = {
+            .events = EPOLLIN,
+            .data.ptr = node
+        };
+        if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, node_rx_fd, &ev) == -1) {
+            perror("epoll_ctl");
+            goto fail;
+        }
+    } ITERATE_GLTHREAD_END(topo->node_list, curr);
+
+    // Create the pthreads that will monitor UDP recv sockets of the
+    // nodes in each shard. They are joined when they are stopped.
+    for(n_started=0; n_started<n_rx_shards; n_started++){
+        if(pthread_create(&rx_shards[n_started].thread, NULL,
+                          __network_start_pkt_receiver_thread,
+                          (void *)&rx_shards[n_started]) != 0){
+            perror("pthread_create");
+            goto fail;
+        }
+    }
+    pthread_rwlock_wrlock(&rx_shards_lock);
+    n_rx_shards_running = n_rx_shards;
+    pthread_rwlock_unlock(&rx_shards_lock);
+    return 0;
+
+fail:
+    for(unsigned int i=0; i<n_started; i++){
+        _comm_rx_shard_stop(&rx_shards[i]);
+    }
+    for(unsigned int i=0; i<n_rx_shards; i++){
+        _comm_rx_shard_cleanup(&rx_shards[i]);
+    }
+    return -1;
+}
+
+/**
+ * @brief Stop the receiver threads and release their resources.
+ *
+ * Wakes every receiver thread through its stop eventfd and waits for
+ * it to exit. Packets still in flight on emulated links are dropped.
+ * Does nothing if the receiver threads are not running.
+ */
+void network_stop_pkt_receiver_thread(void){
+    // No timer can be added to the shards once they are marked stopped
+    pthread_rwlock_wrlock(&rx_shards_lock);
+    unsigned int n_running = n_rx_shards_running;
+    n_rx_shards_running = 0;
+    pthread_rwlock_unlock(&rx_shards_lock);
+
+    for(unsigned int i=0; i<n_running; i++){
+        _comm_rx_shard_stop(&rx_shards[i]);
+    }
+    for(unsigned int i=0; i<n_running; i++){
+        _comm_rx_shard_cleanup(&rx_shards[i]);
+    }
+}
+
+/**
+ * @brief Queue a timer on the receiver thread of a node, from any thread
+ *
+ * On the receiver thread of the node the timer goes straight to its
+ * timer queue, from other threads through the inbox of the queue (see
+ * timer_queue_add_remote).
+ *
+ * @param  node: node whose receiver thread runs the callback
+ * @param  expire_ns: CLOCK_MONOTONIC time the callback is due
+ * @param  cb: callback, called as cb(arg, data)
+ * @return 0: Success
+ *        -1: Fail, the receiver threads are not running
+ */
+int comm_node_timer_add(node_t *node, uint64_t expire_ns,
+                        timer_cb_t cb, void *arg, void *data){
+    int ret = -1;
+    pthread_rwlock_rdlock(&rx_shards_lock);
+    if(node->comm_local && node->rx_shard < n_rx_shards_running){
+        timer_queue_t *tq = &rx_shards[node->rx_shard].emu_timers;
+        ret = (tq == rx_emu_timers) ? timer_queue_add(tq, expire_ns, cb, arg, data) :
+                                      timer_queue_add_remote(tq, expire_ns, cb, arg, data);
+    }
+    pthread_rwlock_unlock(&rx_shards_lock);
+    return ret;
+}
+
+/**
+ * @brief Print the node to shard mapping and the load on each RX shard
+ *
+ * @param  topo: pointer to the graph topology
+ */
+void dump_rx_shards(graph_t *topo){
+    glthread_t *curr;
+    node_t *node;
+
+    if(comm_last_bringup.n_workers != 0){
+        printf("Last bring-up: %u listen sockets in %.1f ms, %u TX sockets in %.1f ms, %u workers\n",
+               comm_last_bringup.n_listen, comm_last_bringup.listen_ns / 1e6,
+               comm_last_bringup.n_tx, comm_last_bringup.tx_ns / 1e6,
+               comm_last_bringup.n_workers);
+    }
+    printf("RX shards: %u\n", n_rx_shards_running);
+    printf("%-6s %-8s %-14s %-14s %-14s %-14s %s\n", "Shard", "Nodes",
+           "Wakeups", "Bursts", "Packets", "Bytes", "Pkts/burst");
+    for(unsigned int i=0; i<n_rx_shards_running; i++){
+        comm_rx_shard_t *shard = &rx_shards[i];
+        uint64_t bursts = SHARD_STAT_READ(shard->rx_bursts);
+        uint64_t pkts = SHARD_STAT_READ(shard->rx_pkts);
+        printf("%-6u %-8u %-14lu %-14lu %-14lu %-14lu %.2f\n", shard->shard_id,
+               shard->n_nodes,
+               (unsigned long)SHARD_STAT_READ(shard->epoll_wakeups),
+               (unsigned long)bursts, (unsigned long)pkts,
+               (unsigned long)SHARD_STAT_READ(shard->rx_bytes),
+               bursts ? (double)pkts / bursts : 0.0);
+    }
+
+    if(n_rx_shards_running == 0){
+        return;
+    }
+    printf("\nNode to shard map:\n");
+    ITERATE_GLTHREAD_BEGIN(&topo->node_list, curr){
+        node = graph_glue_to_node(curr);
+        if(!node->comm_local){
+            printf("\t%-*s partition %u\n", NODE_NAME_SIZE, node->node_name,
+                   node->comm_partition);
+            continue;
+        }
+        printf("\t%-*s shard %u\n", NODE_NAME_SIZE, node->node_name, node->rx_shard);
+    } ITERATE_GLTHREAD_END(&topo->node_list, curr);
+}
+
+static uint64_t comm_stats_drops(const comm_stats_total_t *total){
+    uint64_t drops = 0;
+    for(int r=0; r<COMM_DROP_MAX; r++){
+        drops += total->drops[r];
+    }
+    return drops;
+}
+
+static void _dump_stats_line(const char *name, const comm_stats_total_t *total,
+                             const comm_stats_rate_t *rate){
+    printf("%-*s %12lu %14lu %12.1f %12lu %14lu %12.1f %10lu\n", IF_NAME_SIZE, name,
+           (unsigned long)total->rx_pkts, (unsigned long)total->rx_bytes, rate->rx_pps,
+           (unsigned long)total->tx_pkts, (unsigned long)total->tx_bytes, rate->tx_pps,
+           (unsigned long)comm_stats_drops(total));
+}
+
+/**
+ * @brief Print the packet, byte and drop counters of every node and interface
+ *
+ * Rates are per second since the previous time the counters were
+ * shown, or since the node or interface was created. Drops are broken
+ * down by reason below each node. The counters are read while the
+ * receiver threads update them, without stopping them.
+ *
+ * @param  topo: pointer to the graph topology
+ */
+void dump_intf_stats(graph_t *topo){
+    glthread_t *curr;
+    node_t *node;
+
+    ITERATE_GLTHREAD_BEGIN(&topo->node_list, curr){
+        node = graph_glue_to_node(curr);
+        comm_stats_total_t node_total, if_total;
+        comm_stats_rate_t rate;
+        uint64_t now_ns = timer_now_ns();
+
+        printf("Node %s\n", node->node_name);
+        printf("%-*s %12s %14s %12s %12s %14s %12s %10s\n", IF_NAME_SIZE, "Interface",
+               "RX pkts", "RX bytes", "RX pkts/s", "TX pkts", "TX bytes", "TX pkts/s", "Drops");
+        // Node counters only hold the drops of packets that did not
+        // reach an interface, the interfaces add up to the node totals.
+        comm_stats_read(&node->stats, &node_total);
+        for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
+            interface_t *intf = node->interfaces[i];
+            if(intf == NULL){
+                continue;
+            }
+            comm_stats_read(&intf->stats, &if_total);
+            comm_stats_rate(&intf->stats, &if_total, now_ns, &rate);
+            _dump_stats_line(intf->interface_name, &if_total, &rate);
+            comm_stats_add(&node_total, &if_total);
+        }
+        comm_stats_rate(&node->stats, &node_total, now_ns, &rate);
+        _dump_stats_line("Total", &node_total, &rate);
+        printf("\tRX %.0f bits/s, TX %.0f bits/s\n", rate.rx_bps, rate.tx_bps);
+
+        for(int r=0; r<COMM_DROP_MAX; r++){
+            if(node_total.drops[r] != 0){
+                printf("\tDropped, %s: %lu\n", comm_drop_str(r),
+                       (unsigned long)node_total.drops[r]);
+            }
+        }
+        printf("\n");
+    } ITERATE_GLTHREAD_END(&topo->node_list, curr);
+}
+
+static void _dump_latency_line(const char *name, lat_hist_t *h){
+    lat_hist_summary_t s;
+    lat_hist_summarize(h, &s);
+    printf("%-*s %12lu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", IF_NAME_SIZE, name,
+           (unsigned long)s.n_samples, s.mean_ns / 1e3, s.p50_ns / 1e3, s.p90_ns / 1e3,
+           s.p99_ns / 1e3, s.p999_ns / 1e3, s.max_ns / 1e3);
+}
+
+/**
+ * @brief Print the send to receive latency of every node and link
  *
- * @param  None
- * @return port unsigned 32 bit integer port number
+ * Each node lists the latency of all the packets it received, then
+ * of each interface: the direction of the interface's link leading to
+ * it. Latencies are in microseconds, from the time the sender wrote
+ * the comm header to the time the packet entered the data link layer,
+ * so they include the time spent on emulated links.
+ *
+ * @param  topo: pointer to the graph topology
  */
-static uint32_t get_next_free_port(){
-    uint32_t ret = next_free_port;
-    next_free_port++;
-    return ret;
-}
+void dump_latency(graph_t *topo){
+    glthread_t *curr;
+    node_t *node;
 
+    printf("Latency in usec since the last \"clear latency\"\n");
+    ITERATE_GLTHREAD_BEGIN(&topo->node_list, curr){
+        node = graph_glue_to_node(curr);
+        printf("Node %s\n", node->node_name);
+        printf("%-*s %12s %10s %10s %10s %10s %10s %10s\n", IF_NAME_SIZE, "Interface",
+               "Packets", "Mean", "p50", "p90", "p99", "p99.9", "Max");
+        for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
+            interface_t *intf = node->interfaces[i];
+            if(intf == NULL){
+                continue;
+            }
+            unsigned int dir = (&intf->link->if1 == intf) ? 0 : 1;
+            _dump_latency_line(intf->interface_name,
+                               __atomic_load_n(&intf->link->lat_hist[dir], __ATOMIC_ACQUIRE));
+        }
+        _dump_latency_line("Total", __atomic_load_n(&node->lat_hist, __ATOMIC_ACQUIRE));
+        printf("\n");
+    } ITERATE_GLTHREAD_END(&topo->node_list, curr);
+}
 
 /**
- * @brief Receive comm packet
+ * @brief Send a packet on a connected UDP socket.
  *
- * exctracts interface name from comm packet and forwards payload
- * to data link receiver module
+ * The socket is already connected to the listen port of the
+ * destination node, so no address has to be supplied per packet.
+ *
+ * @param  sockfd: connected TX socket of the sending interface
+ * @param  pkt: pointer to packet to send
+ * @param  pkt_size: size in bytes of packet to send
+ * @return 0: Success
+ *        -1: Fail
  *
  */
-static int _comm_pkt_recv(node_t *node, char *comm_pkt, size_t comm_pkt_size){
-    // extract the rx interface of the packet
-    char *rx_if_name = comm_pkt; // we can do this because we have \0 character at end of if name.
-    interface_t *rx_if = get_node_if_by_name(node, rx_if_name);
-    if(rx_if == NULL){
-        printf("Unable to locate interface %s\n", rx_if_name);
+int _send_pkt_out(int sockfd, char *pkt, size_t pkt_size){
+    if (send(sockfd, pkt, pkt_size, 0) == -1) {
+        perror("Send failed");
         return -1;
     }
-    data_link_pkt_receive(node, rx_if, comm_pkt + IF_NAME_SIZE, (comm_pkt_size-IF_NAME_SIZE));
     return 0;
 }
 
+// Shared memory transport: RX ring of the calling thread on every
+// interface, assigned on its first send
+static __thread int shm_sender = -1;
+// Rings held by live threads, bit r for ring r. The last ring is shared
+// and never held.
+static uint32_t shm_senders_used = 0;
+static pthread_key_t shm_sender_key;
+static pthread_once_t shm_sender_once = PTHREAD_ONCE_INIT;
+
 /**
- * @brief Initialize a UDP server socket on a node to recieve messages for that node.
+ * @brief Hand the ring of an exiting thread to the next sending thread.
  *
- * Each node is assigned a free port number and a UDP socket
- * is bound to that port number to receive data for that node.
+ * Packets the thread left on its rings are still drained by the
+ * receivers, the next holder appends behind them.
  *
- * @param  node: pointer to node whose data structures are filled
- * @return  0: Success
- *         <0: Fail
+ * @param  arg: ring of the thread + 1
  */
-int init_comm_server_socket(node_t *node){
-    int sockfd;
-    struct sockaddr_in server_addr;
-    uint32_t server_listen_port = get_next_free_port();
+static void comm_shm_sender_release(void *arg){
+    uint32_t r = (uint32_t)(uintptr_t)arg - 1;
+    __atomic_fetch_and(&shm_senders_used, ~(1u << r), __ATOMIC_RELEASE);
+}
 
-    if ((sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
-        perror("Socket creation failed");
-        return -1;
+static void comm_shm_sender_key_create(void){
+    if(pthread_key_create(&shm_sender_key, comm_shm_sender_release) != 0){
+        printf("Error: Could not create the shm sender key\n");
     }
+}
 
-    // Fill server information
-    server_addr.sin_family = AF_INET; // IPv4
-    server_addr.sin_addr.s_addr = INADDR_ANY; // Any incoming interface
-    server_addr.sin_port = htons(server_listen_port); // Port number
+/**
+ * @brief Give the calling thread its RX ring on every interface.
+ *
+ * Threads take the free rings in the order they first send and give
+ * them back when they exit. Once all are held, further threads use the
+ * last, shared ring.
+ *
+ * @return ring of the calling thread
+ */
+static int comm_shm_sender_assign(void){
+    const uint32_t own_rings = (1u << (MAX_RX_RINGS_PER_INTF - 1)) - 1;
+    uint32_t used = __atomic_load_n(&shm_senders_used, __ATOMIC_ACQUIRE);
+    uint32_t free_rings;
 
-    // Bind the socket to its source port and source IPs
-    if (bind(sockfd, (const struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Bind failed");
-        close(sockfd);
-        return -1;
+    shm_sender = MAX_RX_RINGS_PER_INTF - 1;
+    pthread_once(&shm_sender_once, comm_shm_sender_key_create);
+    while((free_rings = ~used & own_rings) != 0){
+        int r = __builtin_ctz(free_rings);
+        if(!__atomic_compare_exchange_n(&shm_senders_used, &used, used | (1u << r),
+                                        0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)){
+            continue;
+        }
+        if(pthread_setspecific(shm_sender_key, (void *)(uintptr_t)(r + 1)) != 0){
+            // Never released, keep to the shared ring
+            comm_shm_sender_release((void *)(uintptr_t)(r + 1));
+            break;
+        }
+        shm_sender = r;
+        break;
     }
+    return shm_sender;
+}
 
-    // store the socket fd and port number into the node data structure
-    node->comm_server_listen_port = server_listen_port;
-    node->comm_udp_server_sock_fd = sockfd;
+/**
+ * @brief Take the lock of the shared RX ring of an interface.
+ *
+ * Spins, the lock is only held while a packet is copied into a slot,
+ * and yields the CPU while it is taken so a preempted holder can run.
+ *
+ * @param  intf: interface whose shared ring is filled
+ */
+static void comm_shm_shared_lock(interface_t *intf){
+    while(__atomic_exchange_n(&intf->comm_rx_shared_lock, 1, __ATOMIC_ACQUIRE)){
+        while(__atomic_load_n(&intf->comm_rx_shared_lock, __ATOMIC_RELAXED)){
+            sched_yield();
+        }
+    }
+}
 
-    return 0; //success
+static void comm_shm_shared_unlock(interface_t *intf){
+    __atomic_store_n(&intf->comm_rx_shared_lock, 0, __ATOMIC_RELEASE);
 }
 
 /**
- * @brief Thread function that monitors each node's comm socket for data reception.
+ * @brief Put a comm packet on the RX ring of the destination interface.
  *
- * Server thread running on local host that monitors per-node UDP sockets for data
- * reception.
- *
- * @param  arg: graph topology
- * @return NULL
+ * Shared memory transport: the comm packet is built directly in the
+ * ring slot and the receiving node is woken up. The node across the
+ * link sends from its receiver thread (ARP replies and queued packets,
+ * frames forwarded or flooded by its L2 switch), the CLI and the
+ * traffic generator, each into its own single producer ring, created
+ * here on its first packet. Only threads beyond MAX_RX_RINGS_PER_INTF - 1
+ * share a ring and take its lock.
  *
+ * @param  from_if: sending interface
+ * @param  to_if: interface at the other end of the link
+ * @param  iov: pieces of the packet to send
+ * @param  iovcnt: number of pieces
+ * @param  pkt_size: size in bytes of packet to send
+ * @param  l2: L2 addresses, ethertype and tag, NULL for a data link packet
+ * @return 0: Success
+ *        -1: Fail, ring is full or could not be created
  */
-void* __network_start_pkt_receiver_thread(void* arg) {
-    graph_t *topo = (graph_t*) arg;
-    glthread_t *curr = NULL;
-    node_t *node = NULL;
-
-    int epoll_fd = epoll_create1(0);
-    if (epoll_fd == -1) {
-        perror("epoll_create1");
-        exit(EXIT_FAILURE);
+static int _send_pkt_out_shm(interface_t *from_if, interface_t *to_if,
+                             const struct iovec *iov, int iovcnt, size_t pkt_size,
+                             const pkt_l2_t *l2){
+    int r = shm_sender;
+    if(r < 0){
+        r = comm_shm_sender_assign();
+    }
+    int shared = (r == MAX_RX_RINGS_PER_INTF - 1);
+    if(shared){
+        comm_shm_shared_lock(to_if);
     }
 
-    // Add comm socket of each node to an epoll for monitoring
-    ITERATE_GLTHREAD_BEGIN(&topo->node_list, curr){
-        node = graph_glue_to_node(curr);
-        int node_sock_fd = node->comm_udp_server_sock_fd;
-
-        // Add the node's socket to epoll
-        struct epoll_event ev = {
-            .events = EPOLLIN,
-            .data.fd = node_sock_fd
-        };
-        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, node_sock_fd, &ev) == -1) {
-            perror("epoll_ctl");
-            exit(EXIT_FAILURE);
+    // Only this thread (or the shared lock holder) stores the ring
+    spsc_ring_t *ring = to_if->comm_rx_rings[r];
+    if(ring == NULL){
+        ring = spsc_ring_create(COMM_SHM_RING_SLOTS, PKT_BUF_SIZE);
+        if(ring != NULL){
+            __atomic_store_n(&to_if->comm_rx_rings[r], ring, __ATOMIC_RELEASE);
         }
-    } ITERATE_GLTHREAD_END(topo->node_list, curr);
-
-    struct epoll_event events[MAX_EVENTS];
-
-    // thread polls forever on the sockets waiting for any readable data
-    while (1) {
-        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
-        if (n == -1) {
-            perror("epoll_wait");
-            break;
+    }
+    char *slot = (ring != NULL) ? spsc_ring_reserve(ring) : NULL;
+    if(slot == NULL){
+        if(shared){
+            comm_shm_shared_unlock(to_if);
         }
+        // Counted, not printed: a sender outrunning the receiver hits
+        // this for every packet
+        comm_stats_tx_drop(&from_if->stats, COMM_DROP_TX_ERROR);
+        return -1;
+    }
+    // Leave headroom in the slot so the receiver can push headers in place
+    char *comm_pkt = slot + PKT_BUF_HEADROOM;
+    uint32_t hdr_size = comm_pkt_hdr_fill(comm_pkt, from_if, to_if, l2);
+    comm_iov_gather(comm_pkt + hdr_size, iov, iovcnt);
+    spsc_ring_commit(ring, hdr_size + pkt_size);
+    if(shared){
+        comm_shm_shared_unlock(to_if);
+    }
+    comm_shm_wakeup(to_if->attached_node);
+    comm_stats_tx(&from_if->stats, pkt_size);
+    return 0;
+}
 
-        for (int i = 0; i < n; ++i) {
-            int sockfd = events[i].data.fd;
-            node_t *rx_node = NULL;
-            glthread_t *curr;
-
-            // Identify the receiving node
-            ITERATE_GLTHREAD_BEGIN(&topo->node_list, curr){
-                node_t *curr_node = graph_glue_to_node(curr);
-                if(curr_node->comm_udp_server_sock_fd == sockfd){
-                    rx_node = curr_node;
-                    break;
-                }
-            } ITERATE_GLTHREAD_END(&topo->node_list, curr);
+/**
+ * @brief Get the interface at the other end of the link of an interface.
+ *
+ * @param  from_if: sending interface
+ * @return interface across the link, attached to a node
+ *         NULL: Fail, interface is not linked to a node
+ */
+static interface_t *comm_tx_peer(interface_t *from_if){
+    if(!from_if->attached_node->comm_local){
+        printf("Node %s runs in partition %u, send from there\n",
+               from_if->attached_node->node_name, from_if->attached_node->comm_partition);
+        return NULL;
+    }
+    link_t *if_link = from_if->link;
+    if(if_link == NULL){
+        printf("Link connected to interface %s not found\n", from_if->interface_name);
+        return NULL;
+    }
+    interface_t *to_if = (&if_link->if1 == from_if) ? &if_link->if2 : &if_link->if1;
+    if(to_if->attached_node == NULL){
+        printf("Node connected to interface %s not found\n", to_if->interface_name);
+        return NULL;
+    }
+    return to_if;
+}
 
-            if(rx_node == NULL){
-                printf("Unable to identify rx_node for sock_fd %d\n", sockfd);
-                break;
-            }
+/**
+ * @brief Capture a packet sent or received on an interface as the
+ *        ethernet frame it stands for.
+ *
+ * The ethernet header is built from the L2 addresses and ethertype of
+ * the packet (see eth_hdr_build) and captured in front of it, so the
+ * records are of CAPTURE_LINKTYPE. Costs a single load when the
+ * interface is not captured.
+ *
+ * @param  cp: capture point of the interface
+ * @param  l2: L2 addresses of the packet
+ * @param  iov: pieces of the packet, in order
+ * @param  iovcnt: number of pieces, COMM_TX_IOV_MAX at most
+ */
+static inline void comm_capture(capture_point_t *cp, const pkt_l2_t *l2,
+                                const struct iovec *iov, int iovcnt){
+    if(__atomic_load_n(&cp->capture, __ATOMIC_RELAXED) == NULL){
+        return;
+    }
+    struct iovec frame_iov[1 + COMM_TX_IOV_MAX];
+    char hdr[sizeof(ethernet_vlan_hdr_t)];
+    frame_iov[0].iov_base = hdr;
+    frame_iov[0].iov_len = eth_hdr_build(l2, hdr);
+    memcpy(&frame_iov[1], iov, iovcnt * sizeof(*iov));
+    capture_enqueue(cp, frame_iov, 1 + iovcnt);
+}
 
-            char buffer[MAX_PACKET_BUFFER_SIZE];
-            struct sockaddr_in client_addr;
-            socklen_t addr_len = sizeof(client_addr);
-
-            ssize_t len = recvfrom(sockfd, buffer, sizeof(buffer) - 1, 0,
-                                   (struct sockaddr *)&client_addr, &addr_len);
-            if (len > 0) {
-                buffer[len] = '\0';
-                /* printf("[Socket FD %d] Received from %s:%d: %s, %s\n", */
-                /*        sockfd, */
-                /*        inet_ntoa(client_addr.sin_addr), */
-                /*        ntohs(client_addr.sin_port), */
-                /*        buffer, buffer+IF_NAME_SIZE); */
-
-                // recv comm packet by the node.
-                if(_comm_pkt_recv(rx_node, buffer, len) < 0 ){
-                    printf("Unable to recv packet\n");
-                    break;
-                }
-            }
-        }
+/**
+ * @brief Capture a packet sent out of an interface, with the L2
+ *        addresses it is sent on the link with (see comm_l2_resolve).
+ */
+static inline void comm_capture_tx(interface_t *from_if, interface_t *to_if,
+                                   const pkt_l2_t *l2, const struct iovec *iov, int iovcnt){
+    if(__atomic_load_n(&from_if->capture.capture, __ATOMIC_RELAXED) == NULL){
+        return;
     }
-    // if control reaches here, something is wrong.
-    close(epoll_fd);
-    return NULL;
+    pkt_l2_t wire_l2;
+    comm_l2_resolve(&wire_l2, l2, from_if, to_if);
+    comm_capture(&from_if->capture, &wire_l2, iov, iovcnt);
 }
 
 /**
- * @brief Launch a thread that monitors data reception on each node's socket
+ * @brief Send a packet buffer out of an interface
  *
- * Once the topology is created a separate thread is launched that handles
- * data reception of each node. This function launches that thread
+ * Gets the interface at the other end of the link connected to
+ * the interface. Then send the packet on the TX socket of the
+ * interface after encapsulating the packet with the ethernet header
+ * of its L2 addresses, ethertype and tag (see eth_hdr_push) and a
+ * comm header identifying the destination node's interface. The
+ * headers are pushed into the headroom of the buffer, the packet data
+ * is not copied. The buffer is unchanged on return and still owned
+ * by the caller.
  *
- * @param  topo: pointer to the graph topology
+ * @param  pb: packet buffer holding the data to be sent
+ * @param out_interface: interface through which packet is to be sent.
  * @return 0: Success
+ *        -1: Fail
  *
  */
-int network_start_pkt_receiver_thread(graph_t *topo){
-    // Create a detached pthread that will monitor UDP recv sockets
-    // of all nodes in the topology. Detached thread does not have to
-    // be joined and will remove its resources when it is completed.
-    pthread_t node_rcv_thread;
-    pthread_attr_t attr;
-
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-    pthread_create(&node_rcv_thread, &attr, __network_start_pkt_receiver_thread, (void *)topo);
-    return 0;
-}
+int send_pkt_buf_out(pkt_buf_t *pb, interface_t* out_interface){
+    interface_t *from_if = out_interface;
+    interface_t *to_if = comm_tx_peer(from_if);
+    if(to_if == NULL){
+        return -1;
+    }
+
+    if(pb->len > comm_payload_max()){
+        printf("Packet of size %u is too big to send\n", pb->len);
+        comm_stats_tx_drop(&from_if->stats, COMM_DROP_OVERSIZE);
+        return -1;
+    }
+    struct iovec iov = { .iov_base = pb->data, .iov_len = pb->len };
+    comm_capture_tx(from_if, to_if, &pb->l2, &iov, 1);
+    if(comm_transport == COMM_TRANSPORT_SHM){
+        return _send_pkt_out_shm(from_if, to_if, &iov, 1, pb->len, &pb->l2);
+    }
+
+    if(from_if->comm_tx_sock_fd < 0){
+        printf("TX socket of interface %s is not open\n", from_if->interface_name);
+        return -1;
+    }
+
+    if(comm_io_engine == COMM_IO_URING){
+        // Receiver threads flush their queued sends once per loop
+        if(_send_pkt_out_uring(from_if, to_if, &iov, 1, pb->len, &pb->l2, NULL) < 0){
+            return -1;
+        }
+        return uring_tx_deferred ? 0 : comm_uring_tx_flush();
+    }
+
+    // Create COMM packet in place.
+    // Comm header identifying the rx interface
+    // Ethernet header of the frame
+    // Remaining is data payload
+    pkt_l2_t l2 = pb->l2;
+    uint32_t len = pb->len;
+    comm_l2_resolve(&pb->l2, &l2, from_if, to_if);
+    uint32_t hdr_size = comm_hdr_size();
+    char *comm_hdr = eth_hdr_push(pb) ? pkt_buf_push(pb, hdr_size) : NULL;
+    if(comm_hdr == NULL){
+        printf("No headroom for the comm and ethernet headers\n");
+        pkt_buf_pull(pb, pb->len - len);
+        pb->l2 = l2;
+        return -1;
+    }
+    comm_hdr_fill(comm_hdr, from_if, to_if);
 
+    // Send on the TX socket of the interface, it is connected to the
+    // listen port of the destination node.
+    int ret = _send_pkt_out(from_if->comm_tx_sock_fd, pb->data, pb->len);
+    pkt_buf_pull(pb, pb->len - len);
+    pb->l2 = l2;
+    if(ret < 0){
+        comm_stats_tx_drop(&from_if->stats, COMM_DROP_TX_ERROR);
+    } else {
+        comm_stats_tx(&from_if->stats, pb->len);
+    }
+    return ret;
+}
 
 /**
- * @brief Creates a UDP socket to send a message to a given port.
+ * @brief Send a comm packet on the TX socket of an interface.
  *
- * The port here identifies the node on the graph to which data
- * is sent.
+ * The comm and ethernet headers and the pieces of the packet are
+ * handed to a single sendmsg() on the socket, which is connected to
+ * the listen port of the node across the link.
  *
- * @param  dst_node_port: port number of destination node
- * @param  pkt: pointer to packet to send
+ * @param  from_if: sending interface, its TX socket is open
+ * @param  to_if: interface at the other end of the link
+ * @param  iov: pieces of the packet to send
+ * @param  iovcnt: number of pieces
  * @param  pkt_size: size in bytes of packet to send
+ * @param  l2: L2 addresses, ethertype and tag, NULL for a data link packet
  * @return 0: Success
  *        -1: Fail
- *
  */
-int _send_pkt_out(int dst_node_port, char *pkt, size_t pkt_size){
-    int sockfd;
-    struct sockaddr_in server_addr;
-    // Create UDP socket
-    if ((sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
-        perror("Socket creation failed");
+static int _send_pkt_out_sock(interface_t *from_if, interface_t *to_if,
+                              const struct iovec *iov, int iovcnt, size_t pkt_size,
+                              const pkt_l2_t *l2){
+    struct iovec msg_iov[1 + COMM_TX_IOV_MAX];
+    char hdr[COMM_PKT_HDR_MAX_SIZE] __attribute__((aligned(8)));
+
+    msg_iov[0].iov_base = hdr;
+    msg_iov[0].iov_len = comm_pkt_hdr_fill(hdr, from_if, to_if, l2);
+    memcpy(&msg_iov[1], iov, iovcnt * sizeof(struct iovec));
+    struct msghdr msg = {
+        .msg_iov = msg_iov,
+        .msg_iovlen = 1 + iovcnt,
+    };
+    if(sendmsg(from_if->comm_tx_sock_fd, &msg, 0) < 0){
+        perror("Send failed");
+        comm_stats_tx_drop(&from_if->stats, COMM_DROP_TX_ERROR);
+        return -1;
+    }
+    comm_stats_tx(&from_if->stats, pkt_size);
+    return 0;
+}
+
+// Body of send_pkt_out_iov and send_l2_pkt_out, l2 is NULL for data
+// link packets
+static int _send_pkt_out_iov(const struct iovec *iov, int iovcnt, const pkt_l2_t *l2,
+                             interface_t* out_interface){
+    interface_t *from_if = out_interface;
+    if(iovcnt < 1 || iovcnt > COMM_TX_IOV_MAX){
+        printf("Packet must be sent in 1 to %d pieces\n", COMM_TX_IOV_MAX);
+        return -1;
+    }
+    size_t pkt_size = comm_iov_len(iov, iovcnt);
+    if(pkt_size > comm_payload_max()){
+        printf("Packet of size %zu is too big to send\n", pkt_size);
+        comm_stats_tx_drop(&from_if->stats, COMM_DROP_OVERSIZE);
+        return -1;
+    }
+    interface_t *to_if = comm_tx_peer(from_if);
+    if(to_if == NULL){
         return -1;
     }
+    comm_capture_tx(from_if, to_if, l2, iov, iovcnt);
 
-    // Configure server address
-    // In our case the server is running on a thread on the local host
-    // the destination port identifies the node to which the packet is sent
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(dst_node_port);
-    server_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(comm_transport == COMM_TRANSPORT_SHM){
+        return _send_pkt_out_shm(from_if, to_if, iov, iovcnt, pkt_size, l2);
+    }
 
-     // Send message to server using sendto
-    if (sendto(sockfd, pkt, pkt_size, 0,
-               (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
-        perror("Sendto failed");
-        close(sockfd);
+    if(from_if->comm_tx_sock_fd < 0){
+        printf("TX socket of interface %s is not open\n", from_if->interface_name);
         return -1;
     }
 
-    // Close socket
-    close(sockfd);
-    return 0;
+    if(comm_io_engine == COMM_IO_URING){
+        if(_send_pkt_out_uring(from_if, to_if, iov, iovcnt, pkt_size, l2, NULL) < 0){
+            return -1;
+        }
+        return uring_tx_deferred ? 0 : comm_uring_tx_flush();
+    }
+
+    return _send_pkt_out_sock(from_if, to_if, iov, iovcnt, pkt_size, l2);
+}
+
+/**
+ * @brief Send a packet given in pieces out of an interface
+ *
+ * The packet is the concatenation of the pieces, for instance
+ * headers built by the caller followed by a payload it does not own.
+ * With the UDP socket path the comm and ethernet headers and the pieces are handed
+ * to a single sendmsg() and gathered by the kernel, so the packet is
+ * never copied in user space. The shared memory and io_uring paths
+ * gather the pieces straight into their own buffers.
+ *
+ * @param  iov: pieces of the packet, in order
+ * @param  iovcnt: number of pieces, 1 to COMM_TX_IOV_MAX
+ * @param out_interface: interface through which packet is to be sent.
+ * @return 0: Success
+ *        -1: Fail
+ */
+int send_pkt_out_iov(const struct iovec *iov, int iovcnt, interface_t* out_interface){
+    return _send_pkt_out_iov(iov, iovcnt, NULL, out_interface);
+}
+
+/**
+ * @brief Send an L2 frame out of an interface
+ *
+ * The frame is sent like a data link packet, with its L2 addresses,
+ * ethertype and tag in its ethernet header. The receiving node hands
+ * it to the handler of the ethertype instead of treating it as data.
+ *
+ * @param  l2: L2 addresses and ethertype of the frame, ARP_ETHERTYPE for
+ *             instance. Zero MAC addresses are filled in, see pkt_l2_t.
+ * @param  pkt: payload of the frame
+ * @param  pkt_size: length of the payload in bytes
+ * @param out_interface: interface through which the frame is to be sent.
+ * @return 0: Success
+ *        -1: Fail
+ */
+int send_l2_pkt_out(const pkt_l2_t *l2, char *pkt, size_t pkt_size,
+                    interface_t *out_interface){
+    struct iovec iov = { .iov_base = pkt, .iov_len = pkt_size };
+    return _send_pkt_out_iov(&iov, 1, l2, out_interface);
 }
 
+
 /**
  * @brief Send a packet out of an interface
  *
- * Gets the port number of the destination node attached to
- * the link connected to the interface. Then send the packet
- * to the port number after encapsulating the packet with
- * a header containing the destination node's interface name
+ * The packet is sent as a single piece with send_pkt_out_iov, it is
+ * not copied before it reaches the transport.
  *
  * @param  pkt: pointer of data to be sent.
  * @param  pkt_size: length of data in bytes
@@ -274,117 +2738,225 @@ int _send_pkt_out(int dst_node_port, char *pkt, size_t pkt_size){
  *
  */
 int send_pkt_out(char *pkt, size_t pkt_size, interface_t* out_interface){
-    // Get link connected to the interface
-    interface_t *from_if = out_interface;
-    link_t *if_link = from_if->link;
-    if(if_link == NULL){
-        printf("Link connected to interface %s not found\n", from_if->interface_name);
+    struct iovec iov = { .iov_base = pkt, .iov_len = pkt_size };
+    return send_pkt_out_iov(&iov, 1, out_interface);
+}
+
+
+
+// Body of send_pkt_flood_iov and send_pkt_buf_flood_l2:
+// l2 is NULL for data link packets, l2_only floods the L2 switch ports
+// of the node only
+static int _send_pkt_flood_iov(node_t *node, interface_t *exempted_intf,
+                               const struct iovec *iov, int iovcnt, const pkt_l2_t *l2,
+                               int l2_only, int *if_tx_status){
+    int status[MAX_INTERFACES_PER_NODE];
+    int ret = 0;
+
+    if(iovcnt < 1 || iovcnt > COMM_TX_IOV_MAX){
+        printf("Packet must be flooded in 1 to %d pieces\n", COMM_TX_IOV_MAX);
         return -1;
     }
-
-    // Get the interface at the other end of the link
-    interface_t *to_if;
-    if(&if_link->if1 == from_if){
-        to_if = &if_link->if2;
-    } else {
-        to_if = &if_link->if1;
+    if(!node->comm_local){
+        printf("Node %s runs in partition %u, flood from there\n",
+               node->node_name, node->comm_partition);
+        return -1;
     }
-
-    // Get the destination node attached to the to interface
-    node_t *to_node = to_if->attached_node;
-    if(to_node == NULL){
-        printf("Node connected to interface %s not found\n", to_if->interface_name);
+    size_t pkt_size = comm_iov_len(iov, iovcnt);
+    if(pkt_size > comm_payload_max()){
+        printf("Packet of size %zu is too big to flood\n", pkt_size);
+        for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
+            interface_t *cur_if = node->interfaces[i];
+            if(cur_if != NULL && cur_if != exempted_intf &&
+               (!l2_only || IF_L2_MODE(cur_if) == L2_MODE_ACCESS)){
+                comm_stats_tx_drop(&cur_if->stats, COMM_DROP_OVERSIZE);
+            }
+        }
         return -1;
     }
 
-    // Allocate buffer to send in heap
-    char *sndbuf = (char *)calloc(MAX_COMM_PKT_SIZE, 1);
-    if(sndbuf == NULL){
-        perror("Calloc");
-        return -1;
+    // Send the comm packet of every interface to flood on
+    for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
+        interface_t *cur_if = node->interfaces[i];
+        status[i] = 1;
+        if(cur_if == NULL || cur_if == exempted_intf ||
+           (l2_only && IF_L2_MODE(cur_if) != L2_MODE_ACCESS)){
+            continue;
+        }
+
+        if(get_nbr_node(cur_if) == NULL){
+            printf("Node connected to interface %s not found\n", cur_if->interface_name);
+            status[i] = -1;
+            continue;
+        }
+        interface_t *to_if = (&cur_if->link->if1 == cur_if) ?
+            &cur_if->link->if2 : &cur_if->link->if1;
+        comm_capture_tx(cur_if, to_if, l2, iov, iovcnt);
+
+        if(comm_transport == COMM_TRANSPORT_SHM){
+            status[i] = _send_pkt_out_shm(cur_if, to_if, iov, iovcnt, pkt_size, l2);
+            continue;
+        }
+
+        if(cur_if->comm_tx_sock_fd < 0){
+            printf("TX socket of interface %s is not open\n", cur_if->interface_name);
+            status[i] = -1;
+            continue;
+        }
+
+        if(comm_io_engine == COMM_IO_URING){
+            // status[i] is filled in when the batch is flushed
+            status[i] = -1;
+            _send_pkt_out_uring(cur_if, to_if, iov, iovcnt, pkt_size, l2, &status[i]);
+            continue;
+        }
+
+        status[i] = _send_pkt_out_sock(cur_if, to_if, iov, iovcnt, pkt_size, l2);
     }
 
-    // Create COMM packet: 2048 bytes.
-    // First IF_NAME_SIZE bytes is interface name string
-    // Remaining is data payload
-    strncpy(sndbuf, to_if->interface_name, IF_NAME_SIZE);
-    memcpy(sndbuf+IF_NAME_SIZE, pkt, pkt_size);
+    if(comm_io_engine == COMM_IO_URING){
+        comm_uring_tx_flush();
+    }
 
-    // Get the port number of destination port and send
-    int to_node_port = to_node->comm_server_listen_port;
-    int ret = _send_pkt_out(to_node_port, sndbuf, IF_NAME_SIZE+pkt_size);
-    free(sndbuf);
+    for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
+        if(status[i] < 0){
+            printf("Sending packet failed on interface %s\n",
+                   node->interfaces[i]->interface_name);
+            ret = -1;
+        }
+        if(if_tx_status != NULL){
+            if_tx_status[i] = status[i];
+        }
+    }
     return ret;
 }
 
+/**
+ * @brief send a packet given in pieces out of all interfaces of a node,
+ *        except the excempted interface
+ *
+ * With the UDP transport the comm packet of each interface is sent on
+ * the interface's TX socket, like a packet sent out of that interface
+ * alone, so flooded and unicast packets leave from the same socket and
+ * fail the same way. A comm packet is a header iovec holding the comm
+ * header of the destination interface and the ethernet header,
+ * followed by the caller's iovecs, so the packet is never copied. With
+ * the epoll engine each packet is a sendmsg() on its socket. With the
+ * io_uring engine one send per interface is queued and the batch is
+ * submitted with a single io_uring_enter. With the shared memory transport the packet is put
+ * on the ring of each interface. A failure on one interface does not stop the
+ * flood on the remaining interfaces.
+ *
+ * @param  node: pointer to node
+ * @param  exempted_intf: pointer to excepted interface
+ * @param  iov: pieces of the packet to flood, in order
+ * @param  iovcnt: number of pieces, 1 to COMM_TX_IOV_MAX
+ * @param  if_tx_status: optional array of MAX_INTERFACES_PER_NODE entries
+ *                       indexed like node->interfaces. Set to 0 if the packet
+ *                       was sent on the interface, -1 if sending failed and
+ *                       1 if the interface was not flooded on.
+ * @return 0 : packet sent on every flooded interface
+ *         -1: fail on at least one interface
+ */
+int send_pkt_flood_iov(node_t *node, interface_t *exempted_intf,
+                       const struct iovec *iov, int iovcnt, int *if_tx_status){
+    return _send_pkt_flood_iov(node, exempted_intf, iov, iovcnt, NULL, 0, if_tx_status);
+}
+
+/**
+ * @brief Flood a packet buffer out of the L2 switch ports of a node,
+ *        except the exempted interface
+ *
+ * The frame keeps the L2 addresses and ethertype of the buffer, it is
+ * sent as is from the buffer like send_pkt_flood_iov would. Interfaces
+ * that are not in an L2 mode are not flooded on.
+ *
+ * @param  node: pointer to node
+ * @param  exempted_intf: pointer to excepted interface, the port the
+ *                        frame came in on
+ * @param  pb: packet buffer holding the frame, unchanged and still
+ *             owned by the caller on return
+ * @return 0 : frame sent on every flooded interface
+ *         -1: fail on at least one interface
+ */
+int send_pkt_buf_flood_l2(node_t *node, interface_t *exempted_intf, pkt_buf_t *pb){
+    struct iovec iov = { .iov_base = pb->data, .iov_len = pb->len };
+    return _send_pkt_flood_iov(node, exempted_intf, &iov, 1, &pb->l2, 1, NULL);
+}
 
 
 /**
  * @brief send the packet pkt out of all interfaces of a node, except the excempted interface
  *
+ * See send_pkt_flood_iov, the packet is flooded as a single piece.
+ *
  * @param  node: pointer to node
  * @param  exempted_intf: pointer to excepted interface
  * @param  pkt: pointer of data to flood
  * @param  pkt_size: size of data
- * @return 0 : success
- *         -1: fail
+ * @param  if_tx_status: optional, see send_pkt_flood_iov
+ * @return 0 : packet sent on every flooded interface
+ *         -1: fail on at least one interface
  */
 int send_pkt_flood(node_t *node, interface_t *exempted_intf,
-                   char *pkt, unsigned int pkt_size){
-    for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
-        interface_t *cur_if = node->interfaces[i];
-        if(cur_if != NULL){
-            if(cur_if != exempted_intf){
-                if(send_pkt_out(pkt, pkt_size, cur_if) < 0){
-                    printf("Sending packet failed\n");
-                    return -1;
-                }
-            }
-        }
-    }
-    return 0;
+                   char *pkt, unsigned int pkt_size, int *if_tx_status){
+    struct iovec iov = { .iov_base = pkt, .iov_len = pkt_size };
+    return send_pkt_flood_iov(node, exempted_intf, &iov, 1, if_tx_status);
 }
 
 
 /**
  * @brief Data link packet receive handler.
  *
- * This is the entry point of ethernet frame into layer 2
+ * This is the entry point of ethernet frame into layer 2, for the
+ * frames the receive interface takes (see l2_recv_qualify_at_if).
+ * Frames received on an L2 port go to the L2 switch of the node.
+ * Other frames are handled by their ethertype: the ethernet header was
+ * popped into pkt->l2 when the comm packet was parsed and the buffer
+ * holds the payload. The buffer is owned by the caller and is only
+ * valid for the duration of the call.
  *
  * @param  node
  * @param  receive interface
- * @param  data-link packet
- * @param  data-link packet size
+ * @param  packet buffer holding the data-link packet
  * @return 0: Success
  *        -1: Fail
  */
 int data_link_pkt_receive(node_t *node, interface_t *rx_if,
-                char *pkt, size_t pkt_size){
+                          pkt_buf_t *pkt){
 
     /* Entry point into data link layer from physical layer */
 
-    // Simulate ethernet reception by encapsulating the packet
-    // within the ethernet frame
-    ethernet_hdr_t rx_eth_frame;
-    if(pkt_size > ETH_FRAME_MTU){
-        printf("RX comm packet received cannot have payload bigger than MTU\n");
+    struct iovec iov = { .iov_base = pkt->data, .iov_len = pkt->len };
+    comm_capture(&rx_if->capture, &pkt->l2, &iov, 1);
+
+    if(pkt->len > ETH_FRAME_MTU){
+        comm_stats_rx_drop(&rx_if->stats, COMM_DROP_OVERSIZE);
         return -1;
     }
-    char *ethfp = alloc_eth_frame(pkt, pkt_size);
-    if(ethfp == NULL){
-        printf("Unable to allocate ethernet frame\n");
-        return -1;
+    comm_stats_rx(&rx_if->stats, pkt->len);
+    if(pkt->tx_ns != 0){
+        comm_record_latency(node, rx_if, timer_now_ns() - pkt->tx_ns);
     }
+    if(IF_L2_MODE(rx_if) != L2_MODE_NONE){
+        return l2_switch_recv_frame(node, rx_if, pkt);
+    }
+
+    char *payload = pkt->data;
+    uint16_t payload_size = pkt->len;
 
-    ethernet_hdr_t *eth_hdr = (ethernet_hdr_t*) ethfp;
-    uint16_t payload_size = eth_hdr->ethertype;
-    char *payload = ethfp + sizeof(ethernet_hdr_t);
-    payload[payload_size-1] = '\0';
+    if(pkt->l2.ethertype == ARP_ETHERTYPE){
+        return arp_pkt_recv(node, rx_if, payload, payload_size);
+    }
 
+    // Packets of a traffic generator end here
+    if(traffic_gen_rx(payload, payload_size)){
+        return 0;
+    }
 
     printf("Rx node name: %s\n", node->node_name);
     printf("Rx if name: %s\n", rx_if->interface_name);
-    printf("Data: %s\n", payload);
+    printf("Data: %.*s\n", (int)payload_size, payload);
     printf("Data size: %hu\n", payload_size);
     return 0;
 }
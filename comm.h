@@ -1,17 +1,157 @@
 #ifndef __MY_COMM_H__
 #define __MY_COMM_H__
 #include "graph.h"
+#include "pkt_buf.h"
+#include "timer.h"
+#include "layer2.h"
 #include <stdint.h>
+#include <sys/uio.h>
 
 #define MAX_EVENTS 512
 #define MAX_PACKET_BUFFER_SIZE 1024
 
+// packet format is a comm header followed by the ethernet frame, header
+// in wire format and payload, without FCS. A comm packet fits in the
+// data area of a packet buffer.
+#define MAX_COMM_PKT_SIZE PKT_BUF_DATA_SIZE
+
+/**
+ * Format of the header in front of every comm packet
+ */
+typedef enum {
+    COMM_HDR_BINARY, ///< comm_hdr_t, RX interface by index (default)
+    COMM_HDR_NAME,   ///< RX interface name in IF_NAME_SIZE bytes and the
+                     ///< TX timestamp, for debugging
+} comm_hdr_format_t;
+
+/**
+ * Binary comm header. Packets never leave the host so fields are in
+ * host byte order.
+ */
+typedef struct comm_hdr_ {
+    uint16_t ifindex; ///< index of the RX interface in node->interfaces[]
+    uint16_t flags;   ///< none defined yet, sent as 0
+    uint32_t seq;     ///< sequence number of the sending interface
+    uint64_t tx_ns;   ///< CLOCK_MONOTONIC time the packet was sent
+} comm_hdr_t;
+
+// Size of the name comm header: RX interface name and TX timestamp
+#define COMM_HDR_NAME_SIZE (IF_NAME_SIZE + sizeof(uint64_t))
+
+// Largest comm header of any format
+#define COMM_HDR_MAX_SIZE COMM_HDR_NAME_SIZE
+
+// Largest headers in front of the payload of a comm packet: comm
+// header and ethernet header with an 802.1Q tag
+#define COMM_PKT_HDR_MAX_SIZE (COMM_HDR_MAX_SIZE + sizeof(ethernet_vlan_hdr_t))
+
+// Max number of pieces of a packet sent with send_pkt_out_iov
+#define COMM_TX_IOV_MAX 8
+
+// Max number of comm packets read from a socket in one go
+#define COMM_RX_BURST_MAX 64
+#define COMM_RX_BURST_DEFAULT 32
+
+// Max number of receiver threads
+#define COMM_MAX_RX_SHARDS 64
+
+// Packets buffered per link direction with the shared memory transport
+#define COMM_SHM_RING_SLOTS 256
+
+// Packets in flight on emulated links a receiver thread holds before
+// its timer queue has to grow
+#define COMM_EMU_TIMERS 256
+
+/**
+ * Transport carrying comm packets between nodes
+ */
+typedef enum {
+    COMM_TRANSPORT_UDP, ///< loopback UDP socket per node (default)
+    COMM_TRANSPORT_SHM, ///< in-process ring per sending thread and link direction
+} comm_transport_t;
+
+/**
+ * I/O engine driving the UDP sockets of the nodes
+ */
+typedef enum {
+    COMM_IO_EPOLL, ///< epoll + recvmmsg/send (default)
+    COMM_IO_URING, ///< io_uring multishot receives and batched sends
+} comm_io_engine_t;
+
+// io_uring engine sizing
+#define COMM_URING_ENTRIES 256  ///< SQ entries of a shard's RX ring
+#define COMM_URING_RX_BUFS 256  ///< provided receive buffers per shard
+#define COMM_URING_TX_BATCH 64  ///< sends queued per thread before a flush
+
+// Partitioning of a topology across processes
+#define COMM_MAX_PARTITIONS 64
+#define COMM_BASE_PORT 20000 ///< fixed listen port of the first node of a partitioned
+                             ///< topology, below the default ephemeral port range
+
+/**
+ * How the UDP sockets of nodes and interfaces are opened
+ */
+typedef enum {
+    COMM_BRINGUP_SEQUENTIAL, ///< as nodes and links are created (default)
+    COMM_BRINGUP_PARALLEL,   ///< by worker threads when the topology is brought up
+} comm_bringup_t;
+
+#define COMM_BRINGUP_MAX_WORKERS 64
+#define COMM_BRINGUP_CHUNK 64 ///< sockets a worker opens per claim
+#define COMM_BRINGUP_FD_SPARE 1024 ///< descriptors left over after a bring-up
+
+/**
+ * Outcome of the last bring-up of a topology
+ */
+typedef struct comm_bringup_stats_ {
+    unsigned int n_workers;
+    unsigned int n_listen;  ///< listen sockets opened
+    unsigned int n_tx;      ///< TX sockets opened
+    uint64_t listen_ns;     ///< time to open and bind the listen sockets
+    uint64_t tx_ns;         ///< time to open and connect the TX sockets
+} comm_bringup_stats_t;
+
+int comm_set_transport(comm_transport_t transport);
+comm_transport_t comm_get_transport(void);
+int comm_set_bringup(comm_bringup_t mode, unsigned int n_workers);
+int comm_bringup(graph_t *topo, comm_bringup_stats_t *stats);
+int comm_set_partition(unsigned int index, unsigned int n_partitions);
+int comm_set_partition_host(unsigned int partition, const char *host);
+int comm_set_node_endpoint(const char *node_name, const char *host, uint16_t port,
+                           unsigned int partition);
+int comm_load_endpoints(const char *path);
+int init_comm_node(node_t *node);
+int init_comm_intf(interface_t *intf);
+void destroy_comm_node(node_t *node);
+void destroy_comm_intf(interface_t *intf);
 int init_comm_server_socket(node_t *node);
+int init_comm_tx_socket(interface_t *intf);
+int comm_set_hdr_format(comm_hdr_format_t format);
+int comm_set_rx_burst_size(unsigned int burst_size);
+int comm_set_rx_shards(unsigned int n_shards);
+int comm_set_io_engine(comm_io_engine_t engine);
+comm_io_engine_t comm_get_io_engine(void);
 int network_start_pkt_receiver_thread(graph_t *topo);
+void network_stop_pkt_receiver_thread(void);
+timer_queue_t *comm_rx_timers(void);
+int comm_node_timer_add(node_t *node, uint64_t expire_ns,
+                        timer_cb_t cb, void *arg, void *data);
+void dump_rx_shards(graph_t *topo);
+void dump_intf_stats(graph_t *topo);
+void dump_latency(graph_t *topo);
+struct mmsghdr;
+int _comm_pkt_recv(node_t *node, struct mmsghdr *msgs, unsigned int n_msgs);
 int data_link_pkt_receive(node_t *node, interface_t *rx_if,
-                          char *pkt, size_t pkt_size);
+                          pkt_buf_t *pkt);
 int send_pkt_out(char *pkt, size_t pkt_size, interface_t* out_interface);
+int send_pkt_out_iov(const struct iovec *iov, int iovcnt, interface_t* out_interface);
+int send_pkt_buf_out(pkt_buf_t *pb, interface_t* out_interface);
 int send_pkt_flood(node_t *node, interface_t *exempted_intf,
-                   char *pkt, unsigned int pkt_size);
+                   char *pkt, unsigned int pkt_size, int *if_tx_status);
+int send_pkt_flood_iov(node_t *node, interface_t *exempted_intf,
+                       const struct iovec *iov, int iovcnt, int *if_tx_status);
+int send_l2_pkt_out(const pkt_l2_t *l2, char *pkt, size_t pkt_size,
+                    interface_t *out_interface);
+int send_pkt_buf_flood_l2(node_t *node, interface_t *exempted_intf, pkt_buf_t *pb);
 
 #endif
@@ -0,0 +1,120 @@
+/**
+ * @file comm_stats.c
+ * @author Abishek Ramdas
+ * @brief Lock-free packet, byte and drop counters of nodes and interfaces
+ */
+
+#include "comm_stats.h"
+#include "timer.h"
+#include <string.h>
+
+// TX slot of the calling thread, assigned on its first send
+__thread int comm_stats_tx_slot = -1;
+static unsigned int next_tx_slot = 0;
+
+void comm_stats_init(comm_stats_t *st){
+    memset(st, 0, sizeof(*st));
+    st->shown_ns = timer_now_ns();
+}
+
+/**
+ * @brief Give the calling thread its TX counter slot.
+ *
+ * Threads get the slots round robin in the order they first send.
+ *
+ * @return slot of the calling thread
+ */
+int comm_stats_tx_slot_assign(void){
+    unsigned int n = __atomic_fetch_add(&next_tx_slot, 1, __ATOMIC_RELAXED);
+    comm_stats_tx_slot = n % COMM_STATS_TX_SLOTS;
+    return comm_stats_tx_slot;
+}
+
+#define STAT_READ(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+/**
+ * @brief Sum the RX counters and the TX slots of a node or interface.
+ *
+ * @param  st: counters to read
+ * @param  total: filled in with the sums
+ */
+void comm_stats_read(comm_stats_t *st, comm_stats_total_t *total){
+    total->rx_pkts = STAT_READ(st->rx.pkts);
+    total->rx_bytes = STAT_READ(st->rx.bytes);
+    total->tx_pkts = 0;
+    total->tx_bytes = 0;
+    for(int r=0; r<COMM_DROP_MAX; r++){
+        total->drops[r] = STAT_READ(st->rx.drops[r]);
+    }
+    for(int i=0; i<COMM_STATS_TX_SLOTS; i++){
+        comm_counters_t *c = &st->tx[i];
+        total->tx_pkts += STAT_READ(c->pkts);
+        total->tx_bytes += STAT_READ(c->bytes);
+        for(int r=0; r<COMM_DROP_MAX; r++){
+            total->drops[r] += STAT_READ(c->drops[r]);
+        }
+    }
+}
+
+void comm_stats_add(comm_stats_total_t *sum, const comm_stats_total_t *total){
+    sum->rx_pkts += total->rx_pkts;
+    sum->rx_bytes += total->rx_bytes;
+    sum->tx_pkts += total->tx_pkts;
+    sum->tx_bytes += total->tx_bytes;
+    for(int r=0; r<COMM_DROP_MAX; r++){
+        sum->drops[r] += total->drops[r];
+    }
+}
+
+/**
+ * @brief Rates since the counters were last shown.
+ *
+ * The totals become the new sample the next rates are taken from.
+ * Only meant for the CLI thread.
+ *
+ * @param  st: counters the totals were read from
+ * @param  total: totals read now
+ * @param  now_ns: CLOCK_MONOTONIC time the totals were read
+ * @param  rate: filled in with packets and bits per second
+ */
+void comm_stats_rate(comm_stats_t *st, const comm_stats_total_t *total,
+                     uint64_t now_ns, comm_stats_rate_t *rate){
+    double secs = (double)(now_ns - st->shown_ns) / 1e9;
+    if(secs <= 0){
+        memset(rate, 0, sizeof(*rate));
+        return;
+    }
+    rate->rx_pps = (total->rx_pkts - st->shown_rx_pkts) / secs;
+    rate->rx_bps = (total->rx_bytes - st->shown_rx_bytes) * 8 / secs;
+    rate->tx_pps = (total->tx_pkts - st->shown_tx_pkts) / secs;
+    rate->tx_bps = (total->tx_bytes - st->shown_tx_bytes) * 8 / secs;
+
+    st->shown_ns = now_ns;
+    st->shown_rx_pkts = total->rx_pkts;
+    st->shown_rx_bytes = total->rx_bytes;
+    st->shown_tx_pkts = total->tx_pkts;
+    st->shown_tx_bytes = total->tx_bytes;
+}
+
+const char *comm_drop_str(comm_drop_t reason){
+    switch(reason){
+    case COMM_DROP_TRUNCATED:
+        return "truncated";
+    case COMM_DROP_UNKNOWN_IF:
+        return "unknown interface";
+    case COMM_DROP_OVERSIZE:
+        return "oversize";
+    case COMM_DROP_MAC_MISMATCH:
+        return "MAC mismatch";
+    case COMM_DROP_IF_UNCONFIGURED:
+        return "interface not configured";
+    case COMM_DROP_NO_BUF:
+        return "no packet buffer";
+    case COMM_DROP_TX_ERROR:
+        return "TX error";
+    case COMM_DROP_MALFORMED:
+        return "malformed";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,127 @@
+/**
+ * @file comm_stats.h
+ * @author Abishek Ramdas
+ * @brief Lock-free packet, byte and drop counters of nodes and interfaces
+ */
+
+#ifndef __MY_COMM_STATS_H
+#define __MY_COMM_STATS_H
+
+#include <stdint.h>
+
+// TX counter slots per node or interface. Sending threads are spread
+// over the slots, threads beyond COMM_STATS_TX_SLOTS share a slot.
+#define COMM_STATS_TX_SLOTS 4
+
+/**
+ * Reasons a packet is dropped
+ */
+typedef enum {
+    COMM_DROP_TRUNCATED,       ///< comm packet shorter than its header
+    COMM_DROP_UNKNOWN_IF,      ///< comm header does not name an interface of the node
+    COMM_DROP_OVERSIZE,        ///< packet bigger than the MTU or a comm packet
+    COMM_DROP_MAC_MISMATCH,    ///< destination MAC is not the interface's or broadcast
+    COMM_DROP_IF_UNCONFIGURED, ///< interface has no IP address
+    COMM_DROP_NO_BUF,          ///< packet buffer pool exhausted
+    COMM_DROP_TX_ERROR,        ///< send failed or RX ring of the peer full
+    COMM_DROP_MALFORMED,       ///< L2 frame its protocol handler cannot parse
+    COMM_DROP_MAX
+} comm_drop_t;
+
+/**
+ * Cache line aligned counters, written by a single thread (or by the
+ * threads sharing a TX slot) and read without locking.
+ */
+typedef struct comm_counters_ {
+    uint64_t pkts;
+    uint64_t bytes;
+    uint64_t drops[COMM_DROP_MAX];
+} __attribute__((aligned(64))) comm_counters_t;
+
+/**
+ * Counters of a node or interface. RX counters are only written by
+ * the receiver thread of the node. Packets are sent from any thread,
+ * so every sending thread counts in its own TX slot.
+ */
+typedef struct comm_stats_ {
+    comm_counters_t rx;
+    comm_counters_t tx[COMM_STATS_TX_SLOTS];
+    // Totals at the last time the counters were shown, for rates.
+    // Only used by the CLI.
+    uint64_t shown_ns;
+    uint64_t shown_rx_pkts;
+    uint64_t shown_rx_bytes;
+    uint64_t shown_tx_pkts;
+    uint64_t shown_tx_bytes;
+} comm_stats_t;
+
+/**
+ * Per second rates of a node or interface
+ */
+typedef struct comm_stats_rate_ {
+    double rx_pps;
+    double rx_bps;
+    double tx_pps;
+    double tx_bps;
+} comm_stats_rate_t;
+
+/**
+ * Sum of the counters of a node or interface
+ */
+typedef struct comm_stats_total_ {
+    uint64_t rx_pkts;
+    uint64_t rx_bytes;
+    uint64_t tx_pkts;
+    uint64_t tx_bytes;
+    uint64_t drops[COMM_DROP_MAX];
+} comm_stats_total_t;
+
+extern __thread int comm_stats_tx_slot;
+
+void comm_stats_init(comm_stats_t *st);
+int comm_stats_tx_slot_assign(void);
+void comm_stats_read(comm_stats_t *st, comm_stats_total_t *total);
+void comm_stats_add(comm_stats_total_t *sum, const comm_stats_total_t *total);
+void comm_stats_rate(comm_stats_t *st, const comm_stats_total_t *total,
+                     uint64_t now_ns, comm_stats_rate_t *rate);
+const char *comm_drop_str(comm_drop_t reason);
+
+// Single writer counter update, readers only need a consistent value
+#define COMM_STAT_ADD(counter, val) \
+    __atomic_store_n(&(counter), (counter) + (val), __ATOMIC_RELAXED)
+
+static inline void
+comm_stats_rx(comm_stats_t *st, uint32_t bytes){
+    COMM_STAT_ADD(st->rx.pkts, 1);
+    COMM_STAT_ADD(st->rx.bytes, bytes);
+}
+
+static inline void
+comm_stats_rx_drop(comm_stats_t *st, comm_drop_t reason){
+    COMM_STAT_ADD(st->rx.drops[reason], 1);
+}
+
+static inline comm_counters_t *
+comm_stats_tx_counters(comm_stats_t *st){
+    int slot = comm_stats_tx_slot;
+    if(slot < 0){
+        slot = comm_stats_tx_slot_assign();
+    }
+    return &st->tx[slot];
+}
+
+// TX slots may be shared by threads, the updates are atomic
+static inline void
+comm_stats_tx(comm_stats_t *st, uint32_t bytes){
+    comm_counters_t *c = comm_stats_tx_counters(st);
+    __atomic_fetch_add(&c->pkts, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->bytes, bytes, __ATOMIC_RELAXED);
+}
+
+static inline void
+comm_stats_tx_drop(comm_stats_t *st, comm_drop_t reason){
+    comm_counters_t *c = comm_stats_tx_counters(st);
+    __atomic_fetch_add(&c->drops[reason], 1, __ATOMIC_RELAXED);
+}
+
+#endif
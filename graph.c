@@ -10,7 +10,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <arpa/inet.h>
 #include "comm.h"
+#include "traffic_gen.h"
+#include "layer2.h"
+#include "l2switch.h"
+
+// Number of links created so far, numbers the links' emulation seeds
+static uint32_t n_links_created = 0;
+
 /**
  * @brief Create a new graph data structure and initialize name.
  *
@@ -39,20 +47,42 @@ graph_t* create_new_graph(const char *topology_name){
  * @param  graph      pointer to graph to add to
  * @param  node_name  pointer to name of node
  * @return pointer to node node_t*
+ *         NULL: fail, the node is not added
  */
 node_t* create_graph_node(graph_t *graph, const char *node_name){
-    node_t* nodep = calloc(1, sizeof(node_t));
+    // Counters in the node are cache line aligned
+    node_t* nodep = aligned_alloc(64, sizeof(node_t));
     if(nodep == NULL){
-        perror("calloc:");
+        perror("aligned_alloc:");
         return NULL;
     }
+    memset(nodep, 0, sizeof(node_t));
     memset(nodep->node_name, '\0', sizeof(nodep->node_name));
     strcpy(nodep->node_name, node_name);
     for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
         nodep->interfaces[i] = NULL;
     }
     init_node_nw_prop(&nodep->node_nw_props);
-    init_comm_server_socket(nodep);
+    comm_stats_init(&nodep->stats);
+    nodep->arp = arp_engine_create();
+    if(nodep->arp == NULL){
+        free(nodep);
+        return NULL;
+    }
+    nodep->l2_switch = l2_switch_create();
+    if(nodep->l2_switch == NULL){
+        arp_engine_destroy(nodep->arp);
+        free(nodep);
+        return NULL;
+    }
+    if(init_comm_node(nodep) < 0){
+        printf("Unable to set up comm on node %s\n", nodep->node_name);
+        destroy_comm_node(nodep);
+        l2_switch_destroy(nodep->l2_switch);
+        arp_engine_destroy(nodep->arp);
+        free(nodep);
+        return NULL;
+    }
     glthread_add_next(&graph->node_list, &nodep->graph_glue);
     return nodep;
 }
@@ -75,27 +105,34 @@ link_t* insert_link_between_two_nodes(node_t *node1,
                                    char *to_if_name,
                                    unsigned int cost){
 
-    link_t *new_link = calloc(1, sizeof(link_t));
+    // Counters in the interfaces are cache line aligned
+    link_t *new_link = aligned_alloc(64, sizeof(link_t));
     if(new_link == NULL){
-        perror("calloc:");
+        perror("aligned_alloc:");
         return NULL;
     }
+    memset(new_link, 0, sizeof(link_t));
 
     int node1_free_if = get_free_if_idx_from_node(node1);
     if(node1_free_if < 0){
         printf("Unable to find free interface on node1\n");
+        free(new_link);
         return NULL;
     }
 
     int node2_free_if = get_free_if_idx_from_node(node2);
     if(node2_free_if < 0){
         printf("Unable to find free interface on node2\n");
+        free(new_link);
         return NULL;
     }
 
     new_link->if1.link = new_link;
     new_link->if2.link = new_link;
     new_link->cost = cost;
+    // Every link gets its own seed, in order of creation, so runs of
+    // the same topology draw the same random numbers
+    link_emu_init(&new_link->emu, ++n_links_created);
 
     interface_t *if1 = &new_link->if1;
     strncpy(if1->interface_name, from_if_name, IF_NAME_SIZE);
@@ -104,6 +141,7 @@ link_t* insert_link_between_two_nodes(node_t *node1,
     if1->attached_node = node1;
     init_intf_nw_prop(&if1->intf_nw_props); // IP address is not configured yet
     intf_assign_mac_addr(if1); // assign random MAC address
+    comm_stats_init(&if1->stats);
 
     interface_t *if2 = &new_link->if2;
     strncpy(if2->interface_name, to_if_name, IF_NAME_SIZE);
@@ -112,13 +150,84 @@ link_t* insert_link_between_two_nodes(node_t *node1,
     if2->attached_node = node2;
     init_intf_nw_prop(&if2->intf_nw_props); // IP address is not configured yet
     intf_assign_mac_addr(if2); // assign random MAC address
+    comm_stats_init(&if2->stats);
 
     node1->interfaces[node1_free_if] = if1;
+    if1->ifindex = node1_free_if;
     node2->interfaces[node2_free_if] = if2;
+    if2->ifindex = node2_free_if;
+
+    // Set up the transport of each end towards the node across the link
+    if(init_comm_intf(if1) < 0){
+        printf("Unable to set up comm on interface %s\n", if1->interface_name);
+        goto fail;
+    }
+    if(init_comm_intf(if2) < 0){
+        printf("Unable to set up comm on interface %s\n", if2->interface_name);
+        destroy_comm_intf(if2);
+        goto fail;
+    }
 
     return new_link; // success
+
+fail:
+    destroy_comm_intf(if1);
+    node1->interfaces[node1_free_if] = NULL;
+    node2->interfaces[node2_free_if] = NULL;
+    free(new_link);
+    return NULL;
 }
 
+/**
+ * @brief Free a graph with all its nodes, links and interfaces.
+ *
+ * The receiver threads are stopped first since they use the nodes.
+ * Sockets, eventfds and rings of the nodes and interfaces are closed.
+ *
+ * @param  graph: pointer to graph to destroy, may be NULL
+ */
+void destroy_graph(graph_t *graph){
+    glthread_t *curr;
+    node_t *node;
+
+    if(graph == NULL){
+        return;
+    }
+    // Generators send from their own threads, stop them first
+    ITERATE_GLTHREAD_BEGIN(&graph->node_list, curr){
+        traffic_gen_stop(graph_glue_to_node(curr));
+    } ITERATE_GLTHREAD_END(&graph->node_list, curr);
+    network_stop_pkt_receiver_thread();
+
+    ITERATE_GLTHREAD_BEGIN(&graph->node_list, curr){
+        node = graph_glue_to_node(curr);
+        for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
+            interface_t *intf = node->interfaces[i];
+            if(intf == NULL){
+                continue;
+            }
+            // Both interfaces live in the link, detach them from their
+            // nodes before freeing it
+            link_t *link = intf->link;
+            interface_t *ends[2] = { &link->if1, &link->if2 };
+            for(int j=0; j<2; j++){
+                ends[j]->attached_node->interfaces[ends[j]->ifindex] = NULL;
+                destroy_comm_intf(ends[j]);
+                lat_hist_destroy(link->lat_hist[j]);
+            }
+            free(link);
+        }
+        remove_glthread(&node->graph_glue);
+        destroy_comm_node(node);
+        lat_hist_destroy(node->lat_hist);
+        traffic_gen_destroy(node);
+        arp_engine_destroy(node->arp);
+        l2_switch_destroy(node->l2_switch);
+        free(node);
+    } ITERATE_GLTHREAD_END(&graph->node_list, curr);
+
+    free(graph);
+}
 
 void dump_graph(graph_t *graph){
     if(graph != NULL){
@@ -138,6 +247,13 @@ void dump_node(node_t *node){
     if(node != NULL){
         printf("Node name: %s\n", node->node_name);
         printf("loopback IP: %s/%d\n", LOOPBACK_IP(node).ip_addr, LOOPBACK_IP(node).mask);
+        if(comm_get_transport() == COMM_TRANSPORT_UDP){
+            char host[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &node->comm_server_ip, host, sizeof(host));
+            printf("comm endpoint: %s:%d partition %u (%s)\n", host,
+                   node->comm_server_listen_port, node->comm_partition,
+                   node->comm_local ? "local" : "remote");
+        }
         for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
             if(node->interfaces[i] != NULL){
                 dump_interface(node->interfaces[i]);
@@ -159,12 +275,21 @@ void dump_interface(interface_t *if1){
         printf("\tRemote node: None\n");
     }
     printf("\tCost of link: %u\n", if1->link->cost);
-    printf("\tMAC: %02x:%02x:%02x:%02x:%02x:%02x\n", IF_MAC(if1).mac[0],
-           IF_MAC(if1).mac[1],IF_MAC(if1).mac[2],IF_MAC(if1).mac[3],
-           IF_MAC(if1).mac[4],IF_MAC(if1).mac[5]);
+    if(link_emu_enabled(&if1->link->emu)){
+        // Counters of the direction of the link received on by if1
+        dump_link_emu(&if1->link->emu, (&if1->link->if1 == if1) ? 0 : 1);
+    }
+    printf("\tMAC: " MAC_ADDR_FMT "\n", MAC_ADDR_ARGS(IF_MAC(if1).mac));
     if(IS_INTF_L3_MODE(if1)){
         printf("\tIP address: %s/%d\n", IF_IP(if1).ip_addr, IF_IP(if1).mask);
     } else {
         printf("\tIP address not configured\n");
     }
+    // Captures are only started and stopped by the CLI thread
+    capture_t *c = if1->capture.capture;
+    if(c != NULL){
+        printf("\tCapturing to %s: %lu packets captured, %lu dropped\n", c->path,
+               (unsigned long)__atomic_load_n(&c->n_captured, __ATOMIC_RELAXED),
+               (unsigned long)__atomic_load_n(&c->n_dropped, __ATOMIC_RELAXED));
+    }
 }
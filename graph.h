@@ -9,18 +9,29 @@
 
 #include "gluethread/glthread.h"
 #include "net.h"
+#include "spsc_ring.h"
+#include "link_emu.h"
+#include "comm_stats.h"
+#include "lat_hist.h"
+#include "capture.h"
 #include <string.h>
 
 #define TOPOLOGY_NAME_SIZE 32
 #define NODE_NAME_SIZE 32
 #define MAX_INTERFACES_PER_NODE 16
 #define IF_NAME_SIZE 32
+// RX rings of an interface with the shared memory transport, one per
+// sending thread; threads beyond the first ones share the last ring
+#define MAX_RX_RINGS_PER_INTF 8
 
 // Forward declarations
 typedef struct graph_ graph_t;
 typedef struct node_ node_t;
 typedef struct interface_ interface_t;
 typedef struct link_ link_t;
+typedef struct traffic_gen_ traffic_gen_t;
+typedef struct arp_engine_ arp_engine_t;
+typedef struct l2_switch_ l2_switch_t;
 
 // Graph indicating the network of nodes.
 typedef struct graph_ {
@@ -36,6 +47,23 @@ typedef struct node_{
     // This sock FD is where data for this node will be received.
     int comm_udp_server_sock_fd; ///< listen UDP socket of this node
     int comm_server_listen_port; ///< Port number to which listen socket is bound
+    uint32_t comm_server_ip; ///< IPv4 address of the listen socket, network byte order
+    unsigned int comm_partition; ///< partition (process) running this node
+    int comm_local; ///< node runs in this process
+    unsigned int rx_shard; ///< RX shard (receiver thread) processing this node
+    // Shared memory transport: senders put packets on the RX rings of
+    // this node's interfaces and wake the node up through this eventfd.
+    int comm_shm_event_fd; ///< eventfd signalled when RX rings have packets
+    int comm_shm_wakeup_pending; ///< eventfd already signalled, not drained yet
+    // Drops of packets not belonging to any interface of the node.
+    // Packets and bytes are counted on the interfaces.
+    comm_stats_t stats;
+    // Send to receive latency of the packets received by the node.
+    // Allocated by the node's receiver thread on the first packet.
+    lat_hist_t *lat_hist;
+    traffic_gen_t *traffic_gen; ///< created on first use
+    arp_engine_t *arp; ///< ARP table and resolutions in progress
+    l2_switch_t *l2_switch; ///< MAC table of the L2 ports
     glthread_t graph_glue;
 } node_t;
 
@@ -43,9 +71,23 @@ typedef struct node_{
 // each interface is also given a name
 typedef struct interface_ {
     char interface_name[IF_NAME_SIZE]; ///< name of interface
+    unsigned int ifindex; ///< index of this interface in attached_node->interfaces[]
     link_t *link; ///< which interface is this connected to
     node_t *attached_node; ///< node to which this attached to
     intf_nw_props_t intf_nw_props; ///< network properties
+    // UDP socket connected to the listen port of the node across the link.
+    // Created once when the link is wired, or by the parallel
+    // bring-up, and reused for every packet.
+    int comm_tx_sock_fd; ///< connected TX socket of this interface
+    // Shared memory transport: packets sent to this interface by the
+    // node across the link. Each sending thread gets its own single
+    // producer, single consumer ring on its first send, except for the
+    // last ring which is shared under comm_rx_shared_lock.
+    spsc_ring_t *comm_rx_rings[MAX_RX_RINGS_PER_INTF]; ///< RX rings of this interface, by sender
+    uint8_t comm_rx_shared_lock; ///< serializes the senders of the last RX ring
+    uint32_t comm_tx_seq; ///< sequence number of the next comm packet sent
+    comm_stats_t stats; ///< packets, bytes and drops of this interface
+    capture_point_t capture; ///< pcap capture of the packets sent and received
 } interface_t;
 
 // Link connects two interfaces
@@ -53,6 +95,11 @@ typedef struct link_ {
     interface_t if1; ///< interfaces in this link
     interface_t if2;
     unsigned int cost; ///< cost of this link, not used
+    link_emu_t emu; ///< impairments emulated on packets crossing the link
+    // Send to receive latency of each direction, [0]: towards if1,
+    // [1]: towards if2. Allocated by the receiver thread of the node
+    // the direction leads to, on the first packet.
+    lat_hist_t *lat_hist[2];
 } link_t;
 
 // map function to extract node information from gl linked list node
@@ -66,6 +113,7 @@ extern link_t* insert_link_between_two_nodes(node_t *node1,
                                          char *from_if_name,
                                          char *to_if_name,
                                          unsigned int cost);
+extern void destroy_graph(graph_t *graph);
 
 // Print functions
 extern void dump_graph(graph_t *graph);
@@ -0,0 +1,563 @@
+/**
+ * @file l2switch.c
+ * @author Abishek Ramdas
+ * @brief L2 learning switch: MAC table and forwarding of the frames
+ *        received on the L2 ports of a node
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "l2switch.h"
+#include "comm.h"
+#include "net.h"
+
+// MAC Table CRUD
+
+/**
+ * @brief Home slot of a MAC address: multiplicative hash, top bits.
+ */
+static inline uint32_t mac_tbl_hash(const mac_tbl_t *mac_tbl, uint64_t mac){
+    return (uint32_t)((mac * 0x9e3779b97f4a7c15ULL) >> mac_tbl->hash_shift);
+}
+
+/**
+ * @brief Allocate the slots of a MAC table.
+ *
+ * @param  n_slots: number of slots, power of 2
+ * @return 0: Success
+ *        -1: Fail
+ */
+static int mac_tbl_alloc_slots(mac_tbl_t *mac_tbl, uint32_t n_slots){
+    mac_tbl_entry_t *slots = calloc(n_slots, sizeof(mac_tbl_entry_t));
+    if(slots == NULL){
+        perror("calloc");
+        return -1;
+    }
+    mac_tbl->slots = slots;
+    mac_tbl->n_slots = n_slots;
+    mac_tbl->n_entries = 0;
+    mac_tbl->hash_shift = 64 - __builtin_ctz(n_slots);
+    mac_tbl->lru_head = MAC_TBL_NIL;
+    mac_tbl->lru_tail = MAC_TBL_NIL;
+    return 0;
+}
+
+/**
+ * @brief Find the slot of a MAC address, or the empty slot ending its
+ *        probe sequence.
+ */
+static inline mac_tbl_entry_t *mac_tbl_probe(const mac_tbl_t *mac_tbl, uint64_t mac){
+    uint32_t mask = mac_tbl->n_slots - 1;
+    uint32_t slot = mac_tbl_hash(mac_tbl, mac);
+    for(;;){
+        mac_tbl_entry_t *entry = &mac_tbl->slots[slot];
+        if(!entry->in_use || entry->mac == mac){
+            return entry;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/**
+ * @brief Link the entry of a slot at the tail of the LRU list
+ */
+static inline void mac_tbl_lru_append(mac_tbl_t *mac_tbl, uint32_t slot){
+    mac_tbl_entry_t *entry = &mac_tbl->slots[slot];
+    entry->lru_prev = mac_tbl->lru_tail;
+    entry->lru_next = MAC_TBL_NIL;
+    if(mac_tbl->lru_tail != MAC_TBL_NIL){
+        mac_tbl->slots[mac_tbl->lru_tail].lru_next = slot;
+    } else {
+        mac_tbl->lru_head = slot;
+    }
+    mac_tbl->lru_tail = slot;
+}
+
+/**
+ * @brief Unlink the entry of a slot from the LRU list
+ */
+static inline void mac_tbl_lru_unlink(mac_tbl_t *mac_tbl, uint32_t slot){
+    mac_tbl_entry_t *entry = &mac_tbl->slots[slot];
+    if(entry->lru_prev != MAC_TBL_NIL){
+        mac_tbl->slots[entry->lru_prev].lru_next = entry->lru_next;
+    } else {
+        mac_tbl->lru_head = entry->lru_next;
+    }
+    if(entry->lru_next != MAC_TBL_NIL){
+        mac_tbl->slots[entry->lru_next].lru_prev = entry->lru_prev;
+    } else {
+        mac_tbl->lru_tail = entry->lru_prev;
+    }
+}
+
+/**
+ * @brief Point the LRU neighbours of an entry moved to a slot at its
+ *        new slot
+ */
+static inline void mac_tbl_lru_moved(mac_tbl_t *mac_tbl, uint32_t slot){
+    mac_tbl_entry_t *entry = &mac_tbl->slots[slot];
+    if(entry->lru_prev != MAC_TBL_NIL){
+        mac_tbl->slots[entry->lru_prev].lru_next = slot;
+    } else {
+        mac_tbl->lru_head = slot;
+    }
+    if(entry->lru_next != MAC_TBL_NIL){
+        mac_tbl->slots[entry->lru_next].lru_prev = slot;
+    } else {
+        mac_tbl->lru_tail = slot;
+    }
+}
+
+/**
+ * @brief Double the slots of a MAC table and put the entries back, in
+ *        LRU order.
+ *
+ * @return 0: Success
+ *        -1: Fail, the table is left as it was
+ */
+static int mac_tbl_grow(mac_tbl_t *mac_tbl){
+    mac_tbl_t old = *mac_tbl;
+    if(old.n_slots > UINT32_MAX / 4 || mac_tbl_alloc_slots(mac_tbl, old.n_slots * 2) < 0){
+        *mac_tbl = old;
+        return -1;
+    }
+    for(uint32_t i=old.lru_head; i != MAC_TBL_NIL; i=old.slots[i].lru_next){
+        mac_tbl_entry_t *entry = mac_tbl_probe(mac_tbl, old.slots[i].mac);
+        *entry = old.slots[i];
+        mac_tbl_lru_append(mac_tbl, (uint32_t)(entry - mac_tbl->slots));
+        mac_tbl->n_entries++;
+    }
+    free(old.slots);
+    return 0;
+}
+
+/**
+ * @brief Remove the entry of a slot from the MAC table, shifting back
+ *        the entries probed after it.
+ */
+static void mac_tbl_remove_slot(mac_tbl_t *mac_tbl, uint32_t hole){
+    uint32_t mask = mac_tbl->n_slots - 1;
+    uint32_t slot = hole;
+
+    mac_tbl_lru_unlink(mac_tbl, hole);
+    for(;;){
+        slot = (slot + 1) & mask;
+        mac_tbl_entry_t *next = &mac_tbl->slots[slot];
+        if(!next->in_use){
+            break;
+        }
+        uint32_t home = mac_tbl_hash(mac_tbl, next->mac);
+        if(((slot - home) & mask) >= ((slot - hole) & mask)){
+            mac_tbl->slots[hole] = *next;
+            mac_tbl_lru_moved(mac_tbl, hole);
+            hole = slot;
+        }
+    }
+    memset(&mac_tbl->slots[hole], 0, sizeof(mac_tbl_entry_t));
+    mac_tbl->n_entries--;
+}
+
+/**
+ * @brief Create an empty MAC table
+ *
+ * @return pointer to heap allocated MAC table, NULL on failure
+ */
+mac_tbl_t *create_mac_tbl(void){
+    mac_tbl_t *mac_tbl = calloc(1, sizeof(mac_tbl_t));
+    if(mac_tbl == NULL){
+        perror("calloc");
+        return NULL;
+    }
+    if(mac_tbl_alloc_slots(mac_tbl, MAC_TBL_MIN_SLOTS) < 0){
+        free(mac_tbl);
+        return NULL;
+    }
+    mac_tbl->max_entries = MAC_TBL_DEFAULT_MAX_ENTRIES;
+    mac_tbl->age_ns = MAC_TBL_DEFAULT_AGE_MS * 1000000ULL;
+    return mac_tbl;
+}
+
+/**
+ * @brief Free a MAC table and its entries
+ *
+ * @param  mac_tbl: pointer to the MAC table, may be NULL
+ */
+void destroy_mac_tbl(mac_tbl_t *mac_tbl){
+    if(mac_tbl == NULL){
+        return;
+    }
+    free(mac_tbl->slots);
+    free(mac_tbl);
+}
+
+/**
+ * @brief Lookup a MAC address into the MAC table
+ *
+ * @param  mac_tbl: pointer to the MAC table
+ * @param  mac: MAC address, packed like mac_addr_t
+ * @return pointer to the MAC table entry if found
+ *         NULL if not found
+ */
+mac_tbl_entry_t *lookup_mac_tbl_entry(mac_tbl_t *mac_tbl, uint64_t mac){
+    mac_tbl_entry_t *entry = mac_tbl_probe(mac_tbl, mac);
+    return entry->in_use ? entry : NULL;
+}
+
+/**
+ * @brief Learn the port of a MAC address, from a frame it sent.
+ *
+ * Adds an entry for the MAC address, or refreshes its entry and moves
+ * it to the port. The entry becomes the most recently refreshed. A
+ * table holding max_entries entries evicts its least recently
+ * refreshed entry to make room for a new one.
+ *
+ * @param  mac_tbl: pointer to the MAC table
+ * @param  mac: MAC address, packed like mac_addr_t
+ * @param  ifindex: index of the port the frame came in on
+ * @param  now_ns: time the frame came in
+ * @param  moved: set to 1 if the MAC address was known on another port,
+ *                0 otherwise
+ * @return pointer to the MAC table entry
+ *         NULL if the table cannot grow
+ */
+mac_tbl_entry_t *learn_mac_tbl_entry(mac_tbl_t *mac_tbl, uint64_t mac,
+                                     unsigned int ifindex, uint64_t now_ns, int *moved){
+    mac_tbl_entry_t *entry = mac_tbl_probe(mac_tbl, mac);
+    *moved = 0;
+    if(entry->in_use){
+        uint32_t slot = (uint32_t)(entry - mac_tbl->slots);
+        if(slot != mac_tbl->lru_tail){
+            mac_tbl_lru_unlink(mac_tbl, slot);
+            mac_tbl_lru_append(mac_tbl, slot);
+        }
+        *moved = (entry->ifindex != ifindex);
+        entry->ifindex = ifindex;
+        entry->refresh_ns = now_ns;
+        return entry;
+    }
+    if(mac_tbl->n_entries >= mac_tbl->max_entries && mac_tbl->lru_head != MAC_TBL_NIL){
+        mac_tbl_remove_slot(mac_tbl, mac_tbl->lru_head);
+        mac_tbl->n_evicted++;
+        entry = mac_tbl_probe(mac_tbl, mac);
+    }
+    if((uint64_t)(mac_tbl->n_entries + 1) * 100 >
+       (uint64_t)mac_tbl->n_slots * MAC_TBL_MAX_LOAD_PCT){
+        if(mac_tbl_grow(mac_tbl) < 0){
+            printf("MAC table full at %u entries\n", mac_tbl->n_entries);
+            return NULL;
+        }
+        entry = mac_tbl_probe(mac_tbl, mac);
+    }
+    entry->mac = mac;
+    entry->ifindex = ifindex;
+    entry->refresh_ns = now_ns;
+    entry->in_use = 1;
+    mac_tbl->n_entries++;
+    mac_tbl->n_learned++;
+    mac_tbl_lru_append(mac_tbl, (uint32_t)(entry - mac_tbl->slots));
+    return entry;
+}
+
+/**
+ * @brief Delete the entry of a MAC address from the MAC table
+ *
+ * @param  mac_tbl: pointer to the MAC table
+ * @param  mac: MAC address, packed like mac_addr_t
+ * @return 0: Success
+ *        -1: Fail, the MAC address has no entry
+ */
+int delete_mac_tbl_entry(mac_tbl_t *mac_tbl, uint64_t mac){
+    mac_tbl_entry_t *entry = lookup_mac_tbl_entry(mac_tbl, mac);
+    if(entry == NULL){
+        return -1;
+    }
+    mac_tbl_remove_slot(mac_tbl, (uint32_t)(entry - mac_tbl->slots));
+    return 0;
+}
+
+/**
+ * @brief Remove the entries of a MAC table not refreshed for the age
+ *        time
+ *
+ * Only the head of the LRU list is looked at, the cost is the number
+ * of entries removed.
+ *
+ * @param  mac_tbl: pointer to the MAC table
+ * @param  now_ns: CLOCK_MONOTONIC time to age the table to
+ * @return time the next entry ages out, 0 if the table is empty
+ */
+uint64_t mac_tbl_age(mac_tbl_t *mac_tbl, uint64_t now_ns){
+    while(mac_tbl->lru_head != MAC_TBL_NIL){
+        mac_tbl_entry_t *entry = &mac_tbl->slots[mac_tbl->lru_head];
+        uint64_t expire_ns = entry->refresh_ns + mac_tbl->age_ns;
+        if(now_ns < expire_ns){
+            return expire_ns;
+        }
+        mac_tbl_remove_slot(mac_tbl, mac_tbl->lru_head);
+        mac_tbl->n_aged++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Set the most entries a MAC table holds, evicting the least
+ *        recently refreshed entries past it
+ *
+ * @param  mac_tbl: pointer to the MAC table
+ * @param  max_entries: most entries, at least 1
+ */
+void mac_tbl_set_max_entries(mac_tbl_t *mac_tbl, uint32_t max_entries){
+    mac_tbl->max_entries = max_entries ? max_entries : 1;
+    while(mac_tbl->n_entries > mac_tbl->max_entries){
+        mac_tbl_remove_slot(mac_tbl, mac_tbl->lru_head);
+        mac_tbl->n_evicted++;
+    }
+}
+
+/**
+ * @brief Print the entries of a MAC table
+ *
+ * @param  node: node owning the table, gives the port names
+ * @param  mac_tbl: pointer to the MAC table
+ */
+void dump_mac_tbl(node_t *node, mac_tbl_t *mac_tbl){
+    mac_tbl_entry_t *entry;
+    uint64_t now_ns = timer_now_ns();
+
+    printf("MAC table: %u entries (max %u), %u slots; age %lu ms\n",
+           mac_tbl->n_entries, mac_tbl->max_entries, mac_tbl->n_slots,
+           (unsigned long)(mac_tbl->age_ns / 1000000));
+    printf("Learned %lu, evicted %lu, aged %lu\n", (unsigned long)mac_tbl->n_learned,
+           (unsigned long)mac_tbl->n_evicted, (unsigned long)mac_tbl->n_aged);
+    printf("%-18s %-10s %s\n", "MAC", "Port", "Age (ms)");
+    ITERATE_MAC_TBL_BEGIN(mac_tbl, entry){
+        interface_t *intf = (entry->ifindex < MAX_INTERFACES_PER_NODE) ?
+            node->interfaces[entry->ifindex] : NULL;
+        printf(MAC_ADDR_FMT "  %-10s %lu\n", MAC_ADDR_ARGS(entry->mac),
+               intf ? intf->interface_name : "-",
+               (unsigned long)((now_ns - entry->refresh_ns) / 1000000));
+    } ITERATE_MAC_TBL_END(mac_tbl, entry);
+}
+
+
+// L2 switching
+
+/**
+ * @brief Create the L2 switch of a node, with an empty MAC table
+ *
+ * @return pointer to heap allocated switch, NULL on failure
+ */
+l2_switch_t *l2_switch_create(void){
+    l2_switch_t *sw = calloc(1, sizeof(l2_switch_t));
+    if(sw == NULL){
+        perror("calloc");
+        return NULL;
+    }
+    sw->mac_tbl = create_mac_tbl();
+    if(sw->mac_tbl == NULL){
+        free(sw);
+        return NULL;
+    }
+    pthread_mutex_init(&sw->lock, NULL);
+    return sw;
+}
+
+/**
+ * @brief Free the L2 switch of a node. The receiver threads must be
+ *        stopped.
+ *
+ * @param  sw: pointer to the switch, may be NULL
+ */
+void l2_switch_destroy(l2_switch_t *sw){
+    if(sw == NULL){
+        return;
+    }
+    destroy_mac_tbl(sw->mac_tbl);
+    pthread_mutex_destroy(&sw->lock);
+    free(sw);
+}
+
+/**
+ * @brief Age the MAC table of a node and queue the timer again for the
+ *        next entry to age out.
+ *
+ * Timer callback, runs on the receiver thread of the node.
+ *
+ * @param  arg: node
+ */
+static void l2_switch_age_timer(void *arg, void *data __attribute__((unused))){
+    node_t *node = (node_t *)arg;
+    l2_switch_t *sw = node->l2_switch;
+    timer_queue_t *tq = comm_rx_timers();
+
+    pthread_mutex_lock(&sw->lock);
+    uint64_t next_ns = mac_tbl_age(sw->mac_tbl, timer_now_ns());
+    sw->age_armed = (next_ns != 0 && tq != NULL &&
+                     timer_queue_add(tq, next_ns, l2_switch_age_timer, node, NULL) == 0);
+    pthread_mutex_unlock(&sw->lock);
+}
+
+/**
+ * @brief Forget the aging timer of a node when the timer queue of its
+ *        receiver thread is emptied, the next frame queues it again.
+ *
+ * Timer cancel callback, ignores the events of other callbacks.
+ *
+ * @param  ev: timer event being cancelled
+ */
+void l2_switch_age_cancel(timer_event_t *ev){
+    if(ev->cb != l2_switch_age_timer){
+        return;
+    }
+    l2_switch_t *sw = ((node_t *)ev->arg)->l2_switch;
+    pthread_mutex_lock(&sw->lock);
+    sw->age_armed = 0;
+    pthread_mutex_unlock(&sw->lock);
+}
+
+/**
+ * @brief Switch a frame received on an L2 port of a node
+ *
+ * The source MAC address is learned on the port. A frame to a known
+ * unicast MAC address goes out of the single port it was learned on,
+ * or is filtered if that is the port it came in on. Frames to unknown
+ * unicast, broadcast and multicast MAC addresses are flooded out of
+ * every other L2 port. The cost of a known unicast frame does not
+ * depend on the number of ports.
+ *
+ * Called on the receiver thread of the node, which sends the frame
+ * while the CLI and the traffic generator may send out of the same
+ * ports: the transports take care of concurrent senders, the shared
+ * memory transport with a ring per sending thread.
+ *
+ * @param  node: switching node
+ * @param  rx_if: L2 port the frame came in on
+ * @param  pb: packet buffer holding the frame, with its L2 addresses;
+ *             unchanged and still owned by the caller on return
+ * @return 0: Success
+ *        -1: Fail, the frame could not be sent on some port
+ */
+int l2_switch_recv_frame(node_t *node, interface_t *rx_if, pkt_buf_t *pb){
+    l2_switch_t *sw = node->l2_switch;
+    timer_queue_t *tq = comm_rx_timers();
+    interface_t *out_if = NULL;
+    int moved;
+
+    if(sw == NULL){
+        return -1;
+    }
+    uint64_t now_ns = timer_now_ns();
+
+    pthread_mutex_lock(&sw->lock);
+    // Group addresses are never the source of a frame
+    if(mac_addr_is_unicast(pb->l2.src_mac) &&
+       learn_mac_tbl_entry(sw->mac_tbl, pb->l2.src_mac, rx_if->ifindex,
+                           now_ns, &moved) != NULL){
+        if(moved){
+            sw->stats.moved++;
+        }
+        if(!sw->age_armed && tq != NULL){
+            uint64_t next_ns = mac_tbl_age(sw->mac_tbl, now_ns);
+            sw->age_armed = (next_ns != 0 &&
+                             timer_queue_add(tq, next_ns, l2_switch_age_timer,
+                                             node, NULL) == 0);
+        }
+    }
+    if(mac_addr_is_unicast(pb->l2.dst_mac)){
+        mac_tbl_entry_t *entry = lookup_mac_tbl_entry(sw->mac_tbl, pb->l2.dst_mac);
+        if(entry != NULL && entry->ifindex < MAX_INTERFACES_PER_NODE){
+            out_if = node->interfaces[entry->ifindex];
+        }
+    }
+    if(out_if == rx_if){
+        sw->stats.filtered++;
+        pthread_mutex_unlock(&sw->lock);
+        return 0;
+    }
+    if(out_if != NULL && IF_L2_MODE(out_if) != L2_MODE_NONE){
+        sw->stats.forwarded++;
+        pthread_mutex_unlock(&sw->lock);
+        return send_pkt_buf_out(pb, out_if);
+    }
+    sw->stats.flooded++;
+    pthread_mutex_unlock(&sw->lock);
+    return send_pkt_buf_flood_l2(node, rx_if, pb);
+}
+
+/**
+ * @brief Set the most entries the MAC table of a node holds
+ *
+ * The least recently refreshed entries past the new maximum are
+ * evicted right away.
+ *
+ * @param  node: node
+ * @param  max_entries: most entries, at least 1
+ * @return 0: Success
+ *        -1: Fail, invalid maximum
+ */
+int l2_switch_set_max_entries(node_t *node, uint32_t max_entries){
+    l2_switch_t *sw = node->l2_switch;
+    if(max_entries == 0){
+        printf("The MAC table holds at least one entry\n");
+        return -1;
+    }
+    pthread_mutex_lock(&sw->lock);
+    mac_tbl_set_max_entries(sw->mac_tbl, max_entries);
+    pthread_mutex_unlock(&sw->lock);
+    return 0;
+}
+
+/**
+ * @brief Set after how long without a frame the MAC entries of a node
+ *        age out
+ *
+ * Entries are aged with the new time from the next aging run, the
+ * timer already queued is not moved.
+ *
+ * @param  node: node
+ * @param  age_ms: age time, not 0
+ * @return 0: Success
+ *        -1: Fail, invalid age time
+ */
+int l2_switch_set_age(node_t *node, uint32_t age_ms){
+    l2_switch_t *sw = node->l2_switch;
+    if(age_ms == 0){
+        printf("MAC entries must age after some time\n");
+        return -1;
+    }
+    pthread_mutex_lock(&sw->lock);
+    sw->mac_tbl->age_ns = age_ms * 1000000ULL;
+    pthread_mutex_unlock(&sw->lock);
+    return 0;
+}
+
+/**
+ * @brief Print the MAC table and switching counters of every node with
+ *        an L2 port
+ *
+ * @param  topo: pointer to the graph topology
+ */
+void dump_l2_switch(graph_t *topo){
+    glthread_t *curr;
+    ITERATE_GLTHREAD_BEGIN(&topo->node_list, curr){
+        node_t *node = graph_glue_to_node(curr);
+        l2_switch_t *sw = node->l2_switch;
+        int n_ports = 0;
+        for(int i=0; i<MAX_INTERFACES_PER_NODE && node->interfaces[i]; i++){
+            n_ports += (IF_L2_MODE(node->interfaces[i]) != L2_MODE_NONE);
+        }
+        if(sw == NULL || !node->comm_local || n_ports == 0){
+            continue;
+        }
+        pthread_mutex_lock(&sw->lock);
+        l2_switch_stats_t st = sw->stats;
+        printf("Node %s, %d L2 ports\n", node->node_name, n_ports);
+        dump_mac_tbl(node, sw->mac_tbl);
+        pthread_mutex_unlock(&sw->lock);
+        printf("Moved %lu; forwarded %lu, flooded %lu, filtered %lu\n\n",
+               (unsigned long)st.moved,
+               (unsigned long)st.forwarded, (unsigned long)st.flooded,
+               (unsigned long)st.filtered);
+    } ITERATE_GLTHREAD_END(&topo->node_list, curr);
+}
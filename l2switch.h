@@ -0,0 +1,115 @@
+/**
+ * @file l2switch.h
+ * @author Abishek Ramdas
+ * @brief L2 learning switch: MAC table and forwarding of the frames
+ *        received on the L2 ports of a node
+ */
+
+#ifndef __MY_L2SWITCH_H
+#define __MY_L2SWITCH_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "graph.h"
+#include "pkt_buf.h"
+#include "timer.h"
+
+#define MAC_TBL_MIN_SLOTS 16    ///< slots of a new MAC table, power of 2
+#define MAC_TBL_MAX_LOAD_PCT 70 ///< table doubles past this percentage of used slots
+#define MAC_TBL_DEFAULT_MAX_ENTRIES 8192
+#define MAC_TBL_DEFAULT_AGE_MS 300000 ///< entry removed this long after its last frame
+#define MAC_TBL_NIL UINT32_MAX ///< no slot, ends the LRU list
+
+/**
+ * MAC table entry, stored in place in a slot of the MAC table. 32
+ * bytes, so two entries share a cache line.
+ */
+typedef struct mac_tbl_entry_ {
+    uint64_t mac;        ///< MAC address packed like mac_addr_t (key)
+    uint64_t refresh_ns; ///< last time a frame came from the MAC address
+    uint32_t lru_prev;   ///< slot of the entry refreshed before this one
+    uint32_t lru_next;   ///< slot of the entry refreshed after this one
+    uint16_t ifindex;    ///< port the MAC address was learned on
+    uint8_t in_use;      ///< slot holds an entry
+} mac_tbl_entry_t;
+
+/**
+ * MAC table: open addressing hash table keyed by MAC address, with
+ * linear probing and backward shift deletion like the ARP table.
+ * Entries are linked by slot number in the order they were last
+ * refreshed; the head is the entry evicted when the table is full and
+ * the next one to age out.
+ *
+ * Pointers to entries are valid until the next learn or delete.
+ */
+typedef struct mac_tbl_ {
+    mac_tbl_entry_t *slots;
+    uint32_t n_slots; ///< power of 2
+    uint32_t n_entries;
+    unsigned int hash_shift; ///< 64 - log2(n_slots)
+    uint32_t lru_head; ///< least recently refreshed entry
+    uint32_t lru_tail; ///< most recently refreshed entry
+    uint32_t max_entries; ///< learning past this evicts the head
+    uint64_t age_ns;
+    uint64_t n_learned; ///< entries added
+    uint64_t n_evicted; ///< entries removed to make room
+    uint64_t n_aged;    ///< entries removed by aging
+} mac_tbl_t;
+
+/**
+ * Iterate over the entries of a MAC table. The table must not be
+ * changed while iterating.
+ */
+#define ITERATE_MAC_TBL_BEGIN(mac_tbl, entry)                             \
+{                                                                         \
+    for(uint32_t _slot = 0; _slot < (mac_tbl)->n_slots; _slot++){         \
+        entry = &(mac_tbl)->slots[_slot];                                 \
+        if(!entry->in_use) continue;
+
+#define ITERATE_MAC_TBL_END(mac_tbl, entry) }}
+
+typedef struct l2_switch_stats_ {
+    uint64_t moved;     ///< MAC addresses seen again on another port
+    uint64_t forwarded; ///< known unicast frames sent out of one port
+    uint64_t flooded;   ///< unknown unicast and broadcast frames
+    uint64_t filtered;  ///< frames for a MAC address on their own port
+} l2_switch_stats_t;
+
+/**
+ * L2 switch of a node. Used by the receiver thread of the node and by
+ * the CLI, under the lock.
+ */
+typedef struct l2_switch_ {
+    pthread_mutex_t lock;
+    mac_tbl_t *mac_tbl;
+    int age_armed; ///< aging timer queued on the receiver thread of the node
+    l2_switch_stats_t stats;
+} l2_switch_t;
+
+/**
+ * MAC Table CRUD
+ *
+ */
+mac_tbl_t *create_mac_tbl(void);
+void destroy_mac_tbl(mac_tbl_t *mac_tbl);
+mac_tbl_entry_t *lookup_mac_tbl_entry(mac_tbl_t *mac_tbl, uint64_t mac);
+mac_tbl_entry_t *learn_mac_tbl_entry(mac_tbl_t *mac_tbl, uint64_t mac,
+                                     unsigned int ifindex, uint64_t now_ns, int *moved);
+int delete_mac_tbl_entry(mac_tbl_t *mac_tbl, uint64_t mac);
+uint64_t mac_tbl_age(mac_tbl_t *mac_tbl, uint64_t now_ns);
+void mac_tbl_set_max_entries(mac_tbl_t *mac_tbl, uint32_t max_entries);
+void dump_mac_tbl(node_t *node, mac_tbl_t *mac_tbl);
+
+/**
+ * L2 switching
+ *
+ */
+l2_switch_t *l2_switch_create(void);
+void l2_switch_destroy(l2_switch_t *sw);
+int l2_switch_recv_frame(node_t *node, interface_t *rx_if, pkt_buf_t *pb);
+int l2_switch_set_max_entries(node_t *node, uint32_t max_entries);
+int l2_switch_set_age(node_t *node, uint32_t age_ms);
+void l2_switch_age_cancel(timer_event_t *ev);
+void dump_l2_switch(graph_t *topo);
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * @file lat_hist.c
+ * @author Abishek Ramdas
+ * @brief Log-linear latency histograms
+ */
+
+#include "lat_hist.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIST_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define HIST_STORE(field, val) __atomic_store_n(&(field), (val), __ATOMIC_RELAXED)
+
+// Generation of the counts of every histogram, bumped to reset them
+static uint32_t lat_hist_gen = 0;
+
+lat_hist_t *lat_hist_create(void){
+    lat_hist_t *h = calloc(1, sizeof(lat_hist_t));
+    if(h == NULL){
+        perror("calloc");
+        return NULL;
+    }
+    h->gen = __atomic_load_n(&lat_hist_gen, __ATOMIC_ACQUIRE);
+    return h;
+}
+
+void lat_hist_destroy(lat_hist_t *h){
+    free(h);
+}
+
+/**
+ * @brief Highest latency counted by a bucket.
+ */
+static uint64_t lat_hist_bucket_max(unsigned int idx){
+    if(idx < 2 * LAT_HIST_SUB_BUCKETS){
+        return idx;
+    }
+    unsigned int shift = idx / LAT_HIST_SUB_BUCKETS - 1;
+    uint64_t sub = idx % LAT_HIST_SUB_BUCKETS + LAT_HIST_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * @brief Count a latency.
+ *
+ * Must only be called by the thread owning the histogram.
+ *
+ * @param  h: histogram
+ * @param  latency_ns: latency in nanoseconds
+ */
+void lat_hist_record(lat_hist_t *h, uint64_t latency_ns){
+    uint32_t gen = __atomic_load_n(&lat_hist_gen, __ATOMIC_ACQUIRE);
+    if(h->gen != gen){
+        // Reset requested since the last sample. Readers see the old
+        // generation until the counts are cleared.
+        for(unsigned int i=0; i<LAT_HIST_BUCKETS; i++){
+            HIST_STORE(h->counts[i], 0);
+        }
+        HIST_STORE(h->n_samples, 0);
+        HIST_STORE(h->sum_ns, 0);
+        HIST_STORE(h->max_ns, 0);
+        __atomic_store_n(&h->gen, gen, __ATOMIC_RELEASE);
+    }
+
+    unsigned int idx = lat_hist_bucket(latency_ns);
+    HIST_STORE(h->counts[idx], h->counts[idx] + 1);
+    HIST_STORE(h->n_samples, h->n_samples + 1);
+    HIST_STORE(h->sum_ns, h->sum_ns + latency_ns);
+    if(latency_ns > h->max_ns){
+        HIST_STORE(h->max_ns, latency_ns);
+    }
+}
+
+/**
+ * @brief Compute the percentiles of a histogram.
+ *
+ * Runs while the owner keeps recording, without locking. A percentile
+ * is the highest latency of the bucket it falls in, never more than the
+ * largest latency seen.
+ *
+ * @param  h: histogram, may be NULL if nothing was recorded
+ * @param  summary: filled in, all zero if there are no samples
+ */
+void lat_hist_summarize(lat_hist_t *h, lat_hist_summary_t *summary){
+    static const double pcts[] = { 50.0, 90.0, 99.0, 99.9 };
+    uint64_t *outs[] = { &summary->p50_ns, &summary->p90_ns,
+                         &summary->p99_ns, &summary->p999_ns };
+
+    memset(summary, 0, sizeof(*summary));
+    if(h == NULL ||
+       __atomic_load_n(&h->gen, __ATOMIC_ACQUIRE) != __atomic_load_n(&lat_hist_gen, __ATOMIC_ACQUIRE)){
+        return;
+    }
+
+    // The total is taken from the buckets so the percentiles stay
+    // consistent with the counts that were read.
+    uint64_t counts[LAT_HIST_BUCKETS];
+    uint64_t n = 0;
+    for(unsigned int i=0; i<LAT_HIST_BUCKETS; i++){
+        counts[i] = HIST_LOAD(h->counts[i]);
+        n += counts[i];
+    }
+    if(n == 0){
+        return;
+    }
+    summary->n_samples = n;
+    summary->max_ns = HIST_LOAD(h->max_ns);
+    uint64_t n_samples = HIST_LOAD(h->n_samples);
+    summary->mean_ns = n_samples ? HIST_LOAD(h->sum_ns) / n_samples : 0;
+
+    // Rank of the sample at each percentile, rounded up
+    uint64_t ranks[4];
+    for(unsigned int p=0; p<4; p++){
+        double rank = pcts[p] * n / 100.0;
+        ranks[p] = (uint64_t)rank;
+        if(ranks[p] < rank || ranks[p] == 0){
+            ranks[p]++;
+        }
+    }
+
+    unsigned int p = 0;
+    uint64_t seen = 0;
+    for(unsigned int i=0; i<LAT_HIST_BUCKETS && p < 4; i++){
+        seen += counts[i];
+        while(p < 4 && seen >= ranks[p]){
+            uint64_t v = lat_hist_bucket_max(i);
+            *outs[p++] = (v > summary->max_ns) ? summary->max_ns : v;
+        }
+    }
+}
+
+/**
+ * @brief Reset every histogram.
+ *
+ * Histograms are cleared by their owner on its next sample and read
+ * as empty until then.
+ */
+void lat_hist_reset_all(void){
+    __atomic_fetch_add(&lat_hist_gen, 1, __ATOMIC_ACQ_REL);
+}
@@ -0,0 +1,75 @@
+/**
+ * @file lat_hist.h
+ * @author Abishek Ramdas
+ * @brief Log-linear latency histograms
+ */
+
+#ifndef __MY_LAT_HIST_H
+#define __MY_LAT_HIST_H
+
+#include <stdint.h>
+
+// Every power of two range of latencies is split in 2^LAT_HIST_SUB_BITS
+// linear buckets, so a latency is known to within 1/32 (about 3%).
+// Latencies are in nanoseconds and clamped to LAT_HIST_MAX_NS.
+#define LAT_HIST_SUB_BITS 5
+#define LAT_HIST_SUB_BUCKETS (1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_MAX_BITS 34 ///< about 17 seconds
+#define LAT_HIST_MAX_NS ((1ULL << LAT_HIST_MAX_BITS) - 1)
+#define LAT_HIST_BUCKETS ((LAT_HIST_MAX_BITS - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB_BUCKETS)
+
+/**
+ * Latency histogram, constant size whatever the number of samples.
+ * Written by a single thread and read without locking. Histograms are
+ * reset all at once by bumping a generation: the writer clears a
+ * histogram on its next sample, readers ignore the counts of an older
+ * generation.
+ */
+typedef struct lat_hist_ {
+    uint32_t gen;       ///< reset generation the counts belong to
+    uint64_t n_samples;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t counts[LAT_HIST_BUCKETS];
+} lat_hist_t;
+
+/**
+ * Percentiles of a histogram, in nanoseconds
+ */
+typedef struct lat_hist_summary_ {
+    uint64_t n_samples;
+    uint64_t mean_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} lat_hist_summary_t;
+
+lat_hist_t *lat_hist_create(void);
+void lat_hist_destroy(lat_hist_t *h);
+void lat_hist_record(lat_hist_t *h, uint64_t latency_ns);
+void lat_hist_summarize(lat_hist_t *h, lat_hist_summary_t *summary);
+void lat_hist_reset_all(void);
+
+/**
+ * @brief Bucket counting a latency.
+ *
+ * Latencies below 2 * LAT_HIST_SUB_BUCKETS ns get a bucket each. Above,
+ * the bucket is given by the position of the highest bit set and the
+ * LAT_HIST_SUB_BITS bits below it.
+ */
+static inline unsigned int
+lat_hist_bucket(uint64_t ns){
+    if(ns > LAT_HIST_MAX_NS){
+        ns = LAT_HIST_MAX_NS;
+    }
+    if(ns < 2 * LAT_HIST_SUB_BUCKETS){
+        return (unsigned int)ns;
+    }
+    unsigned int shift = 63 - __builtin_clzll(ns) - LAT_HIST_SUB_BITS;
+    return (shift + 1) * LAT_HIST_SUB_BUCKETS +
+           (unsigned int)((ns >> shift) - LAT_HIST_SUB_BUCKETS);
+}
+
+#endif
@@ -1,43 +1,385 @@
+#define _GNU_SOURCE // pthread_rwlockattr_setkind_np
 #include "layer2.h"
 #include "gluethread/glthread.h"
 #include "graph.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include "comm.h"
+#include "timer.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-char *alloc_eth_frame(char *dl_pkt, size_t dk_pkt_size){
+/**
+ * @brief Write the ethernet header of a packet of L2 addresses l2.
+ *
+ * The header carries an 802.1Q tag if l2->vlan_tci is not 0. A packet
+ * with no ethertype is a data link packet of the nodes and gets
+ * ETH_TYPE_DATA_LINK: the length of the payload is the length of the
+ * frame, it is never written in the type field.
+ *
+ * @param  l2: L2 addresses, ethertype and tag of the packet
+ * @param  hdr: where to write the header, room for an ethernet_vlan_hdr_t
+ * @return bytes of the header
+ */
+uint32_t eth_hdr_build(const pkt_l2_t *l2, char *hdr){
+    uint16_t ethertype = l2->ethertype ? l2->ethertype : ETH_TYPE_DATA_LINK;
+    if(l2->vlan_tci != 0){
+        ethernet_vlan_hdr_t *vhdr = (ethernet_vlan_hdr_t *)hdr;
+        mac_addr_unpack(l2->dst_mac, vhdr->dst_mac);
+        mac_addr_unpack(l2->src_mac, vhdr->src_mac);
+        vhdr->tpid = htons(ETH_TYPE_VLAN);
+        vhdr->tci = htons(l2->vlan_tci);
+        vhdr->ethertype = htons(ethertype);
+        return sizeof(ethernet_vlan_hdr_t);
+    }
+    ethernet_hdr_t *eth_hdr = (ethernet_hdr_t *)hdr;
+    mac_addr_unpack(l2->dst_mac, eth_hdr->dst_mac);
+    mac_addr_unpack(l2->src_mac, eth_hdr->src_mac);
+    eth_hdr->ethertype = htons(ethertype);
+    return sizeof(ethernet_hdr_t);
+}
 
-    size_t eth_frame_size = sizeof(ethernet_hdr_t) + dk_pkt_size + sizeof(fcs_t);
-    if(eth_frame_size >  ETH_FRAME_MTU){
-        printf("Data link packet cannot be more then MTU size\n");
+/**
+ * @brief Push the ethernet header of a packet into the headroom of its
+ *        buffer, in place.
+ *
+ * The header is built from the L2 addresses of the packet (pkt->l2),
+ * see eth_hdr_build.
+ *
+ * @param  pkt: packet buffer holding the payload of the frame
+ * @return pointer to the ethernet header at the start of the buffer data
+ *         NULL if there is not enough headroom
+ */
+ethernet_hdr_t *eth_hdr_push(pkt_buf_t *pkt){
+    uint32_t hdr_size = pkt->l2.vlan_tci ? sizeof(ethernet_vlan_hdr_t) : sizeof(ethernet_hdr_t);
+    char *hdr = pkt_buf_push(pkt, hdr_size);
+    if(hdr == NULL){
         return NULL;
     }
+    eth_hdr_build(&pkt->l2, hdr);
+    return (ethernet_hdr_t *)hdr;
+}
 
-    char *ethfp = (char *)calloc(1, eth_frame_size);
-    if(ethfp == NULL){
-        perror("Calloc failed\n");
+/**
+ * @brief Pop the ethernet header off the start of a packet, in place.
+ *
+ * The MAC addresses, ethertype and 802.1Q tag of the header are stored
+ * in pkt->l2, then the header is pulled off the buffer, which holds
+ * the payload of the frame. A type field below ETH_TYPE_MIN is an
+ * 802.3 length: the packet is trimmed to it and its ethertype is 0. A
+ * frame of ETH_TYPE_DATA_LINK is a data link packet of the nodes and
+ * gets ethertype 0 as well, the reverse of eth_hdr_build.
+ *
+ * @param  pkt: packet buffer holding an ethernet frame, without FCS
+ * @return pointer to the payload
+ *         NULL if the frame is truncated or its type field is invalid
+ */
+char *eth_hdr_pop(pkt_buf_t *pkt){
+    if(pkt->len < sizeof(ethernet_hdr_t)){
         return NULL;
     }
-
-    ethernet_hdr_t *eth_hdr = (ethernet_hdr_t *) ethfp;
-    for(int i=0; i<6; i++){
-        eth_hdr->dst_mac[i] = 0;
-        eth_hdr->src_mac[i] = 0;
+    ethernet_hdr_t *eth_hdr = (ethernet_hdr_t *)pkt->data;
+    uint32_t hdr_size = sizeof(ethernet_hdr_t);
+    uint16_t type = ntohs(eth_hdr->ethertype);
+    uint16_t tci = 0;
+    if(type == ETH_TYPE_VLAN){
+        ethernet_vlan_hdr_t *vhdr = (ethernet_vlan_hdr_t *)pkt->data;
+        hdr_size = sizeof(ethernet_vlan_hdr_t);
+        if(pkt->len < hdr_size){
+            return NULL;
+        }
+        tci = ntohs(vhdr->tci);
+        type = ntohs(vhdr->ethertype);
+    }
+    uint32_t payload_size = pkt->len - hdr_size;
+    if(type < ETH_TYPE_MIN){
+        // 802.3 frame, the type field is the length of the payload
+        if(type > ETH_FRAME_MTU || type > payload_size){
+            return NULL;
+        }
+        payload_size = type;
+        type = 0;
+    } else if(type == ETH_TYPE_DATA_LINK){
+        type = 0;
     }
-    eth_hdr->ethertype = dk_pkt_size;
 
-    char *payload = ethfp + sizeof(ethernet_hdr_t);
-    memcpy(payload, dl_pkt, dk_pkt_size);
+    pkt->l2.dst_mac = mac_addr_pack(eth_hdr->dst_mac);
+    pkt->l2.src_mac = mac_addr_pack(eth_hdr->src_mac);
+    pkt->l2.ethertype = type;
+    pkt->l2.vlan_tci = tci;
+    pkt_buf_pull(pkt, hdr_size);
+    pkt->len = payload_size;
+    return pkt->data;
+}
 
-    fcs_t *fcs = (fcs_t*)ETH_FCS(ethfp, dk_pkt_size);
-    fcs = 0;
+/**
+ * @brief Qualify a burst of frames against the MAC of an interface.
+ *
+ * Same test as l2_mac_qualify, run on several destination MACs at once
+ * with SIMD compares: 4 frames per step with AVX2, 2 with SSE2 (what
+ * x86-64 builds get by default), one by one elsewhere.
+ *
+ * @param  if_mac: MAC of the interface, packed
+ * @param  dst_macs: destination MACs of the frames, packed
+ * @param  n: number of frames, at most 64
+ * @return mask with bit i set if frame i is taken by the interface
+ */
+uint64_t l2_mac_qualify_burst(uint64_t if_mac, const uint64_t *dst_macs, unsigned int n){
+    uint64_t accept = 0;
+    unsigned int i = 0;
+#if defined(__AVX2__)
+    const __m256i if_v = _mm256_set1_epi64x((long long)if_mac);
+    const __m256i bcast_v = _mm256_set1_epi64x((long long)MAC_ADDR_BROADCAST);
+    for(; i + 4 <= n; i += 4){
+        __m256i dst_v = _mm256_loadu_si256((const __m256i *)(dst_macs + i));
+        __m256i ok = _mm256_or_si256(_mm256_cmpeq_epi64(dst_v, if_v),
+                                     _mm256_cmpeq_epi64(dst_v, bcast_v));
+        accept |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(ok)) << i;
+    }
+#elif defined(__SSE2__)
+    const __m128i if_v = _mm_set1_epi64x((long long)if_mac);
+    const __m128i bcast_v = _mm_set1_epi64x((long long)MAC_ADDR_BROADCAST);
+    for(; i + 2 <= n; i += 2){
+        __m128i dst_v = _mm_loadu_si128((const __m128i *)(dst_macs + i));
+        // SSE2 compares 32 bit lanes: a 64 bit lane is equal when both
+        // of its halves are
+        __m128i eq_if = _mm_cmpeq_epi32(dst_v, if_v);
+        __m128i eq_bcast = _mm_cmpeq_epi32(dst_v, bcast_v);
+        eq_if = _mm_and_si128(eq_if, _mm_shuffle_epi32(eq_if, _MM_SHUFFLE(2, 3, 0, 1)));
+        eq_bcast = _mm_and_si128(eq_bcast, _mm_shuffle_epi32(eq_bcast, _MM_SHUFFLE(2, 3, 0, 1)));
+        __m128i ok = _mm_or_si128(eq_if, eq_bcast);
+        accept |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(ok)) << i;
+    }
+#endif
+    for(; i < n; i++){
+        accept |= (uint64_t)l2_mac_qualify(if_mac, dst_macs[i]) << i;
+    }
+    return accept;
+}
 
-    return ethfp;
+/**
+ * @brief Qualify a burst of frames received on an interface, see
+ *        l2_recv_qualify_at_if. The frames dropped are counted on the
+ *        interface.
+ *
+ * @param  intfp: receive interface
+ * @param  dst_macs: destination MACs of the frames, packed
+ * @param  n: number of frames, at most 64
+ * @return mask with bit i set if frame i continues to the next layer
+ */
+uint64_t l2_recv_qualify_burst(interface_t *intfp, const uint64_t *dst_macs, unsigned int n){
+    uint64_t all = (n >= 64) ? UINT64_MAX : (1ULL << n) - 1;
+    if(IF_L2_MODE(intfp) != L2_MODE_NONE){
+        return all;
+    }
+    if(IF_IP_CONFIG(intfp) == 0){
+        COMM_STAT_ADD(intfp->stats.rx.drops[COMM_DROP_IF_UNCONFIGURED], n);
+        return 0;
+    }
+    uint64_t accept = l2_mac_qualify_burst(IF_MAC(intfp).mac, dst_macs, n);
+    if(accept != all){
+        COMM_STAT_ADD(intfp->stats.rx.drops[COMM_DROP_MAC_MISMATCH],
+                      __builtin_popcountll(all & ~accept));
+    }
+    return accept;
 }
 
 
 // ARP Table CRUD
 
+/**
+ * @brief Home slot of an IP address: multiplicative hash, top bits.
+ */
+static inline uint32_t arp_tbl_hash(const arp_tbl_t *arp_tbl, uint32_t ip_num){
+    return (ip_num * 2654435761u) >> arp_tbl->hash_shift;
+}
+
+/**
+ * @brief Allocate the slots of an ARP table.
+ *
+ * @param  n_slots: number of slots, power of 2
+ * @return 0: Success
+ *        -1: Fail
+ */
+static int arp_tbl_alloc_slots(arp_tbl_t *arp_tbl, uint32_t n_slots){
+    arp_tbl_entry_t *slots = calloc(n_slots, sizeof(arp_tbl_entry_t));
+    if(slots == NULL){
+        perror("calloc");
+        return -1;
+    }
+    arp_tbl->slots = slots;
+    arp_tbl->n_slots = n_slots;
+    arp_tbl->n_entries = 0;
+    arp_tbl->hash_shift = 32 - __builtin_ctz(n_slots);
+    arp_tbl->lru_head = ARP_TBL_NIL;
+    arp_tbl->lru_tail = ARP_TBL_NIL;
+    return 0;
+}
+
+/**
+ * @brief Find the slot of an IP address, or the empty slot ending its
+ *        probe sequence.
+ */
+static inline arp_tbl_entry_t *arp_tbl_probe(const arp_tbl_t *arp_tbl, uint32_t ip_num){
+    uint32_t mask = arp_tbl->n_slots - 1;
+    uint32_t slot = arp_tbl_hash(arp_tbl, ip_num);
+    for(;;){
+        arp_tbl_entry_t *entry = &arp_tbl->slots[slot];
+        if(!entry->in_use || entry->ip_n == ip_num){
+            return entry;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/**
+ * @brief Link the entry of a slot at the tail of the LRU list
+ */
+static inline void arp_tbl_lru_append(arp_tbl_t *arp_tbl, uint32_t slot){
+    arp_tbl_entry_t *entry = &arp_tbl->slots[slot];
+    entry->lru_prev = arp_tbl->lru_tail;
+    entry->lru_next = ARP_TBL_NIL;
+    if(arp_tbl->lru_tail != ARP_TBL_NIL){
+        arp_tbl->slots[arp_tbl->lru_tail].lru_next = slot;
+    } else {
+        arp_tbl->lru_head = slot;
+    }
+    arp_tbl->lru_tail = slot;
+}
+
+/**
+ * @brief Unlink the entry of a slot from the LRU list
+ */
+static inline void arp_tbl_lru_unlink(arp_tbl_t *arp_tbl, uint32_t slot){
+    arp_tbl_entry_t *entry = &arp_tbl->slots[slot];
+    if(entry->lru_prev != ARP_TBL_NIL){
+        arp_tbl->slots[entry->lru_prev].lru_next = entry->lru_next;
+    } else {
+        arp_tbl->lru_head = entry->lru_next;
+    }
+    if(entry->lru_next != ARP_TBL_NIL){
+        arp_tbl->slots[entry->lru_next].lru_prev = entry->lru_prev;
+    } else {
+        arp_tbl->lru_tail = entry->lru_prev;
+    }
+}
+
+/**
+ * @brief Point the LRU neighbours of an entry moved to a slot at its
+ *        new slot
+ */
+static inline void arp_tbl_lru_moved(arp_tbl_t *arp_tbl, uint32_t slot){
+    arp_tbl_entry_t *entry = &arp_tbl->slots[slot];
+    if(entry->lru_prev != ARP_TBL_NIL){
+        arp_tbl->slots[entry->lru_prev].lru_next = slot;
+    } else {
+        arp_tbl->lru_head = slot;
+    }
+    if(entry->lru_next != ARP_TBL_NIL){
+        arp_tbl->slots[entry->lru_next].lru_prev = slot;
+    } else {
+        arp_tbl->lru_tail = slot;
+    }
+}
+
+/**
+ * @brief Double the slots of an ARP table and put the entries back.
+ *
+ * Entries are put back in LRU order, which the new table keeps.
+ *
+ * @return 0: Success
+ *        -1: Fail, the table is left as it was
+ */
+static int arp_tbl_grow(arp_tbl_t *arp_tbl){
+    arp_tbl_t old = *arp_tbl;
+    if(old.n_slots > UINT32_MAX / 4 || arp_tbl_alloc_slots(arp_tbl, old.n_slots * 2) < 0){
+        *arp_tbl = old;
+        return -1;
+    }
+    for(uint32_t i=old.lru_head; i != ARP_TBL_NIL; i=old.slots[i].lru_next){
+        arp_tbl_entry_t *entry = arp_tbl_probe(arp_tbl, old.slots[i].ip_n);
+        *entry = old.slots[i];
+        arp_tbl_lru_append(arp_tbl, (uint32_t)(entry - arp_tbl->slots));
+        arp_tbl->n_entries++;
+    }
+    free(old.slots);
+    return 0;
+}
+
+/**
+ * @brief Remove the entry of a slot from the ARP table
+ *
+ * The entries probed after the removed one are shifted back into the
+ * hole when their home slot allows it, so every entry stays reachable
+ * from its home slot without crossing an empty slot.
+ */
+static void arp_tbl_remove_slot(arp_tbl_t *arp_tbl, uint32_t hole){
+    uint32_t mask = arp_tbl->n_slots - 1;
+    uint32_t slot = hole;
+
+    arp_tbl_lru_unlink(arp_tbl, hole);
+    for(;;){
+        slot = (slot + 1) & mask;
+        arp_tbl_entry_t *next = &arp_tbl->slots[slot];
+        if(!next->in_use){
+            break;
+        }
+        // Move the entry unless its home slot lies after the hole, in
+        // probe order up to where the entry is
+        uint32_t home = arp_tbl_hash(arp_tbl, next->ip_n);
+        if(((slot - home) & mask) >= ((slot - hole) & mask)){
+            arp_tbl->slots[hole] = *next;
+            arp_tbl_lru_moved(arp_tbl, hole);
+            hole = slot;
+        }
+    }
+    memset(&arp_tbl->slots[hole], 0, sizeof(arp_tbl_entry_t));
+    arp_tbl->n_entries--;
+}
+
+/**
+ * @brief Set the MAC address and interface of an entry, confirmed now
+ */
+static void arp_tbl_refresh(arp_tbl_t *arp_tbl, arp_tbl_entry_t *entry,
+                            const mac_addr_t *mac, unsigned int ifindex){
+    uint32_t slot = (uint32_t)(entry - arp_tbl->slots);
+    if(slot != arp_tbl->lru_tail){
+        arp_tbl_lru_unlink(arp_tbl, slot);
+        arp_tbl_lru_append(arp_tbl, slot);
+    }
+    entry->mac = *mac;
+    entry->ifindex = ifindex;
+    entry->probed = 0;
+    entry->used = 0;
+    entry->refresh_ns = timer_now_ns();
+}
+
+/**
+ * @brief Slot of the entry to evict from a full ARP table
+ *
+ * The first of the ARP_TBL_EVICT_SCAN least recently refreshed entries
+ * not used since the last scan, or the head if all were; the used mark
+ * of the entries passed over is cleared.
+ */
+static uint32_t arp_tbl_evict_slot(arp_tbl_t *arp_tbl){
+    uint32_t slot = arp_tbl->lru_head;
+    for(int i=0; i<ARP_TBL_EVICT_SCAN && slot != ARP_TBL_NIL; i++){
+        arp_tbl_entry_t *entry = &arp_tbl->slots[slot];
+        if(!entry->used){
+            return slot;
+        }
+        entry->used = 0;
+        slot = entry->lru_next;
+    }
+    return arp_tbl->lru_head;
+}
+
 /**
  * @brief Create an empty ARP table
  *
@@ -50,15 +392,34 @@ arp_tbl_t* create_arp_tbl(){
         perror("calloc");
         return NULL;
     }
-    init_glthread(&arp_tbl->arp_tbl_list);
+    if(arp_tbl_alloc_slots(arp_tbl, ARP_TBL_MIN_SLOTS) < 0){
+        free(arp_tbl);
+        return NULL;
+    }
+    arp_tbl->max_entries = ARP_TBL_DEFAULT_MAX_ENTRIES;
+    arp_tbl->reachable_ns = ARP_TBL_DEFAULT_REACHABLE_MS * 1000000ULL;
+    arp_tbl->expire_ns = ARP_TBL_DEFAULT_EXPIRE_MS * 1000000ULL;
     return arp_tbl;
 }
 
+/**
+ * @brief Free an ARP table and its entries
+ *
+ * @param  arp_tbl: pointer to the ARP table, may be NULL
+ */
+void destroy_arp_tbl(arp_tbl_t *arp_tbl){
+    if(arp_tbl == NULL){
+        return;
+    }
+    free(arp_tbl->slots);
+    free(arp_tbl);
+}
+
 /**
  * @brief Lookup an IP address into the ARP table to get the ARP entry
  *
- * Iterate through the ARP table list and compare IP number (key)
- * return pointer to the ARP entry if a match is found. 
+ * Probes from the home slot of the IP number (key) until the entry or
+ * an empty slot is found.
  *
  * @param  apr_tbl: pointer to the ARP table
  * @param  ip_num: IP address as uint32_t
@@ -66,21 +427,906 @@ arp_tbl_t* create_arp_tbl(){
  *         NULL if not found
  */
 arp_tbl_entry_t* lookup_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num){
-    if(arp_tbl != NULL){
-        arp_tbl_entry_t *curr_arp_entry;
-        glthread_t *curr;
-        ITERATE_GLTHREAD_BEGIN(&arp_tbl->arp_tbl_list, curr){
-            curr_arp_entry = arp_glue_to_arp_entry(curr);
-            if(curr_arp_entry->ip_n == ip_num){
-                return curr_arp_entry;
-            }
-        } ITERATE_GLTHREAD_END(&arp_tbl->arp_tbl_list, curr);
+    if(arp_tbl == NULL){
+        return NULL;
+    }
+    arp_tbl_entry_t *entry = arp_tbl_probe(arp_tbl, ip_num);
+    return entry->in_use ? entry : NULL;
+}
+
+/**
+ * @brief Add an entry to the ARP table, or refresh the entry of the IP
+ *        address if there is one.
+ *
+ * The entry is confirmed now and becomes the most recently refreshed.
+ * A table holding max_entries entries evicts one of its least recently
+ * refreshed entries, not used lately if there is one, to make room for
+ * a new one.
+ *
+ * @param  arp_tbl: pointer to the ARP table
+ * @param  ip_num: IP address as uint32_t
+ * @param  mac: MAC address the IP address resolves to
+ * @param  ifindex: index of the interface the MAC is reached through
+ * @return pointer to the ARP table entry
+ *         NULL if the table cannot grow
+ */
+arp_tbl_entry_t* add_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num,
+                                   const mac_addr_t *mac, unsigned int ifindex){
+    if(arp_tbl == NULL){
+        return NULL;
+    }
+    arp_tbl_entry_t *entry = arp_tbl_probe(arp_tbl, ip_num);
+    if(entry->in_use){
+        arp_tbl->n_refreshed++;
+        arp_tbl_refresh(arp_tbl, entry, mac, ifindex);
+        return entry;
+    }
+    if(arp_tbl->n_entries >= arp_tbl->max_entries && arp_tbl->lru_head != ARP_TBL_NIL){
+        arp_tbl_remove_slot(arp_tbl, arp_tbl_evict_slot(arp_tbl));
+        arp_tbl->n_evicted++;
+        entry = arp_tbl_probe(arp_tbl, ip_num);
+    }
+    if((uint64_t)(arp_tbl->n_entries + 1) * 100 >
+       (uint64_t)arp_tbl->n_slots * ARP_TBL_MAX_LOAD_PCT){
+        if(arp_tbl_grow(arp_tbl) < 0){
+            printf("ARP table full at %u entries\n", arp_tbl->n_entries);
+            return NULL;
+        }
+        entry = arp_tbl_probe(arp_tbl, ip_num);
+    }
+    entry->ip_n = ip_num;
+    entry->in_use = 1;
+    arp_tbl->n_entries++;
+    arp_tbl_lru_append(arp_tbl, (uint32_t)(entry - arp_tbl->slots));
+    arp_tbl_refresh(arp_tbl, entry, mac, ifindex);
+    return entry;
+}
+
+/**
+ * @brief Update the MAC address and interface of an existing ARP entry,
+ *        and refresh it
+ *
+ * @param  arp_tbl: pointer to the ARP table
+ * @param  ip_num: IP address as uint32_t
+ * @param  mac: MAC address the IP address resolves to
+ * @param  ifindex: index of the interface the MAC is reached through
+ * @return pointer to the ARP table entry
+ *         NULL if the IP address has no entry
+ */
+arp_tbl_entry_t* update_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num,
+                                      const mac_addr_t *mac, unsigned int ifindex){
+    arp_tbl_entry_t *entry = lookup_arp_tbl_entry(arp_tbl, ip_num);
+    if(entry == NULL){
+        return NULL;
+    }
+    arp_tbl->n_refreshed++;
+    arp_tbl_refresh(arp_tbl, entry, mac, ifindex);
+    return entry;
+}
+
+/**
+ * @brief Delete the entry of an IP address from the ARP table
+ *
+ * @param  arp_tbl: pointer to the ARP table
+ * @param  ip_num: IP address as uint32_t
+ * @return 0: Success
+ *        -1: Fail, the IP address has no entry
+ */
+int delete_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num){
+    arp_tbl_entry_t *entry = lookup_arp_tbl_entry(arp_tbl, ip_num);
+    if(entry == NULL){
+        return -1;
+    }
+    arp_tbl_remove_slot(arp_tbl, (uint32_t)(entry - arp_tbl->slots));
+    return 0;
+}
+
+/**
+ * @brief Remove the expired entries of an ARP table
+ *
+ * Entries expire in the order they were refreshed, so only the head of
+ * the LRU list is looked at: the cost is the number of entries removed.
+ *
+ * @param  arp_tbl: pointer to the ARP table
+ * @param  now_ns: CLOCK_MONOTONIC time to age the table to
+ * @return time the next entry expires, 0 if the table is empty
+ */
+uint64_t arp_tbl_age(arp_tbl_t *arp_tbl, uint64_t now_ns){
+    while(arp_tbl->lru_head != ARP_TBL_NIL){
+        arp_tbl_entry_t *entry = &arp_tbl->slots[arp_tbl->lru_head];
+        if(arp_tbl_entry_state(arp_tbl, entry, now_ns) != ARP_ENTRY_EXPIRED){
+            return entry->refresh_ns + arp_tbl->expire_ns;
+        }
+        arp_tbl_remove_slot(arp_tbl, arp_tbl->lru_head);
+        arp_tbl->n_expired++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Set the most entries an ARP table holds, evicting entries
+ *        past it as add_arp_tbl_entry does
+ *
+ * @param  arp_tbl: pointer to the ARP table
+ * @param  max_entries: most entries, at least 1
+ */
+void arp_tbl_set_max_entries(arp_tbl_t *arp_tbl, uint32_t max_entries){
+    arp_tbl->max_entries = max_entries ? max_entries : 1;
+    while(arp_tbl->n_entries > arp_tbl->max_entries){
+        arp_tbl_remove_slot(arp_tbl, arp_tbl_evict_slot(arp_tbl));
+        arp_tbl->n_evicted++;
+    }
+}
+
+/**
+ * @brief Print the entries of an ARP table
+ *
+ * @param  node: node owning the table, gives the interface names
+ * @param  arp_tbl: pointer to the ARP table
+ */
+void dump_arp_tbl(node_t *node, arp_tbl_t *arp_tbl){
+    static const char *state_str[] = { "reachable", "stale", "expired" };
+    arp_tbl_entry_t *entry;
+    char ip[16];
+    uint64_t now_ns = timer_now_ns();
+
+    printf("ARP table: %u entries (max %u), %u slots; reachable %lu ms, expire %lu ms\n",
+           arp_tbl->n_entries, arp_tbl->max_entries, arp_tbl->n_slots,
+           (unsigned long)(arp_tbl->reachable_ns / 1000000),
+           (unsigned long)(arp_tbl->expire_ns / 1000000));
+    printf("Refreshed %lu, evicted %lu, expired %lu\n", (unsigned long)arp_tbl->n_refreshed,
+           (unsigned long)arp_tbl->n_evicted, (unsigned long)arp_tbl->n_expired);
+    printf("%-16s %-18s %-10s %-10s %s\n", "IP", "MAC", "Interface", "State", "Age (ms)");
+    ITERATE_ARP_TBL_BEGIN(arp_tbl, entry){
+        interface_t *intf = (entry->ifindex < MAX_INTERFACES_PER_NODE) ?
+            node->interfaces[entry->ifindex] : NULL;
+        inet_ntop(AF_INET, &entry->ip_n, ip, sizeof(ip));
+        printf("%-16s " MAC_ADDR_FMT "  %-10s %-10s %lu\n", ip, MAC_ADDR_ARGS(entry->mac.mac),
+               intf ? intf->interface_name : "-",
+               state_str[arp_tbl_entry_state(arp_tbl, entry, now_ns)],
+               (unsigned long)((now_ns - entry->refresh_ns) / 1000000));
+    } ITERATE_ARP_TBL_END(arp_tbl, entry);
+}
+
+
+// ARP resolution
+
+/**
+ * @brief IP address of an interface in number form, 0 if it has none
+ */
+static uint32_t arp_if_ip(interface_t *intf){
+    uint32_t ip_num = 0;
+    if(!IF_IP_CONFIG(intf) || inet_pton(AF_INET, IF_IP(intf).ip_addr, &ip_num) != 1){
+        return 0;
+    }
+    return ip_num;
+}
+
+/**
+ * @brief Interface of a node in the subnet of an IP address
+ *
+ * @return interface, NULL if none is in the subnet
+ */
+static interface_t *arp_out_if(node_t *node, uint32_t ip_num){
+    for(int i=0; i<MAX_INTERFACES_PER_NODE && node->interfaces[i]; i++){
+        interface_t *intf = node->interfaces[i];
+        uint32_t if_ip = arp_if_ip(intf);
+        if(if_ip == 0){
+            continue;
+        }
+        uint32_t mask = IF_IP(intf).mask ? htonl(~0u << (32 - IF_IP(intf).mask)) : 0;
+        if((if_ip & mask) == (ip_num & mask)){
+            return intf;
+        }
     }
     return NULL;
 }
 
+/**
+ * @brief Fill an ARP packet sent from an interface
+ */
+static void arp_pkt_fill(apr_pkt_t *arp_pkt, uint16_t op, interface_t *intf,
+                         const mac_addr_t *target_mac, uint32_t target_ip){
+    memset(arp_pkt, 0, sizeof(*arp_pkt));
+    arp_pkt->arp_hardware_type = htons(ARP_HW_TYPE_ETHERNET);
+    arp_pkt->arp_protocol_type = htons(ARP_PROTO_TYPE_IPV4);
+    arp_pkt->arp_hw_addr_len = 6;
+    arp_pkt->arp_proto_addr_len = 4;
+    arp_pkt->arp_operation = htons(op);
+    mac_addr_unpack(IF_MAC(intf).mac, arp_pkt->arp_sender_hw_addr);
+    arp_pkt->arp_sender_proto_addr = arp_if_ip(intf);
+    if(target_mac != NULL){
+        mac_addr_unpack(target_mac->mac, arp_pkt->arp_target_hw_addr);
+    }
+    arp_pkt->arp_target_proto_addr = target_ip;
+}
+
+/**
+ * @brief Broadcast an ARP request for an IP address
+ *
+ * Sent to the broadcast MAC address out of the interface in the subnet
+ * of the IP address only, the request carries its addresses: other
+ * interfaces are in other broadcast domains. A switch across the link
+ * floods it to the rest of the segment, only the node owning the IP
+ * address answers.
+ *
+ * @param  out_if: interface in the subnet of the IP address, gives the
+ *                 sender addresses of the request
+ */
+static int arp_send_request(interface_t *out_if, uint32_t ip_num){
+    apr_pkt_t arp_pkt;
+    pkt_l2_t l2 = { .dst_mac = MAC_ADDR_BROADCAST, .ethertype = ARP_ETHERTYPE };
+    arp_pkt_fill(&arp_pkt, ARP_OP_REQUEST, out_if, NULL, ip_num);
+    return send_l2_pkt_out(&l2, (char *)&arp_pkt, sizeof(arp_pkt), out_if);
+}
+
+static arp_pending_t *arp_pending_find(arp_engine_t *arp, uint32_t ip_num){
+    glthread_t *curr;
+    ITERATE_GLTHREAD_BEGIN(&arp->pending_list, curr){
+        arp_pending_t *pending = pending_glue_to_arp_pending(curr);
+        if(pending->ip_n == ip_num){
+            return pending;
+        }
+    } ITERATE_GLTHREAD_END(&arp->pending_list, curr);
+    return NULL;
+}
+
+static arp_pending_t *arp_pending_find_id(arp_engine_t *arp, uint64_t id){
+    glthread_t *curr;
+    ITERATE_GLTHREAD_BEGIN(&arp->pending_list, curr){
+        arp_pending_t *pending = pending_glue_to_arp_pending(curr);
+        if(pending->id == id){
+            return pending;
+        }
+    } ITERATE_GLTHREAD_END(&arp->pending_list, curr);
+    return NULL;
+}
+
+static void arp_retry_timer(void *arg, void *data);
+
+/**
+ * @brief Start the resolution of an IP address, its first request is
+ *        to be sent by the caller once the lock is released
+ *
+ * Queues the retry timer of the resolution on the receiver thread of
+ * the node, which sends the request again or ends the resolution
+ * whether or not anyone waits on it.
+ */
+static arp_pending_t *arp_pending_start(arp_engine_t *arp, interface_t *out_if,
+                                        uint32_t ip_num){
+    arp_pending_t *pending = calloc(1, sizeof(arp_pending_t));
+    if(pending == NULL){
+        perror("calloc");
+        return NULL;
+    }
+    pending->ip_n = ip_num;
+    pending->out_if = out_if;
+    pending->start_ns = timer_now_ns();
+    pending->req_ns = pending->start_ns;
+    pending->n_requests = 1;
+    pending->id = ++arp->next_pending_id;
+    init_glthread(&pending->pending_glue);
+    glthread_add_next(&arp->pending_list, &pending->pending_glue);
+    arp->stats.requests_sent++;
+    node_t *node = out_if->attached_node;
+    pending->retry_armed =
+        (comm_node_timer_add(node, pending->req_ns + ARP_RETRY_MS * 1000000ULL,
+                             arp_retry_timer, node, (void *)(uintptr_t)pending->id) == 0);
+    return pending;
+}
+
+/**
+ * @brief End a resolution, resolved or failed.
+ *
+ * The queued packets are moved to queue for the caller to send or
+ * free once the lock is released. The resolution is freed here unless
+ * threads wait on it, the last of them frees it.
+ *
+ * @return number of packets moved to queue
+ */
+static unsigned int arp_pending_end(arp_engine_t *arp, arp_pending_t *pending, int result,
+                                    pkt_buf_t *queue[ARP_PENDING_QUEUE_LEN]){
+    unsigned int n_queued = pending->n_queued;
+    memcpy(queue, pending->queue, n_queued * sizeof(pkt_buf_t *));
+    pending->n_queued = 0;
+    pending->result = result;
+    remove_glthread(&pending->pending_glue);
+    if(result > 0){
+        arp->stats.resolved++;
+    } else {
+        arp->stats.failed++;
+        arp->stats.pkts_dropped += n_queued;
+    }
+    pthread_cond_broadcast(&arp->done);
+    if(pending->n_waiters == 0){
+        free(pending);
+    }
+    return n_queued;
+}
+
+/**
+ * @brief Send or free the packets of an ended resolution
+ *
+ * @param  out_if: interface to send them out of, NULL to free them
+ * @param  mac: MAC address the packets are sent to
+ */
+static void arp_flush_queue(interface_t *out_if, const mac_addr_t *mac,
+                            pkt_buf_t **queue, unsigned int n_queued){
+    for(unsigned int i=0; i<n_queued; i++){
+        if(out_if != NULL){
+            queue[i]->l2.dst_mac = mac->mac;
+            send_pkt_buf_out(queue[i], out_if);
+        }
+        pkt_buf_free(queue[i]);
+    }
+}
+
+/**
+ * @brief Send the request of a resolution again, or end it once
+ *        ARP_MAX_REQUESTS requests went unanswered
+ *
+ * Timer callback, runs on the receiver thread of the node. A
+ * resolution started by arp_send_pkt ends here even if no other
+ * packet is sent to its IP address, and its queued packets are freed.
+ *
+ * @param  arg: node
+ * @param  data: id of the resolution
+ */
+static void arp_retry_timer(void *arg, void *data){
+    node_t *node = (node_t *)arg;
+    arp_engine_t *arp = node->arp;
+    pkt_buf_t *queue[ARP_PENDING_QUEUE_LEN];
+    unsigned int n_dropped = 0;
+    interface_t *out_if = NULL;
+    uint32_t ip_num = 0;
+
+    pthread_mutex_lock(&arp->lock);
+    arp_pending_t *pending = arp_pending_find_id(arp, (uintptr_t)data);
+    if(pending == NULL){
+        // Resolved or failed already
+        pthread_mutex_unlock(&arp->lock);
+        return;
+    }
+    uint64_t now_ns = timer_now_ns();
+    uint64_t retry_ns = pending->req_ns + ARP_RETRY_MS * 1000000ULL;
+    if(now_ns < retry_ns){
+        // A thread waiting in arp_resolve sent the request again
+    } else if(pending->n_requests >= ARP_MAX_REQUESTS){
+        n_dropped = arp_pending_end(arp, pending, -1, queue);
+        pending = NULL;
+    } else {
+        pending->n_requests++;
+        pending->req_ns = now_ns;
+        arp->stats.requests_sent++;
+        out_if = pending->out_if;
+        ip_num = pending->ip_n;
+        retry_ns = now_ns + ARP_RETRY_MS * 1000000ULL;
+    }
+    if(pending != NULL){
+        pending->retry_armed =
+            (comm_node_timer_add(node, retry_ns, arp_retry_timer, node, data) == 0);
+    }
+    pthread_mutex_unlock(&arp->lock);
+
+    arp_flush_queue(NULL, NULL, queue, n_dropped);
+    if(out_if != NULL){
+        arp_send_request(out_if, ip_num);
+    }
+}
+
+/**
+ * @brief Create the ARP state of a node
+ *
+ * @return pointer to heap allocated ARP state, NULL on failure
+ */
+arp_engine_t *arp_engine_create(void){
+    pthread_condattr_t attr;
+    pthread_rwlockattr_t rw_attr;
+    arp_engine_t *arp = calloc(1, sizeof(arp_engine_t));
+    if(arp == NULL){
+        perror("calloc");
+        return NULL;
+    }
+    arp->arp_tbl = create_arp_tbl();
+    if(arp->arp_tbl == NULL){
+        free(arp);
+        return NULL;
+    }
+    pthread_mutex_init(&arp->lock, NULL);
+    // Senders keep the table read locked back to back, the receiver
+    // thread learning a reply must not wait for them all to stop
+    pthread_rwlockattr_init(&rw_attr);
+    pthread_rwlockattr_setkind_np(&rw_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&arp->tbl_lock, &rw_attr);
+    pthread_rwlockattr_destroy(&rw_attr);
+    // Waits are timed against the clock of timer_now_ns
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&arp->done, &attr);
+    pthread_condattr_destroy(&attr);
+    init_glthread(&arp->pending_list);
+    return arp;
+}
+
+/**
+ * @brief Free the ARP state of a node, with the packets still waiting
+ *        for a resolution
+ *
+ * The receiver threads must be stopped and no thread may be resolving.
+ *
+ * @param  arp: pointer to the ARP state, may be NULL
+ */
+void arp_engine_destroy(arp_engine_t *arp){
+    glthread_t *curr;
+    if(arp == NULL){
+        return;
+    }
+    ITERATE_GLTHREAD_BEGIN(&arp->pending_list, curr){
+        arp_pending_t *pending = pending_glue_to_arp_pending(curr);
+        remove_glthread(&pending->pending_glue);
+        arp_flush_queue(NULL, NULL, pending->queue, pending->n_queued);
+        free(pending);
+    } ITERATE_GLTHREAD_END(&arp->pending_list, curr);
+    destroy_arp_tbl(arp->arp_tbl);
+    pthread_cond_destroy(&arp->done);
+    pthread_rwlock_destroy(&arp->tbl_lock);
+    pthread_mutex_destroy(&arp->lock);
+    free(arp);
+}
+
+/**
+ * @brief Resolve an IP address to a MAC address, waiting for the reply.
+ *
+ * An IP address in the ARP table is resolved right away. Otherwise a
+ * request is broadcast, or the resolution in progress for the IP
+ * address is joined, and the request is sent again every ARP_RETRY_MS
+ * up to ARP_MAX_REQUESTS times. The reply is handled by the receiver
+ * thread of the node, which must be running; must not be called from
+ * a receiver thread.
+ *
+ * @param  node: node resolving
+ * @param  ip_num: IP address as uint32_t
+ * @param  res: filled with the MAC address and how it was resolved
+ * @return 0: Success
+ *        -1: Fail, no interface in the subnet or no reply
+ */
+int arp_resolve(node_t *node, uint32_t ip_num, arp_resolve_result_t *res){
+    arp_engine_t *arp = node->arp;
+    pkt_buf_t *queue[ARP_PENDING_QUEUE_LEN];
+    unsigned int n_dropped = 0;
+    int send_request = 0;
+
+    memset(res, 0, sizeof(*res));
+    if(arp == NULL){
+        return -1;
+    }
+    interface_t *out_if = arp_out_if(node, ip_num);
+    if(out_if == NULL){
+        printf("Node %s has no interface in the subnet of the IP address\n", node->node_name);
+        return -1;
+    }
+    uint64_t start_ns = timer_now_ns();
+
+    pthread_mutex_lock(&arp->lock);
+    arp_tbl_entry_t *entry = lookup_arp_tbl_entry(arp->arp_tbl, ip_num);
+    if(entry != NULL &&
+       arp_tbl_entry_state(arp->arp_tbl, entry, start_ns) != ARP_ENTRY_EXPIRED){
+        arp_tbl_entry_touch(entry);
+        res->mac = entry->mac;
+        res->ifindex = entry->ifindex;
+        res->cached = 1;
+        pthread_mutex_unlock(&arp->lock);
+        res->latency_ns = timer_now_ns() - start_ns;
+        return 0;
+    }
+    arp_pending_t *pending = arp_pending_find(arp, ip_num);
+    if(pending != NULL){
+        arp->stats.requests_coalesced++;
+        res->coalesced = 1;
+    } else {
+        pending = arp_pending_start(arp, out_if, ip_num);
+        if(pending == NULL){
+            pthread_mutex_unlock(&arp->lock);
+            return -1;
+        }
+        send_request = 1;
+    }
+    pending->n_waiters++;
 
-arp_tbl_entry_t* add_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num, mac_addr_t mac, char *if_name){
-    if(arp_tbl == NULL) return NULL;
-    
+    while(pending->result == 0){
+        if(send_request){
+            pthread_mutex_unlock(&arp->lock);
+            arp_send_request(out_if, ip_num);
+            pthread_mutex_lock(&arp->lock);
+            send_request = 0;
+            continue;
+        }
+        uint64_t retry_ns = pending->req_ns + ARP_RETRY_MS * 1000000ULL;
+        struct timespec deadline = {
+            .tv_sec = retry_ns / 1000000000ULL,
+            .tv_nsec = retry_ns % 1000000000ULL,
+        };
+        pthread_cond_timedwait(&arp->done, &arp->lock, &deadline);
+        uint64_t now_ns = timer_now_ns();
+        if(pending->result != 0 || now_ns < pending->req_ns + ARP_RETRY_MS * 1000000ULL){
+            continue;
+        }
+        if(pending->n_requests >= ARP_MAX_REQUESTS){
+            n_dropped = arp_pending_end(arp, pending, -1, queue);
+            break;
+        }
+        // Only the waiter seeing the retry time first sends again
+        pending->n_requests++;
+        pending->req_ns = now_ns;
+        arp->stats.requests_sent++;
+        send_request = 1;
+    }
+
+    int ret = -1;
+    if(pending->result > 0 &&
+       (entry = lookup_arp_tbl_entry(arp->arp_tbl, ip_num)) != NULL){
+        res->mac = entry->mac;
+        res->ifindex = entry->ifindex;
+        ret = 0;
+    }
+    res->n_requests = pending->n_requests;
+    res->latency_ns = timer_now_ns() - start_ns;
+    if(--pending->n_waiters == 0){
+        free(pending);
+    }
+    pthread_mutex_unlock(&arp->lock);
+    arp_flush_queue(NULL, NULL, queue, n_dropped);
+    return ret;
+}
+
+/**
+ * @brief Send a packet to an IP address in a subnet of the node.
+ *
+ * The packet goes out of the interface the ARP table gives for the IP
+ * address; a stale entry is used and a request is broadcast to confirm
+ * it. If the IP address is not resolved yet, the packet is copied
+ * into a packet buffer and held until the reply comes, up to
+ * ARP_PENDING_QUEUE_LEN packets per IP address; a request is broadcast
+ * unless one is in progress already. The retry timer of the resolution
+ * sends it again and drops the held packets if no reply comes. Does
+ * not block, can be called from a receiver thread. Packets to a
+ * resolved IP address only read lock the ARP table.
+ *
+ * @param  node: sending node
+ * @param  ip_num: destination IP address as uint32_t
+ * @param  pkt: data link packet to send
+ * @param  pkt_size: size in bytes of the packet
+ * @return 0: Success, the packet was sent or queued
+ *        -1: Fail, the packet was dropped
+ */
+int arp_send_pkt(node_t *node, uint32_t ip_num, char *pkt, uint32_t pkt_size){
+    arp_engine_t *arp = node->arp;
+    pkt_buf_t *queue[ARP_PENDING_QUEUE_LEN];
+    unsigned int n_dropped = 0;
+    interface_t *out_if = NULL;
+    int send_request = 0;
+    int ret = 0;
+
+    if(arp == NULL){
+        return -1;
+    }
+    uint64_t now_ns = timer_now_ns();
+    for(;;){
+        pthread_rwlock_rdlock(&arp->tbl_lock);
+        arp_tbl_entry_t *entry = lookup_arp_tbl_entry(arp->arp_tbl, ip_num);
+        arp_entry_state_t state = entry ? arp_tbl_entry_state(arp->arp_tbl, entry, now_ns) :
+                                          ARP_ENTRY_EXPIRED;
+        if(state != ARP_ENTRY_EXPIRED){
+            pkt_l2_t l2 = { .dst_mac = entry->mac.mac };
+            out_if = node->interfaces[entry->ifindex];
+            arp_tbl_entry_touch(entry);
+            // One request per stale period, the reply refreshes the entry
+            if(state == ARP_ENTRY_STALE && !__atomic_load_n(&entry->probed, __ATOMIC_RELAXED) &&
+               __atomic_exchange_n(&entry->probed, 1, __ATOMIC_RELAXED) == 0){
+                send_request = 1;
+            }
+            pthread_rwlock_unlock(&arp->tbl_lock);
+            if(send_request){
+                pthread_mutex_lock(&arp->lock);
+                arp->stats.requests_sent++;
+                pthread_mutex_unlock(&arp->lock);
+                arp_send_request(out_if, ip_num);
+            }
+            // Sent to the resolved MAC address, which is not the peer
+            // interface when the link goes to a switch
+            return send_l2_pkt_out(&l2, pkt, pkt_size, out_if);
+        }
+        pthread_rwlock_unlock(&arp->tbl_lock);
+
+        pthread_mutex_lock(&arp->lock);
+        entry = lookup_arp_tbl_entry(arp->arp_tbl, ip_num);
+        if(entry == NULL ||
+           arp_tbl_entry_state(arp->arp_tbl, entry, now_ns) == ARP_ENTRY_EXPIRED){
+            break;
+        }
+        // Learned in between, send it as above
+        pthread_mutex_unlock(&arp->lock);
+    }
+
+    arp_pending_t *pending = arp_pending_find(arp, ip_num);
+    if(pending != NULL && pending->n_waiters == 0 && !pending->retry_armed &&
+       now_ns >= pending->req_ns + ARP_RETRY_MS * 1000000ULL){
+        // No timer and nobody waits on this resolution to send its
+        // requests again: the receiver threads were not running
+        if(pending->n_requests >= ARP_MAX_REQUESTS){
+            n_dropped = arp_pending_end(arp, pending, -1, queue);
+            pending = NULL;
+        } else {
+            pending->n_requests++;
+            pending->req_ns = now_ns;
+            arp->stats.requests_sent++;
+            send_request = 1;
+        }
+    }
+    if(pending != NULL){
+        arp->stats.requests_coalesced++;
+    } else {
+        out_if = arp_out_if(node, ip_num);
+        if(out_if == NULL || (pending = arp_pending_start(arp, out_if, ip_num)) == NULL){
+            arp->stats.pkts_dropped++;
+            pthread_mutex_unlock(&arp->lock);
+            arp_flush_queue(NULL, NULL, queue, n_dropped);
+            return -1;
+        }
+        send_request = 1;
+    }
+    out_if = pending->out_if;
+
+    pkt_buf_t *pb = NULL;
+    if(pending->n_queued < ARP_PENDING_QUEUE_LEN && pkt_size <= PKT_BUF_DATA_SIZE &&
+       (pb = pkt_buf_alloc()) != NULL){
+        memcpy(pkt_buf_put(pb, pkt_size), pkt, pkt_size);
+        pending->queue[pending->n_queued++] = pb;
+        arp->stats.pkts_queued++;
+    } else {
+        arp->stats.pkts_dropped++;
+        ret = -1;
+    }
+    pthread_mutex_unlock(&arp->lock);
+
+    arp_flush_queue(NULL, NULL, queue, n_dropped);
+    if(send_request){
+        arp_send_request(out_if, ip_num);
+    }
+    return ret;
+}
+
+/**
+ * @brief Age the ARP table of a node and queue the timer again for the
+ *        next entry to expire.
+ *
+ * Timer callback, runs on the receiver thread of the node.
+ *
+ * @param  arg: node
+ */
+static void arp_age_timer(void *arg, void *data __attribute__((unused))){
+    node_t *node = (node_t *)arg;
+    arp_engine_t *arp = node->arp;
+    timer_queue_t *tq = comm_rx_timers();
+
+    pthread_mutex_lock(&arp->lock);
+    pthread_rwlock_wrlock(&arp->tbl_lock);
+    uint64_t next_ns = arp_tbl_age(arp->arp_tbl, timer_now_ns());
+    pthread_rwlock_unlock(&arp->tbl_lock);
+    arp->age_armed = (next_ns != 0 && tq != NULL &&
+                      timer_queue_add(tq, next_ns, arp_age_timer, node, NULL) == 0);
+    pthread_mutex_unlock(&arp->lock);
+}
+
+/**
+ * @brief Forget the aging and retry timers of a node when the timer
+ *        queue of its receiver thread is emptied. A later ARP packet
+ *        queues the aging timer again; resolutions left without timer
+ *        are retried by the next packet sent to their IP address.
+ *
+ * Timer cancel callback, ignores the events of other callbacks.
+ *
+ * @param  ev: timer event being cancelled
+ */
+void arp_timer_cancel(timer_event_t *ev){
+    if(ev->cb != arp_age_timer && ev->cb != arp_retry_timer){
+        return;
+    }
+    arp_engine_t *arp = ((node_t *)ev->arg)->arp;
+    pthread_mutex_lock(&arp->lock);
+    if(ev->cb == arp_age_timer){
+        arp->age_armed = 0;
+    } else {
+        arp_pending_t *pending = arp_pending_find_id(arp, (uintptr_t)ev->data);
+        if(pending != NULL){
+            pending->retry_armed = 0;
+        }
+    }
+    pthread_mutex_unlock(&arp->lock);
+}
+
+/**
+ * @brief Learn the MAC address of an IP address from an ARP packet
+ *        received on an interface
+ *
+ * Installs or refreshes the ARP table entry and ends the resolution of
+ * the IP address if one is in progress, sending its queued packets.
+ * Queues the aging timer of the table on the receiver thread if it is
+ * not queued yet.
+ */
+static void arp_learn(arp_engine_t *arp, interface_t *rx_if, uint32_t ip_num,
+                      const mac_addr_t *mac){
+    pkt_buf_t *queue[ARP_PENDING_QUEUE_LEN];
+    unsigned int n_queued = 0;
+    timer_queue_t *tq = comm_rx_timers();
+
+    pthread_mutex_lock(&arp->lock);
+    pthread_rwlock_wrlock(&arp->tbl_lock);
+    add_arp_tbl_entry(arp->arp_tbl, ip_num, mac, rx_if->ifindex);
+    if(!arp->age_armed && tq != NULL){
+        uint64_t next_ns = arp_tbl_age(arp->arp_tbl, timer_now_ns());
+        arp->age_armed = (next_ns != 0 &&
+                          timer_queue_add(tq, next_ns, arp_age_timer,
+                                          rx_if->attached_node, NULL) == 0);
+    }
+    pthread_rwlock_unlock(&arp->tbl_lock);
+    arp_pending_t *pending = arp_pending_find(arp, ip_num);
+    if(pending != NULL){
+        n_queued = arp_pending_end(arp, pending, 1, queue);
+    }
+    pthread_mutex_unlock(&arp->lock);
+    arp_flush_queue(rx_if, mac, queue, n_queued);
+}
+
+/**
+ * @brief Handle an ARP packet received on an interface
+ *
+ * Requests for the IP address of the interface are answered out of
+ * it. Requests and replies addressed to the interface install the
+ * sender's MAC address in the ARP table. Packets for other IP
+ * addresses are ignored.
+ *
+ * @param  node: receiving node
+ * @param  rx_if: receive interface
+ * @param  pkt: ARP packet
+ * @param  pkt_size: size in bytes of the packet
+ * @return 0: Success
+ *        -1: Fail, the packet is malformed or the interface has no IP address
+ */
+int arp_pkt_recv(node_t *node, interface_t *rx_if, char *pkt, uint32_t pkt_size){
+    arp_engine_t *arp = node->arp;
+    apr_pkt_t arp_pkt;
+
+    if(pkt_size < sizeof(arp_pkt)){
+        comm_stats_rx_drop(&rx_if->stats, COMM_DROP_MALFORMED);
+        return -1;
+    }
+    memcpy(&arp_pkt, pkt, sizeof(arp_pkt));
+    uint16_t op = ntohs(arp_pkt.arp_operation);
+    if(ntohs(arp_pkt.arp_hardware_type) != ARP_HW_TYPE_ETHERNET ||
+       ntohs(arp_pkt.arp_protocol_type) != ARP_PROTO_TYPE_IPV4 ||
+       arp_pkt.arp_hw_addr_len != 6 || arp_pkt.arp_proto_addr_len != 4 ||
+       (op != ARP_OP_REQUEST && op != ARP_OP_REPLY)){
+        comm_stats_rx_drop(&rx_if->stats, COMM_DROP_MALFORMED);
+        return -1;
+    }
+    uint32_t if_ip = arp_if_ip(rx_if);
+    if(if_ip == 0){
+        comm_stats_rx_drop(&rx_if->stats, COMM_DROP_IF_UNCONFIGURED);
+        return -1;
+    }
+    if(arp == NULL || arp_pkt.arp_target_proto_addr != if_ip){
+        // Not for this interface
+        return 0;
+    }
+
+    mac_addr_t sender_mac = { .mac = mac_addr_pack(arp_pkt.arp_sender_hw_addr) };
+    arp_learn(arp, rx_if, arp_pkt.arp_sender_proto_addr, &sender_mac);
+    if(op == ARP_OP_REPLY){
+        pthread_mutex_lock(&arp->lock);
+        arp->stats.replies_received++;
+        pthread_mutex_unlock(&arp->lock);
+        return 0;
+    }
+
+    apr_pkt_t reply;
+    arp_pkt_fill(&reply, ARP_OP_REPLY, rx_if, &sender_mac, arp_pkt.arp_sender_proto_addr);
+    pkt_l2_t l2 = { .dst_mac = sender_mac.mac, .ethertype = ARP_ETHERTYPE };
+    int ret = send_l2_pkt_out(&l2, (char *)&reply, sizeof(reply), rx_if);
+    pthread_mutex_lock(&arp->lock);
+    arp->stats.requests_received++;
+    if(ret == 0){
+        arp->stats.replies_sent++;
+    }
+    pthread_mutex_unlock(&arp->lock);
+    return ret;
+}
+
+/**
+ * @brief Set the most entries the ARP table of a node holds
+ *
+ * The entries past the new maximum are evicted right away, least
+ * recently refreshed first unless used lately.
+ *
+ * @param  node: node
+ * @param  max_entries: most entries, at least 1
+ * @return 0: Success
+ *        -1: Fail, invalid maximum
+ */
+int arp_set_max_entries(node_t *node, uint32_t max_entries){
+    arp_engine_t *arp = node->arp;
+    if(max_entries == 0){
+        printf("The ARP table holds at least one entry\n");
+        return -1;
+    }
+    pthread_mutex_lock(&arp->lock);
+    pthread_rwlock_wrlock(&arp->tbl_lock);
+    arp_tbl_set_max_entries(arp->arp_tbl, max_entries);
+    pthread_rwlock_unlock(&arp->tbl_lock);
+    pthread_mutex_unlock(&arp->lock);
+    return 0;
+}
+
+/**
+ * @brief Set how long the ARP entries of a node stay reachable, and
+ *        after how long they expire, from their last refresh
+ *
+ * Entries are aged with the new timeouts from the next aging run, the
+ * timer already queued is not moved.
+ *
+ * @param  node: node
+ * @param  reachable_ms: entries are used as is for this long
+ * @param  expire_ms: entries are removed this long after their refresh,
+ *                    not less than reachable_ms
+ * @return 0: Success
+ *        -1: Fail, invalid timeouts
+ */
+int arp_set_timeouts(node_t *node, uint32_t reachable_ms, uint32_t expire_ms){
+    arp_engine_t *arp = node->arp;
+    if(reachable_ms == 0 || expire_ms < reachable_ms){
+        printf("ARP entries must expire after they become stale\n");
+        return -1;
+    }
+    pthread_mutex_lock(&arp->lock);
+    pthread_rwlock_wrlock(&arp->tbl_lock);
+    arp->arp_tbl->reachable_ns = reachable_ms * 1000000ULL;
+    arp->arp_tbl->expire_ns = expire_ms * 1000000ULL;
+    pthread_rwlock_unlock(&arp->tbl_lock);
+    pthread_mutex_unlock(&arp->lock);
+    return 0;
+}
+
+/**
+ * @brief Print the ARP table, resolutions in progress and ARP counters
+ *        of every node
+ *
+ * @param  topo: pointer to the graph topology
+ */
+void dump_arp(graph_t *topo){
+    glthread_t *curr;
+    ITERATE_GLTHREAD_BEGIN(&topo->node_list, curr){
+        node_t *node = graph_glue_to_node(curr);
+        arp_engine_t *arp = node->arp;
+        if(arp == NULL || !node->comm_local){
+            continue;
+        }
+        pthread_mutex_lock(&arp->lock);
+        unsigned int n_pending = 0;
+        glthread_t *p;
+        ITERATE_GLTHREAD_BEGIN(&arp->pending_list, p){
+            n_pending++;
+        } ITERATE_GLTHREAD_END(&arp->pending_list, p);
+        arp_stats_t st = arp->stats;
+        printf("Node %s\n", node->node_name);
+        dump_arp_tbl(node, arp->arp_tbl);
+        pthread_mutex_unlock(&arp->lock);
+        printf("Resolutions in progress: %u\n", n_pending);
+        printf("Requests sent %lu, coalesced %lu, received %lu; replies sent %lu, received %lu\n",
+               (unsigned long)st.requests_sent, (unsigned long)st.requests_coalesced,
+               (unsigned long)st.requests_received, (unsigned long)st.replies_sent,
+               (unsigned long)st.replies_received);
+        printf("Resolved %lu, failed %lu; packets queued %lu, dropped %lu\n\n",
+               (unsigned long)st.resolved, (unsigned long)st.failed,
+               (unsigned long)st.pkts_queued, (unsigned long)st.pkts_dropped);
+    } ITERATE_GLTHREAD_END(&topo->node_list, curr);
 }
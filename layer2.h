@@ -4,31 +4,195 @@
 #include "gluethread/glthread.h"
 #include "net.h"
 #include "graph.h"
+#include "pkt_buf.h"
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
+#include <pthread.h>
+#include "timer.h"
 
 #define ETH_FRAME_MTU 1500
+#define ETH_TYPE_MIN 0x0600       ///< smaller values of the type field are an 802.3 payload length
+#define ETH_TYPE_VLAN 0x8100      ///< TPID of an 802.1Q tag
+#define ETH_TYPE_DATA_LINK 0x88B5 ///< IEEE local experimental ethertype, data link packets of the nodes
 #define ARP_ETHERTYPE 0x806
+#define ARP_HW_TYPE_ETHERNET 1
+#define ARP_PROTO_TYPE_IPV4 0x0800
+#define ARP_OP_REQUEST 1
+#define ARP_OP_REPLY 2
+#define ARP_PENDING_QUEUE_LEN 16 ///< packets held per IP address being resolved
+#define ARP_RETRY_MS 250         ///< request sent again after this long without reply
+#define ARP_MAX_REQUESTS 4       ///< requests sent before a resolution fails
+
+#define ARP_TBL_MIN_SLOTS 16   ///< slots of a new ARP table, power of 2
+#define ARP_TBL_MAX_LOAD_PCT 70 ///< table doubles past this percentage of used slots
+#define ARP_TBL_DEFAULT_MAX_ENTRIES 4096
+#define ARP_TBL_DEFAULT_REACHABLE_MS 30000 ///< entry used as is for this long
+#define ARP_TBL_DEFAULT_EXPIRE_MS 60000    ///< entry removed this long after its last refresh
+#define ARP_TBL_NIL UINT32_MAX ///< no slot, ends the LRU list
+#define ARP_TBL_EVICT_SCAN 8   ///< entries from the LRU head looked at for one not used lately
 
 /**
- * Linked list of ARP entries denoting an ARP table
- *
+ * State of an ARP entry, from the time since it was last refreshed by
+ * an ARP packet.
  */
-typedef struct arp_tbl_ {
-    glthread_t arp_tbl_list; ///< linked list of arp entries
-} arp_tbl_t;
+typedef enum {
+    ARP_ENTRY_REACHABLE, ///< used as is
+    ARP_ENTRY_STALE,     ///< still used, a request is sent to confirm it
+    ARP_ENTRY_EXPIRED    ///< no longer used, removed by the next aging run
+} arp_entry_state_t;
 
+/**
+ * ARP entry, stored in place in a slot of the ARP table. 32 bytes, so
+ * two entries share a cache line.
+ */
 typedef struct arp_tbl_entry_ {
     uint32_t ip_n; ///< IP address numerical (key)
+    uint8_t ifindex; ///< index of the interface the MAC is reached through
+    uint8_t in_use; ///< slot holds an entry
+    uint8_t probed; ///< request sent to confirm the stale entry
+    uint8_t used; ///< packets were sent to it since its refresh or the last eviction scan
     mac_addr_t mac; ///< MAC addr corresponding to IP address
-    char if_name[IF_NAME_SIZE]; ///< Interface name
-    glthread_t arp_glue;
+    uint32_t lru_prev; ///< slot of the entry refreshed before this one
+    uint32_t lru_next; ///< slot of the entry refreshed after this one
+    uint64_t refresh_ns; ///< last time an ARP packet confirmed the entry
 } arp_tbl_entry_t;
 
-// map function to extract arp information from gl linked list node
-GLTHREAD_TO_STRUCT(arp_glue_to_arp_entry, arp_tbl_entry_t, arp_glue);
+/**
+ * ARP table: open addressing hash table keyed by IP address, with
+ * linear probing. Deleted entries are filled by shifting back the
+ * entries probed after them, so there are no tombstones and lookups
+ * stay short however many entries have come and gone.
+ *
+ * Entries are also linked by slot number in the order they were last
+ * refreshed. The head of that list is the next one to expire, so aging
+ * never walks the table. Eviction also starts from the head but gives
+ * a second chance to entries used since they were refreshed: the first
+ * entry without the used mark among the ARP_TBL_EVICT_SCAN oldest is
+ * evicted, the marks of those passed over are cleared. Lookups do not
+ * mark entries, the senders do with arp_tbl_entry_touch.
+ *
+ * Pointers to entries are valid until the next add or delete.
+ */
+typedef struct arp_tbl_ {
+    arp_tbl_entry_t *slots;
+    uint32_t n_slots; ///< power of 2
+    uint32_t n_entries;
+    unsigned int hash_shift; ///< 32 - log2(n_slots)
+    uint32_t lru_head; ///< least recently refreshed entry
+    uint32_t lru_tail; ///< most recently refreshed entry
+    uint32_t max_entries; ///< adding past this evicts the head
+    uint64_t reachable_ns;
+    uint64_t expire_ns;
+    uint64_t n_refreshed; ///< entries confirmed again
+    uint64_t n_evicted;   ///< entries removed to make room
+    uint64_t n_expired;   ///< entries removed by aging
+} arp_tbl_t;
 
+/**
+ * @brief State of an ARP entry at a time
+ */
+static inline arp_entry_state_t
+arp_tbl_entry_state(const arp_tbl_t *arp_tbl, const arp_tbl_entry_t *entry,
+                    uint64_t now_ns){
+    uint64_t age_ns = now_ns - entry->refresh_ns;
+    if(now_ns < entry->refresh_ns || age_ns < arp_tbl->reachable_ns){
+        return ARP_ENTRY_REACHABLE;
+    }
+    return (age_ns < arp_tbl->expire_ns) ? ARP_ENTRY_STALE : ARP_ENTRY_EXPIRED;
+}
+
+/**
+ * @brief Mark an ARP entry as used by a packet sent to it.
+ *
+ * Only an atomic store, so it can be done with the table read locked.
+ */
+static inline void
+arp_tbl_entry_touch(arp_tbl_entry_t *entry){
+    if(!__atomic_load_n(&entry->used, __ATOMIC_RELAXED)){
+        __atomic_store_n(&entry->used, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Iterate over the entries of an ARP table. The table must not be
+ * changed while iterating.
+ */
+#define ITERATE_ARP_TBL_BEGIN(arp_tbl, entry)                             \
+{                                                                         \
+    for(uint32_t _slot = 0; _slot < (arp_tbl)->n_slots; _slot++){         \
+        entry = &(arp_tbl)->slots[_slot];                                 \
+        if(!entry->in_use) continue;
+
+#define ITERATE_ARP_TBL_END(arp_tbl, entry) }}
+
+
+/**
+ * Resolution of an IP address in progress. Every resolution of the
+ * same IP address, and every packet sent to it, joins the one in
+ * progress instead of sending its own request.
+ */
+typedef struct arp_pending_ {
+    uint64_t id;             ///< names the resolution to its retry timer
+    uint32_t ip_n;           ///< IP address being resolved
+    interface_t *out_if;     ///< interface in the subnet of the IP address
+    uint64_t start_ns;       ///< first request sent
+    uint64_t req_ns;         ///< last request sent
+    unsigned int n_requests; ///< requests sent
+    int result;              ///< 0 while pending, 1 resolved, -1 failed
+    unsigned int n_waiters;  ///< threads blocked in arp_resolve
+    int retry_armed;         ///< retry timer queued on the receiver thread of the node
+    unsigned int n_queued;
+    pkt_buf_t *queue[ARP_PENDING_QUEUE_LEN]; ///< packets to send once resolved
+    glthread_t pending_glue;
+} arp_pending_t;
+
+GLTHREAD_TO_STRUCT(pending_glue_to_arp_pending, arp_pending_t, pending_glue)
+
+typedef struct arp_stats_ {
+    uint64_t requests_sent;
+    uint64_t requests_coalesced; ///< resolutions and packets that joined one in progress
+    uint64_t requests_received;
+    uint64_t replies_sent;
+    uint64_t replies_received;
+    uint64_t resolved;
+    uint64_t failed;             ///< resolutions without reply
+    uint64_t pkts_queued;
+    uint64_t pkts_dropped;       ///< queue full or resolution failed
+} arp_stats_t;
+
+/**
+ * ARP state of a node: its ARP table and the resolutions in progress.
+ * Used by the receiver thread of the node and by the threads sending
+ * from it, under the lock.
+ *
+ * The table is only changed with both the lock and tbl_lock written,
+ * so either one is enough to read it. Packets sent to resolved IP
+ * addresses only take tbl_lock for reading and do not wait on each
+ * other.
+ */
+typedef struct arp_engine_ {
+    pthread_mutex_t lock;
+    pthread_cond_t done; ///< broadcast when a resolution ends
+    pthread_rwlock_t tbl_lock; ///< taken after lock when both are needed
+    arp_tbl_t *arp_tbl;
+    int age_armed; ///< aging timer queued on the receiver thread of the node
+    glthread_t pending_list; ///< arp_pending_t
+    uint64_t next_pending_id;
+    arp_stats_t stats;
+} arp_engine_t;
+
+/**
+ * Outcome of arp_resolve
+ */
+typedef struct arp_resolve_result_ {
+    mac_addr_t mac;
+    unsigned int ifindex;    ///< interface the MAC is reached through
+    uint64_t latency_ns;     ///< time until the reply, or until giving up
+    unsigned int n_requests; ///< requests sent by the resolution
+    int cached;              ///< IP address was in the ARP table already
+    int coalesced;           ///< joined a resolution in progress
+} arp_resolve_result_t;
 
 typedef struct arp_pkt_{
     uint16_t arp_hardware_type;    // Hardware type (e.g., 1 for Ethernet)
@@ -37,20 +201,39 @@ typedef struct arp_pkt_{
     uint8_t  arp_proto_addr_len;   // Length of protocol address (4 for IPv4)
     uint16_t arp_operation;        // Operation: 1 for request, 2 for reply
 
-    mac_addr_t arp_sender_hw_addr; // Sender hardware address (MAC)
-    uint32_t   arp_sender_proto_addr; // Sender protocol address (IP)
+    uint8_t  arp_sender_hw_addr[6]; // Sender hardware address (MAC), wire order
+    uint32_t arp_sender_proto_addr; // Sender protocol address (IP)
 
-    mac_addr_t arp_target_hw_addr; // Target hardware address (MAC)
-    uint32_t   arp_target_proto_addr; // Target protocol address (IP)
+    uint8_t  arp_target_hw_addr[6]; // Target hardware address (MAC), wire order
+    uint32_t arp_target_proto_addr; // Target protocol address (IP)
 } __attribute__((packed)) apr_pkt_t;
 
 
+/**
+ * Ethernet header as on the wire, 14 bytes, fields in network byte
+ * order. In a tagged frame ethertype holds ETH_TYPE_VLAN and the frame
+ * starts with an ethernet_vlan_hdr_t instead.
+ */
 typedef struct ethernet_hdr_{
-    mac_addr_t dst_mac[6];       // Destination MAC address
-    mac_addr_t src_mac[6];       // Source MAC address
-    uint16_t ethertype;          // also length of payload
+    uint8_t dst_mac[6];          // Destination MAC address, wire order
+    uint8_t src_mac[6];          // Source MAC address, wire order
+    uint16_t ethertype;          // ethertype, or 802.3 length below ETH_TYPE_MIN
 } __attribute__((packed)) ethernet_hdr_t;
 
+/**
+ * Ethernet header with an 802.1Q tag, 18 bytes
+ */
+typedef struct ethernet_vlan_hdr_{
+    uint8_t dst_mac[6];
+    uint8_t src_mac[6];
+    uint16_t tpid;               // ETH_TYPE_VLAN
+    uint16_t tci;                // priority (3 bits), DEI (1 bit), VLAN ID (12 bits)
+    uint16_t ethertype;
+} __attribute__((packed)) ethernet_vlan_hdr_t;
+
+#define ETH_VLAN_ID(tci) ((tci) & 0x0FFF)
+#define ETH_VLAN_PCP(tci) ((tci) >> 13)
+
 typedef uint32_t fcs_t;
 
 /**
@@ -66,42 +249,40 @@ typedef uint32_t fcs_t;
 #define ETH_FCS(eth_hdr_p, payload_size) ((char *)eth_hdr_p + ETH_HDR_SIZE_WO_PAYLOAD + payload_size)
 
 
+uint32_t eth_hdr_build(const pkt_l2_t *l2, char *hdr);
+ethernet_hdr_t *eth_hdr_push(pkt_buf_t *pkt);
+char *eth_hdr_pop(pkt_buf_t *pkt);
+
 /**
- * Identify if a MAC address is broadcast or not
- *
+ * @brief Whether an interface of MAC if_mac takes a frame sent to
+ *        dst_mac: unicast to the interface, or broadcast. Two compares
+ *        and an or, no branch.
  */
-#define IS_MAC_BROADCAST(mac) ((mac[0] == 0xFF && mac[1] == 0xFF && mac[2] == 0xFF && mac[3] == 0xFF && mac[4] == 0xFF && mac[5] == 0xFF) ? 1 : 0)
-
-
-char *alloc_eth_frame(char *dl_pkt, size_t dk_pkt_size);
-
-inline void layer2_fill_broadcast_mac(uint8_t *mac_array){
-    // mac array has 6 bytes, each byte should be filled with 1s
-    // 1 byte filled with 1 is 255 (0xFF)
-    for(int i=0; i<6; i++){
-        mac_array[i] = 0xFF;
-    }
-    return;
+static inline int l2_mac_qualify(uint64_t if_mac, uint64_t dst_mac){
+    return (dst_mac == if_mac) | (dst_mac == MAC_ADDR_BROADCAST);
 }
 
-static inline int l2_recv_qualify_at_if(interface_t *intfp, ethernet_hdr_t * eth){
+static inline int l2_recv_qualify_at_if(interface_t *intfp, uint64_t dst_mac){
+    // frames on an L2 port are all for the switch of the node
+    if(IF_L2_MODE(intfp) != L2_MODE_NONE){
+        return 1;
+    }
     // if interface is not configured, drop the eth frame
-    // if dst MAC is not broadcast or
-    // if dst MAC does not match MAC of interface, drop
+    // if dst MAC is neither broadcast nor the MAC of interface, drop
     if(IF_IP_CONFIG(intfp) == 0){
+        comm_stats_rx_drop(&intfp->stats, COMM_DROP_IF_UNCONFIGURED);
         return 0; // Drop
     }
-    if(IS_MAC_BROADCAST(eth->dst_mac) == 0){
-        // Not broadcast
-        for(int i=0; i<6; i++){
-            if((int)IF_MAC(intfp).mac[i] !=  eth->dst_mac[i]){
-                return 0;
-            }
-        }
+    if(!l2_mac_qualify(IF_MAC(intfp).mac, dst_mac)){
+        comm_stats_rx_drop(&intfp->stats, COMM_DROP_MAC_MISMATCH);
+        return 0;
     }
     return 1; // Continue to next layer
 }
 
+uint64_t l2_mac_qualify_burst(uint64_t if_mac, const uint64_t *dst_macs, unsigned int n);
+uint64_t l2_recv_qualify_burst(interface_t *intfp, const uint64_t *dst_macs, unsigned int n);
+
 
 
 /**
@@ -109,9 +290,30 @@ static inline int l2_recv_qualify_at_if(interface_t *intfp, ethernet_hdr_t * eth
  *
  */
 arp_tbl_t* create_arp_tbl();
+void destroy_arp_tbl(arp_tbl_t *arp_tbl);
 arp_tbl_entry_t* lookup_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num);
-arp_tbl_entry_t* add_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num, mac_addr_t mac, char *if_name);
-void delete_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num);
+arp_tbl_entry_t* add_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num,
+                                   const mac_addr_t *mac, unsigned int ifindex);
+arp_tbl_entry_t* update_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num,
+                                      const mac_addr_t *mac, unsigned int ifindex);
+int delete_arp_tbl_entry(arp_tbl_t* arp_tbl, uint32_t ip_num);
+uint64_t arp_tbl_age(arp_tbl_t *arp_tbl, uint64_t now_ns);
+void arp_tbl_set_max_entries(arp_tbl_t *arp_tbl, uint32_t max_entries);
+void dump_arp_tbl(node_t *node, arp_tbl_t *arp_tbl);
+
+/**
+ * ARP resolution
+ *
+ */
+arp_engine_t *arp_engine_create(void);
+void arp_engine_destroy(arp_engine_t *arp);
+int arp_resolve(node_t *node, uint32_t ip_num, arp_resolve_result_t *res);
+int arp_send_pkt(node_t *node, uint32_t ip_num, char *pkt, uint32_t pkt_size);
+int arp_pkt_recv(node_t *node, interface_t *rx_if, char *pkt, uint32_t pkt_size);
+int arp_set_max_entries(node_t *node, uint32_t max_entries);
+int arp_set_timeouts(node_t *node, uint32_t reachable_ms, uint32_t expire_ms);
+void arp_timer_cancel(timer_event_t *ev);
+void dump_arp(graph_t *topo);
 
 
 
@@ -0,0 +1,182 @@
+/**
+ * @file link_emu.c
+ * @author Abishek Ramdas
+ * @brief Link impairment emulation: delay, bandwidth, loss, reordering, duplication
+ *
+ * link_emu_schedule only decides the fate of a packet: whether it is
+ * lost and when its copies reach the other end. The comm layer holds
+ * delayed packets on the timer queue of the receiving thread.
+ */
+
+#include "link_emu.h"
+#include <stdio.h>
+#include <string.h>
+
+#define EMU_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define EMU_STORE(field, val) __atomic_store_n(&(field), (val), __ATOMIC_RELAXED)
+// Single writer counter update, readers only need a consistent value
+#define EMU_STAT_INC(counter) EMU_STORE(counter, (counter) + 1)
+
+/**
+ * @brief Initialize a link with no impairments.
+ *
+ * @param  emu: emulation state of the link
+ * @param  seed: seed of the random number generators
+ */
+void link_emu_init(link_emu_t *emu, uint32_t seed){
+    memset(emu, 0, sizeof(*emu));
+    emu->params.seed = seed;
+    emu->seed_gen = 1;
+}
+
+void link_emu_get_params(link_emu_t *emu, link_emu_params_t *params){
+    params->delay_us = EMU_LOAD(emu->params.delay_us);
+    params->bandwidth_kbps = EMU_LOAD(emu->params.bandwidth_kbps);
+    params->loss_ppm = EMU_LOAD(emu->params.loss_ppm);
+    params->reorder_ppm = EMU_LOAD(emu->params.reorder_ppm);
+    params->dup_ppm = EMU_LOAD(emu->params.dup_ppm);
+    params->seed = EMU_LOAD(emu->params.seed);
+}
+
+/**
+ * @brief Change the impairments of a live link.
+ *
+ * Changing the seed restarts the random sequence of both directions
+ * from the new seed.
+ *
+ * @param  emu: emulation state of the link
+ * @param  params: new impairments
+ */
+void link_emu_set_params(link_emu_t *emu, const link_emu_params_t *params){
+    EMU_STORE(emu->params.delay_us, params->delay_us);
+    EMU_STORE(emu->params.bandwidth_kbps, params->bandwidth_kbps);
+    EMU_STORE(emu->params.loss_ppm, params->loss_ppm);
+    EMU_STORE(emu->params.reorder_ppm, params->reorder_ppm);
+    EMU_STORE(emu->params.dup_ppm, params->dup_ppm);
+    if(EMU_LOAD(emu->params.seed) != params->seed){
+        EMU_STORE(emu->params.seed, params->seed);
+        EMU_STORE(emu->seed_gen, emu->seed_gen + 1);
+    }
+    EMU_STORE(emu->enabled, (params->delay_us || params->bandwidth_kbps ||
+                             params->loss_ppm || params->reorder_ppm ||
+                             params->dup_ppm) ? 1 : 0);
+}
+
+static uint64_t splitmix64(uint64_t x){
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Roll the direction's random number generator.
+ *
+ * @return 1 with a chance of ppm in a million, else 0
+ */
+static int link_emu_roll(link_emu_dir_t *d, uint32_t ppm){
+    if(ppm == 0){
+        return 0;
+    }
+    // xorshift64*
+    d->rng ^= d->rng >> 12;
+    d->rng ^= d->rng << 25;
+    d->rng ^= d->rng >> 27;
+    uint64_t r = (d->rng * 0x2545F4914F6CDD1DULL) >> 32;
+    return ((r * LINK_EMU_PPM) >> 32) < ppm;
+}
+
+/**
+ * @brief Decide the fate of a packet entering one direction of a link.
+ *
+ * The packet first waits for the packets ahead of it to be serialized
+ * at the link bandwidth, then takes the propagation delay to reach the
+ * other end. A reordered packet skips the propagation delay and
+ * overtakes the packets still in flight. A duplicated packet reaches
+ * the other end twice at the same time.
+ *
+ * Must only be called by the receiver thread of the node the
+ * direction leads to.
+ *
+ * @param  emu: emulation state of the link
+ * @param  dir: 0 for packets towards if1, 1 towards if2
+ * @param  pkt_len: bytes of the packet
+ * @param  now_ns: CLOCK_MONOTONIC time the packet enters the link
+ * @param  deliver_ns: set to the time each copy reaches the other end
+ * @return number of copies of the packet to deliver, 0 if it is lost
+ */
+unsigned int link_emu_schedule(link_emu_t *emu, unsigned int dir, uint32_t pkt_len,
+                               uint64_t now_ns, uint64_t deliver_ns[2]){
+    link_emu_dir_t *d = &emu->dir[dir];
+    link_emu_params_t p;
+
+    link_emu_get_params(emu, &p);
+    uint32_t seed_gen = EMU_LOAD(emu->seed_gen);
+    if(d->seed_gen != seed_gen){
+        d->rng = splitmix64(((uint64_t)p.seed << 1) | dir);
+        if(d->rng == 0){
+            d->rng = 1; // xorshift never leaves 0
+        }
+        d->seed_gen = seed_gen;
+    }
+
+    EMU_STAT_INC(d->n_pkts);
+    if(link_emu_roll(d, p.loss_ppm)){
+        EMU_STAT_INC(d->n_lost);
+        return 0;
+    }
+
+    uint64_t depart_ns = now_ns;
+    if(p.bandwidth_kbps != 0){
+        if(d->busy_until_ns > depart_ns){
+            depart_ns = d->busy_until_ns;
+        }
+        // bits / (kbit/s) = ms, scaled to ns
+        depart_ns += (uint64_t)pkt_len * 8 * 1000000ULL / p.bandwidth_kbps;
+        d->busy_until_ns = depart_ns;
+    }
+
+    deliver_ns[0] = depart_ns;
+    if(link_emu_roll(d, p.reorder_ppm)){
+        EMU_STAT_INC(d->n_reordered);
+    } else {
+        deliver_ns[0] += (uint64_t)p.delay_us * 1000;
+    }
+
+    if(link_emu_roll(d, p.dup_ppm)){
+        EMU_STAT_INC(d->n_duplicated);
+        deliver_ns[1] = deliver_ns[0];
+        return 2;
+    }
+    return 1;
+}
+
+/**
+ * @brief Count a packet dropped for lack of a buffer to hold it in flight.
+ */
+void link_emu_drop_no_buf(link_emu_t *emu, unsigned int dir){
+    EMU_STAT_INC(emu->dir[dir].n_no_buf);
+}
+
+/**
+ * @brief Print the impairments of a link and the counters of one direction.
+ *
+ * @param  emu: emulation state of the link
+ * @param  dir: 0 for packets towards if1, 1 towards if2
+ */
+void dump_link_emu(link_emu_t *emu, unsigned int dir){
+    link_emu_params_t p;
+    link_emu_dir_t *d = &emu->dir[dir];
+
+    link_emu_get_params(emu, &p);
+    printf("\tLink emulation: %s\n", link_emu_enabled(emu) ? "on" : "off");
+    printf("\t\tdelay %u us, bandwidth %u kbps%s, seed %u\n", p.delay_us,
+           p.bandwidth_kbps, p.bandwidth_kbps ? "" : " (unlimited)", p.seed);
+    printf("\t\tloss %.4f%%, reorder %.4f%%, duplicate %.4f%%\n",
+           p.loss_ppm * 100.0 / LINK_EMU_PPM, p.reorder_ppm * 100.0 / LINK_EMU_PPM,
+           p.dup_ppm * 100.0 / LINK_EMU_PPM);
+    printf("\t\tRX packets %lu, lost %lu, reordered %lu, duplicated %lu, no buffer %lu\n",
+           (unsigned long)EMU_LOAD(d->n_pkts), (unsigned long)EMU_LOAD(d->n_lost),
+           (unsigned long)EMU_LOAD(d->n_reordered), (unsigned long)EMU_LOAD(d->n_duplicated),
+           (unsigned long)EMU_LOAD(d->n_no_buf));
+}
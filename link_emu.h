@@ -0,0 +1,68 @@
+/**
+ * @file link_emu.h
+ * @author Abishek Ramdas
+ * @brief Link impairment emulation: delay, bandwidth, loss, reordering, duplication
+ */
+
+#ifndef __MY_LINK_EMU_H
+#define __MY_LINK_EMU_H
+
+#include <stdint.h>
+
+// Probabilities are given in parts per million
+#define LINK_EMU_PPM 1000000
+
+/**
+ * Impairments applied to every packet crossing a link, in both
+ * directions. Written by the CLI while packets flow, every field is
+ * read on its own so a change takes effect from the next packet.
+ */
+typedef struct link_emu_params_ {
+    uint32_t delay_us;      ///< propagation delay
+    uint32_t bandwidth_kbps;///< serialization rate, 0 for unlimited
+    uint32_t loss_ppm;      ///< chance a packet is lost
+    uint32_t reorder_ppm;   ///< chance a packet skips the propagation delay
+    uint32_t dup_ppm;       ///< chance a packet is delivered twice
+    uint32_t seed;          ///< seed of the random number generators
+} link_emu_params_t;
+
+/**
+ * State of one direction of a link. Only used by the receiver thread
+ * of the node the direction leads to, so it needs no locking. Counters
+ * are read without locking by the CLI.
+ */
+typedef struct link_emu_dir_ {
+    uint64_t rng;           ///< xorshift64* state
+    uint32_t seed_gen;      ///< seed generation rng was seeded from
+    uint64_t busy_until_ns; ///< time the last packet finishes serializing
+    uint64_t n_pkts;        ///< packets entering the link
+    uint64_t n_lost;
+    uint64_t n_reordered;
+    uint64_t n_duplicated;
+    uint64_t n_no_buf;      ///< packets dropped, packet buffer pool was empty
+} link_emu_dir_t;
+
+typedef struct link_emu_ {
+    link_emu_params_t params;
+    uint32_t enabled;  ///< set while any impairment is configured
+    uint32_t seed_gen; ///< bumped when the seed changes
+    link_emu_dir_t dir[2]; ///< [0]: towards if1, [1]: towards if2
+} link_emu_t;
+
+void link_emu_init(link_emu_t *emu, uint32_t seed);
+void link_emu_get_params(link_emu_t *emu, link_emu_params_t *params);
+void link_emu_set_params(link_emu_t *emu, const link_emu_params_t *params);
+unsigned int link_emu_schedule(link_emu_t *emu, unsigned int dir, uint32_t pkt_len,
+                               uint64_t now_ns, uint64_t deliver_ns[2]);
+void link_emu_drop_no_buf(link_emu_t *emu, unsigned int dir);
+void dump_link_emu(link_emu_t *emu, unsigned int dir);
+
+/**
+ * @brief Check if packets crossing the link have to be emulated.
+ */
+static inline int
+link_emu_enabled(link_emu_t *emu){
+    return __atomic_load_n(&emu->enabled, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -1,15 +1,148 @@
 #include "CommandParser/libcli.h"
 #include "graph.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "nmcli.h"
+#include "comm.h"
+#include "pkt_buf.h"
 
 extern graph_t * build_first_topo();
 graph_t *topo = NULL;
 
-int main(){
+static void usage(const char *prog){
+    printf("Usage: %s [-b rx-burst-size] [-r rx-shards] [-t udp|shm] [-e epoll|uring] [-p pkt-bufs] [-f binary|name]\n"
+           "          [-P index/count] [-H host,...] [-E endpoints-file] [-j workers]\n", prog);
+    printf("  -b  comm packets drained per socket read (1-%d, default %d)\n",
+           COMM_RX_BURST_MAX, COMM_RX_BURST_DEFAULT);
+    printf("  -r  number of receiver threads (1-%d, default 1)\n",
+           COMM_MAX_RX_SHARDS);
+    printf("  -t  transport between nodes: udp sockets or shm rings (default udp)\n");
+    printf("  -e  I/O engine of the udp transport (default epoll)\n");
+    printf("  -p  number of buffers in the packet buffer pool (default %d)\n",
+           PKT_BUF_POOL_DEFAULT_SIZE);
+    printf("  -f  comm header format: binary interface index or interface name for\n"
+           "      debugging (default binary)\n");
+    printf("  -P  run partition index of a topology split across count processes\n"
+           "      (default 0/1)\n");
+    printf("  -H  host address of each partition, in order (default 127.0.0.1)\n");
+    printf("  -E  file of node endpoints, lines of <node-name> <host>:<port> <partition>\n");
+    printf("  -j  open the udp sockets on worker threads once the topology is built\n"
+           "      (0-%d, 0: one per CPU)\n",
+           COMM_BRINGUP_MAX_WORKERS);
+}
+
+int main(int argc, char **argv){
+    int opt;
+    int n_pkt_bufs = PKT_BUF_POOL_DEFAULT_SIZE;
+    while((opt = getopt(argc, argv, "b:r:t:e:p:f:P:H:E:j:")) != -1){
+        switch(opt){
+        case 'b':
+            if(comm_set_rx_burst_size(atoi(optarg)) < 0){
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            if(comm_set_rx_shards(atoi(optarg)) < 0){
+                return EXIT_FAILURE;
+            }
+            break;
+        case 't': {
+            int rc;
+            if(strcmp(optarg, "udp") == 0){
+                rc = comm_set_transport(COMM_TRANSPORT_UDP);
+            } else if(strcmp(optarg, "shm") == 0){
+                rc = comm_set_transport(COMM_TRANSPORT_SHM);
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            if(rc < 0){
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'e': {
+            int rc;
+            if(strcmp(optarg, "epoll") == 0){
+                rc = comm_set_io_engine(COMM_IO_EPOLL);
+            } else if(strcmp(optarg, "uring") == 0){
+                rc = comm_set_io_engine(COMM_IO_URING);
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            if(rc < 0){
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'p':
+            n_pkt_bufs = atoi(optarg);
+            if(n_pkt_bufs <= 0){
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'f': {
+            int rc;
+            if(strcmp(optarg, "binary") == 0){
+                rc = comm_set_hdr_format(COMM_HDR_BINARY);
+            } else if(strcmp(optarg, "name") == 0){
+                rc = comm_set_hdr_format(COMM_HDR_NAME);
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            if(rc < 0){
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'P': {
+            unsigned int index, count;
+            if(sscanf(optarg, "%u/%u", &index, &count) != 2 ||
+               comm_set_partition(index, count) < 0){
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'H': {
+            unsigned int partition = 0;
+            for(char *host = strtok(optarg, ","); host != NULL; host = strtok(NULL, ",")){
+                if(comm_set_partition_host(partition++, host) < 0){
+                    return EXIT_FAILURE;
+                }
+            }
+            break;
+        }
+        case 'E':
+            if(comm_load_endpoints(optarg) < 0){
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'j':
+            if(comm_set_bringup(COMM_BRINGUP_PARALLEL, atoi(optarg)) < 0){
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(pkt_buf_pool_init(n_pkt_bufs) < 0){
+        return EXIT_FAILURE;
+    }
+
     nw_init_cli();
     topo = build_first_topo();
+    if(topo == NULL){
+        return EXIT_FAILURE;
+    }
     start_shell();
     return 0;
 }
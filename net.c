@@ -32,15 +32,15 @@ int node_set_loopback_address(node_t *node, const char *ip_addr){
  *
  * @details
  * MAC addresses are burnt inside the NIC so we assign a random value
- * to emulate it.
+ * to emulate it. The address is a locally administered unicast one,
+ * 02:00 followed by the hash: a switch only learns unicast addresses.
  */
 int intf_assign_mac_addr(interface_t *intf){
     unsigned int hash_val = 0;
     node_t* node = intf->attached_node;
     hash_val = hash_code((void*)node->node_name, sizeof(node->node_name));
     hash_val *= hash_code((void*)intf->interface_name, sizeof(intf->interface_name));
-    memset(IF_MAC(intf).mac, 0, sizeof(IF_MAC(intf).mac));
-    snprintf(IF_MAC(intf).mac, sizeof(IF_MAC(intf).mac), "%u", hash_val);
+    IF_MAC(intf).mac = MAC_ADDR_LOCAL_BIT | hash_val;
     return 0;
 }
 
@@ -65,6 +65,7 @@ int node_set_intf_ip_address(node_t *node, char *local_if, const char *ip_addr,
     IF_IP(intf).ip_addr[sizeof(IF_IP(intf).ip_addr)-1] = '\0';
     IF_IP(intf).mask = mask;
     IF_IP_CONFIG(intf) = 1;
+    IF_L2_MODE(intf) = L2_MODE_NONE; // an L3 interface is not a switch port
     return 0;
 }
 
@@ -88,6 +89,34 @@ int node_unset_intf_ip_address(node_t *node, char *local_if){
     return 0;
 }
 
+/**
+ * @brief Set the L2 mode of an interface on a node.
+ *
+ * An interface in L2_MODE_ACCESS is a port of the L2 switch of the
+ * node, its IP address is cleared. L2_MODE_NONE takes the interface
+ * out of the switch.
+ *
+ * @param  node: pointer to node containing the interface
+ * @param  local_if: pointer to interface name string
+ * @param  l2_mode: L2 mode to set
+ * @return 0: success
+ *         <0: failure
+ */
+int node_set_intf_l2_mode(node_t *node, char *local_if, intf_l2_mode_t l2_mode){
+    interface_t *intf;
+    intf = get_node_if_by_name(node, local_if);
+    if(intf == NULL){
+        printf("Unable to find interface %s on node %s\n", local_if, node->node_name);
+        return -1;
+    }
+    if(l2_mode != L2_MODE_NONE && IF_IP_CONFIG(intf)){
+        memset(&IF_IP(intf), 0, sizeof(IF_IP(intf)));
+        IF_IP_CONFIG(intf) = 0;
+    }
+    IF_L2_MODE(intf) = l2_mode;
+    return 0;
+}
+
 
 /**
  * @brief Given an end-point IP addr return interface in node that lies in the same subnet.
@@ -105,6 +134,9 @@ node_get_matching_subnet_interface(node_t *node, char *ip_addr){
     interface_t *curr_if;
     for(int i=0; i<MAX_INTERFACES_PER_NODE; i++){
         curr_if = node->interfaces[i];
+        if(curr_if == NULL){
+            continue;
+        }
         if(IS_INTF_L3_MODE(curr_if) == 1){
             // IP is configured
             char* curr_if_ip = IF_IP(curr_if).ip_addr;
@@ -1,7 +1,6 @@
 #ifndef __MY_NET__H
 #define __MY_NET__H
 
-#include <cstdint>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,10 +16,58 @@ typedef struct ip_addr_ {
     int mask;
 } ip_addr_t;
 
+/**
+ * MAC address packed in the low 48 bits of an integer, the first byte
+ * of the address in bits 47-40. Addresses are compared and qualified
+ * with integer operations; mac_addr_pack and mac_addr_unpack convert
+ * from and to the 6 bytes of the wire.
+ */
 typedef struct mac_addr_{
-    uint8_t mac[7]; // 48 bits (6 bytes) plus null character
+    uint64_t mac;
 }mac_addr_t;
 
+#define MAC_ADDR_BROADCAST 0xFFFFFFFFFFFFULL
+#define MAC_ADDR_GROUP_BIT (1ULL << 40) ///< I/G bit, low bit of the first byte
+#define MAC_ADDR_LOCAL_BIT (1ULL << 41) ///< U/L bit, locally administered
+
+// printf format and arguments of a packed MAC address
+#define MAC_ADDR_FMT "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC_ADDR_ARGS(m) (unsigned int)((m) >> 40) & 0xFF, (unsigned int)((m) >> 32) & 0xFF, \
+                         (unsigned int)((m) >> 24) & 0xFF, (unsigned int)((m) >> 16) & 0xFF, \
+                         (unsigned int)((m) >> 8) & 0xFF, (unsigned int)(m) & 0xFF
+
+/**
+ * @brief Pack the 6 bytes of a MAC address, in wire order
+ */
+static inline uint64_t mac_addr_pack(const uint8_t *bytes){
+    return (uint64_t)bytes[0] << 40 | (uint64_t)bytes[1] << 32 | (uint64_t)bytes[2] << 24 |
+           (uint64_t)bytes[3] << 16 | (uint64_t)bytes[4] << 8 | (uint64_t)bytes[5];
+}
+
+/**
+ * @brief Write the 6 bytes of a packed MAC address, in wire order
+ */
+static inline void mac_addr_unpack(uint64_t mac, uint8_t *bytes){
+    for(int i=0; i<6; i++){
+        bytes[i] = (uint8_t)(mac >> (40 - 8 * i));
+    }
+}
+
+static inline int mac_addr_is_broadcast(uint64_t mac){
+    return mac == MAC_ADDR_BROADCAST;
+}
+
+/**
+ * @brief Group (multicast) address, broadcast included
+ */
+static inline int mac_addr_is_multicast(uint64_t mac){
+    return (int)((mac >> 40) & 1);
+}
+
+static inline int mac_addr_is_unicast(uint64_t mac){
+    return (int)(~(mac >> 40) & 1);
+}
+
 /** @struct node_nw_props_t
  *  @brief Network properties of a node
  */
@@ -29,12 +76,22 @@ typedef struct node_nw_props_ {
     int loopback_ip_flag; //< Inidcates whether loopback IP is configured or not
 } node_nw_props_t;
 
+/** @enum intf_l2_mode_t
+ *  @brief L2 mode of an interface. An interface in an L2 mode is a port
+ *         of the L2 switch of its node and carries no IP address.
+ */
+typedef enum intf_l2_mode_ {
+    L2_MODE_NONE = 0, //< not switched, L3 interface or unconfigured
+    L2_MODE_ACCESS,   //< switch port, frames are learned and forwarded
+} intf_l2_mode_t;
+
 /** @struct intf_nw_props_
  *  @brief Interface network properties
  */
 typedef struct intf_nw_props_{
     // L2 network properties
     mac_addr_t mac_address; //< MAC address burnt into the NIC
+    intf_l2_mode_t l2_mode; //< L2 switch mode, L2_MODE_NONE if not a switch port
     // L3 network properties
     ip_addr_t ip_address;
     int ip_address_flag; //< indicates whether IP addr is configured
@@ -46,6 +103,7 @@ typedef struct intf_nw_props_{
 #define IF_MAC(intfp) ((intfp->intf_nw_props.mac_address))
 #define IF_IP_CONFIG(intfp) ((intfp)->intf_nw_props.ip_address_flag)
 #define IS_INTF_L3_MODE(intfp) ((IF_IP_CONFIG(intfp) == 1) ? 1 : 0)
+#define IF_L2_MODE(intfp) ((intfp)->intf_nw_props.l2_mode)
 /**
  * @brief Initialize network properties of a node.
  * @return node_nw_props: pointer to an node_nw_props_t with default values
@@ -61,9 +119,10 @@ __attribute__((used)) static void init_node_nw_prop(node_nw_props_t* node_nw_pro
  * @return intf_nw_props: pointer to an intf_nw_props_t with default values
  */
 __attribute__((used)) static void init_intf_nw_prop(intf_nw_props_t *intf_nw_props) {
-    memset(&intf_nw_props->mac_address, 0, sizeof(intf_nw_props->mac_address));
+    intf_nw_props->mac_address.mac = 0;
     memset(&intf_nw_props->ip_address, 0, sizeof(intf_nw_props->ip_address));
     intf_nw_props->ip_address_flag = 0;
+    intf_nw_props->l2_mode = L2_MODE_NONE;
 }
 
 /**
@@ -90,6 +149,7 @@ extern int node_set_loopback_address(node_t *node, const char *ip_addr);
 extern int intf_assign_mac_addr(interface_t *intf);
 extern int node_set_intf_ip_address(node_t *node, char *local_if, const char *ip_addr, const int mask);
 extern int node_unset_intf_ip_address(node_t *node, char *local_if);
+extern int node_set_intf_l2_mode(node_t *node, char *local_if, intf_l2_mode_t l2_mode);
 extern  interface_t * node_get_matching_subnet_interface(node_t *node, char *ip_addr);
 
 /**
@@ -6,6 +6,15 @@
 #include "CommandParser/clistd.h"
 #include "nmcli.h" ///< Parameter codes for diff CLI commands.
 #include "utils.h"
+#include "comm.h"
+#include "link_emu.h"
+#include "lat_hist.h"
+#include "capture.h"
+#include "traffic_gen.h"
+#include "layer2.h"
+#include "l2switch.h"
+#include <stdlib.h>
+#include <arpa/inet.h>
 
 extern graph_t *topo;
 
@@ -34,6 +43,111 @@ show_topo_callback(param_t *param,
     return 0;
 }
 
+// show rx-shards
+static int
+show_rx_shards_callback(param_t *param,
+                        ser_buff_t *tlv_buf,
+                        op_mode enable_or_disable){
+    int CMDCODE = -1;
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_SHOW_RX_SHARDS:
+        dump_rx_shards(topo);
+        break;
+    default:
+        ;
+    }
+    return 0;
+}
+
+// show pkt-buf-pool
+static int
+show_pkt_buf_pool_callback(param_t *param,
+                           ser_buff_t *tlv_buf,
+                           op_mode enable_or_disable){
+    int CMDCODE = -1;
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_SHOW_PKT_BUF_POOL:
+        dump_pkt_buf_pool();
+        break;
+    default:
+        ;
+    }
+    return 0;
+}
+
+// show arp
+static int
+show_arp_callback(param_t *param,
+                  ser_buff_t *tlv_buf,
+                  op_mode enable_or_disable){
+    int CMDCODE = -1;
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_SHOW_ARP:
+        dump_arp(topo);
+        break;
+    default:
+        ;
+    }
+    return 0;
+}
+
+// show mac
+static int
+show_mac_callback(param_t *param,
+                  ser_buff_t *tlv_buf,
+                  op_mode enable_or_disable){
+    int CMDCODE = -1;
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_SHOW_MAC:
+        dump_l2_switch(topo);
+        break;
+    default:
+        ;
+    }
+    return 0;
+}
+
+// show interface statistics
+static int
+show_intf_stats_callback(param_t *param,
+                         ser_buff_t *tlv_buf,
+                         op_mode enable_or_disable){
+    int CMDCODE = -1;
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_SHOW_INTF_STATS:
+        dump_intf_stats(topo);
+        break;
+    default:
+        ;
+    }
+    return 0;
+}
+
+// show latency, clear latency
+static int
+latency_callback(param_t *param,
+                 ser_buff_t *tlv_buf,
+                 op_mode enable_or_disable){
+    int CMDCODE = -1;
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_SHOW_LATENCY:
+        dump_latency(topo);
+        break;
+    case CMDCODE_CLEAR_LATENCY:
+        lat_hist_reset_all();
+        break;
+    default:
+        ;
+    }
+    return 0;
+}
+
 // run node <node-name> resolve-arp <ip-address>
 static int
 run_node_arp_resolve_callback(param_t *param,
@@ -55,9 +169,83 @@ run_node_arp_resolve_callback(param_t *param,
 
     CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
     switch(CMDCODE){
-    case CMDCODE_RUN_NODE_RESOLVE_ARP:
-            printf("Here, nodename %s\n", node_name);
-            printf("Here, IP address %s\n", ip_address);
+    case CMDCODE_RUN_NODE_RESOLVE_ARP:{
+        node_t *node = get_node_by_node_name(topo, node_name);
+        uint32_t ip_num;
+        arp_resolve_result_t res;
+        if(node == NULL){
+            printf("Node %s not found\n", node_name);
+            return -1;
+        }
+        if(inet_pton(AF_INET, ip_address, &ip_num) != 1 ||
+           arp_resolve(node, ip_num, &res) < 0){
+            printf("Unable to resolve %s on node %s\n", ip_address, node_name);
+            return -1;
+        }
+        char how[48];
+        if(res.cached){
+            snprintf(how, sizeof(how), "cached");
+        } else if(res.coalesced){
+            snprintf(how, sizeof(how), "joined a resolution in progress");
+        } else {
+            snprintf(how, sizeof(how), "%u request%s", res.n_requests,
+                     res.n_requests == 1 ? "" : "s");
+        }
+        printf("Resolved %s to " MAC_ADDR_FMT " on %s in %.1f us (%s)\n",
+               ip_address, MAC_ADDR_ARGS(res.mac.mac),
+               node->interfaces[res.ifindex]->interface_name, res.latency_ns / 1e3, how);
+        break;
+    }
+    default:
+        ;
+    }
+    return 0;
+}
+
+// run node <node-name> interface <if-name> capture start <file> [snaplen <bytes>] [count <packets>]
+// run node <node-name> interface <if-name> capture stop
+static int
+run_capture_callback(param_t *param,
+                     ser_buff_t *tlv_buf,
+                     op_mode enable_or_disable){
+    int CMDCODE = -1;
+    tlv_struct_t *tlv = NULL;
+    char *node_name = NULL;
+    char *if_name = NULL;
+    char *file = NULL;
+    uint32_t snaplen = 0;
+    uint64_t count = 0;
+
+    TLV_LOOP_BEGIN(tlv_buf, tlv){
+        if(strncmp(tlv->leaf_id, "node_name", strlen("node_name")) == 0){
+            node_name = tlv->value;
+        } else if(strncmp(tlv->leaf_id, "if_name", strlen("if_name")) == 0){
+            if_name = tlv->value;
+        } else if(strncmp(tlv->leaf_id, "file", strlen("file")) == 0){
+            file = tlv->value;
+        } else if(strncmp(tlv->leaf_id, "snaplen", strlen("snaplen")) == 0){
+            snaplen = strtoul(tlv->value, NULL, 10);
+        } else if(strncmp(tlv->leaf_id, "count", strlen("count")) == 0){
+            count = strtoull(tlv->value, NULL, 10);
+        }
+    } TLV_LOOP_END;
+
+    node_t *node = get_node_by_node_name(topo, node_name);
+    interface_t *intf = (node != NULL) ? get_node_if_by_name(node, if_name) : NULL;
+    if(intf == NULL){
+        printf("Interface %s not found on node %s\n", if_name, node_name);
+        return -1;
+    }
+
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_RUN_CAPTURE_START:
+        return capture_start(&intf->capture, file, snaplen, count);
+    case CMDCODE_RUN_CAPTURE_STOP:
+        if(capture_stop(&intf->capture) < 0){
+            printf("Interface %s is not being captured\n", if_name);
+            return -1;
+        }
         break;
     default:
         ;
@@ -65,6 +253,297 @@ run_node_arp_resolve_callback(param_t *param,
     return 0;
 }
 
+// run node <node-name> traffic-gen start|stop
+static int
+run_traffic_gen_callback(param_t *param,
+                         ser_buff_t *tlv_buf,
+                         op_mode enable_or_disable){
+    int CMDCODE = -1;
+    tlv_struct_t *tlv = NULL;
+    char *node_name = NULL;
+
+    TLV_LOOP_BEGIN(tlv_buf, tlv){
+        if(strncmp(tlv->leaf_id, "node_name", strlen("node_name")) == 0){
+            node_name = tlv->value;
+        }
+    } TLV_LOOP_END;
+
+    node_t *node = get_node_by_node_name(topo, node_name);
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_RUN_TGEN_START:
+        return traffic_gen_start(node);
+    case CMDCODE_RUN_TGEN_STOP:
+        if(traffic_gen_stop(node) < 0){
+            printf("No traffic generator running on node %s\n", node_name);
+            return -1;
+        }
+        break;
+    default:
+        ;
+    }
+    return 0;
+}
+
+// config node <node-name> traffic-gen <setting> <value>
+static int
+config_traffic_gen_callback(param_t *param,
+                            ser_buff_t *tlv_buf,
+                            op_mode enable_or_disable){
+    int CMDCODE = -1;
+    tlv_struct_t *tlv = NULL;
+    char *node_name = NULL;
+    char *value = NULL;
+
+    TLV_LOOP_BEGIN(tlv_buf, tlv){
+        if(strncmp(tlv->leaf_id, "node_name", strlen("node_name")) == 0){
+            node_name = tlv->value;
+        } else {
+            value = tlv->value;
+        }
+    } TLV_LOOP_END;
+
+    node_t *node = get_node_by_node_name(topo, node_name);
+    traffic_gen_t *gen = traffic_gen_get(node);
+    if(gen == NULL){
+        return -1;
+    }
+    if(__atomic_load_n(&gen->running, __ATOMIC_ACQUIRE)){
+        printf("Traffic generator of node %s is running, stop it first\n", node_name);
+        return -1;
+    }
+
+    // "no config ..." restores the default
+    int reset = (enable_or_disable == CONFIG_DISABLE);
+    traffic_gen_params_t defaults;
+    traffic_gen_set_defaults(&defaults);
+    traffic_gen_params_t *p = &gen->params;
+
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_CONFIG_TGEN_SIZE:
+        p->pkt_size = reset ? defaults.pkt_size : strtoul(value, NULL, 10);
+        break;
+    case CMDCODE_CONFIG_TGEN_PPS:
+        p->pps = reset ? 0 : strtoull(value, NULL, 10);
+        p->bps = 0;
+        break;
+    case CMDCODE_CONFIG_TGEN_BPS:
+        p->bps = reset ? 0 : strtoull(value, NULL, 10);
+        p->pps = 0;
+        break;
+    case CMDCODE_CONFIG_TGEN_DURATION:
+        p->duration_s = reset ? defaults.duration_s : strtoul(value, NULL, 10);
+        break;
+    case CMDCODE_CONFIG_TGEN_BURST:
+        p->burst = reset ? defaults.burst : strtoul(value, NULL, 10);
+        if(p->burst == 0 || p->burst > TRAFFIC_GEN_MAX_BURST){
+            printf("Burst must be between 1 and %d\n", TRAFFIC_GEN_MAX_BURST);
+            p->burst = defaults.burst;
+            return -1;
+        }
+        break;
+    case CMDCODE_CONFIG_TGEN_INTERFACE:
+        memset(p->if_name, 0, sizeof(p->if_name));
+        if(!reset){
+            strncpy(p->if_name, value, sizeof(p->if_name) - 1);
+            p->dst_ip[0] = '\0';
+        }
+        break;
+    case CMDCODE_CONFIG_TGEN_IP:
+        memset(p->dst_ip, 0, sizeof(p->dst_ip));
+        if(!reset){
+            strncpy(p->dst_ip, value, sizeof(p->dst_ip) - 1);
+            p->if_name[0] = '\0';
+        }
+        break;
+    default:
+        ;
+    }
+    return 0;
+}
+
+// config node <node-name> arp <setting> <value>
+static int
+config_arp_callback(param_t *param,
+                    ser_buff_t *tlv_buf,
+                    op_mode enable_or_disable){
+    int CMDCODE = -1;
+    tlv_struct_t *tlv = NULL;
+    char *node_name = NULL;
+    char *value = NULL;
+
+    TLV_LOOP_BEGIN(tlv_buf, tlv){
+        if(strncmp(tlv->leaf_id, "node_name", strlen("node_name")) == 0){
+            node_name = tlv->value;
+        } else {
+            value = tlv->value;
+        }
+    } TLV_LOOP_END;
+
+    node_t *node = get_node_by_node_name(topo, node_name);
+    if(node == NULL || node->arp == NULL){
+        printf("Node %s not found\n", node_name);
+        return -1;
+    }
+    // "no config ..." restores the default
+    int reset = (enable_or_disable == CONFIG_DISABLE);
+    arp_tbl_t *arp_tbl = node->arp->arp_tbl;
+    uint32_t reachable_ms = arp_tbl->reachable_ns / 1000000;
+    uint32_t expire_ms = arp_tbl->expire_ns / 1000000;
+
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_CONFIG_ARP_MAX_ENTRIES:
+        return arp_set_max_entries(node, reset ? ARP_TBL_DEFAULT_MAX_ENTRIES :
+                                                 strtoul(value, NULL, 10));
+    case CMDCODE_CONFIG_ARP_REACHABLE:
+        reachable_ms = reset ? ARP_TBL_DEFAULT_REACHABLE_MS : strtoul(value, NULL, 10);
+        return arp_set_timeouts(node, reachable_ms, expire_ms);
+    case CMDCODE_CONFIG_ARP_EXPIRE:
+        expire_ms = reset ? ARP_TBL_DEFAULT_EXPIRE_MS : strtoul(value, NULL, 10);
+        return arp_set_timeouts(node, reachable_ms, expire_ms);
+    default:
+        ;
+    }
+    return 0;
+}
+
+// config node <node-name> interface <if-name> l2-mode access
+static int
+config_intf_l2_mode_callback(param_t *param,
+                             ser_buff_t *tlv_buf,
+                             op_mode enable_or_disable){
+    int CMDCODE = -1;
+    tlv_struct_t *tlv = NULL;
+    char *node_name = NULL;
+    char *if_name = NULL;
+
+    TLV_LOOP_BEGIN(tlv_buf, tlv){
+        if(strncmp(tlv->leaf_id, "node_name", strlen("node_name")) == 0){
+            node_name = tlv->value;
+        } else if(strncmp(tlv->leaf_id, "if_name", strlen("if_name")) == 0){
+            if_name = tlv->value;
+        }
+    } TLV_LOOP_END;
+
+    node_t *node = get_node_by_node_name(topo, node_name);
+    if(node == NULL){
+        printf("Node %s not found\n", node_name);
+        return -1;
+    }
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_CONFIG_INTF_L2_MODE:
+        // "no config ..." takes the interface out of the switch
+        return node_set_intf_l2_mode(node, if_name, (enable_or_disable == CONFIG_DISABLE) ?
+                                                    L2_MODE_NONE : L2_MODE_ACCESS);
+    default:
+        ;
+    }
+    return 0;
+}
+
+// config node <node-name> mac <setting> <value>
+static int
+config_mac_callback(param_t *param,
+                    ser_buff_t *tlv_buf,
+                    op_mode enable_or_disable){
+    int CMDCODE = -1;
+    tlv_struct_t *tlv = NULL;
+    char *node_name = NULL;
+    char *value = NULL;
+
+    TLV_LOOP_BEGIN(tlv_buf, tlv){
+        if(strncmp(tlv->leaf_id, "node_name", strlen("node_name")) == 0){
+            node_name = tlv->value;
+        } else {
+            value = tlv->value;
+        }
+    } TLV_LOOP_END;
+
+    node_t *node = get_node_by_node_name(topo, node_name);
+    if(node == NULL || node->l2_switch == NULL){
+        printf("Node %s not found\n", node_name);
+        return -1;
+    }
+    // "no config ..." restores the default
+    int reset = (enable_or_disable == CONFIG_DISABLE);
+
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_CONFIG_MAC_MAX_ENTRIES:
+        return l2_switch_set_max_entries(node, reset ? MAC_TBL_DEFAULT_MAX_ENTRIES :
+                                                       strtoul(value, NULL, 10));
+    case CMDCODE_CONFIG_MAC_AGE:
+        return l2_switch_set_age(node, reset ? MAC_TBL_DEFAULT_AGE_MS :
+                                               strtoul(value, NULL, 10));
+    default:
+        ;
+    }
+    return 0;
+}
+
+// config node <node-name> interface <if-name> link <impairment> <value>
+static int
+config_link_emu_callback(param_t *param,
+                         ser_buff_t *tlv_buf,
+                         op_mode enable_or_disable){
+    int CMDCODE = -1;
+    tlv_struct_t *tlv = NULL;
+    char *node_name = NULL;
+    char *if_name = NULL;
+    char *value = NULL;
+
+    TLV_LOOP_BEGIN(tlv_buf, tlv){
+        if(strncmp(tlv->leaf_id, "node_name", strlen("node_name")) == 0){
+            node_name = tlv->value;
+        } else if(strncmp(tlv->leaf_id, "if_name", strlen("if_name")) == 0){
+            if_name = tlv->value;
+        } else {
+            value = tlv->value;
+        }
+    } TLV_LOOP_END;
+
+    node_t *node = get_node_by_node_name(topo, node_name);
+    interface_t *intf = (node != NULL) ? get_node_if_by_name(node, if_name) : NULL;
+    if(intf == NULL || intf->link == NULL){
+        printf("Interface %s not found on node %s\n", if_name, node_name);
+        return -1;
+    }
+
+    // "no config ..." resets the impairment
+    int reset = (enable_or_disable == CONFIG_DISABLE);
+    link_emu_params_t params;
+    link_emu_get_params(&intf->link->emu, &params);
+
+    CMDCODE = EXTRACT_CMD_CODE(tlv_buf);
+    switch(CMDCODE){
+    case CMDCODE_CONFIG_LINK_DELAY:
+        params.delay_us = reset ? 0 : strtoul(value, NULL, 10);
+        break;
+    case CMDCODE_CONFIG_LINK_BANDWIDTH:
+        params.bandwidth_kbps = reset ? 0 : strtoul(value, NULL, 10);
+        break;
+    case CMDCODE_CONFIG_LINK_LOSS:
+        params.loss_ppm = reset ? 0 : (uint32_t)(strtod(value, NULL) * LINK_EMU_PPM / 100);
+        break;
+    case CMDCODE_CONFIG_LINK_REORDER:
+        params.reorder_ppm = reset ? 0 : (uint32_t)(strtod(value, NULL) * LINK_EMU_PPM / 100);
+        break;
+    case CMDCODE_CONFIG_LINK_DUPLICATE:
+        params.dup_ppm = reset ? 0 : (uint32_t)(strtod(value, NULL) * LINK_EMU_PPM / 100);
+        break;
+    case CMDCODE_CONFIG_LINK_SEED:
+        params.seed = reset ? 0 : strtoul(value, NULL, 10);
+        break;
+    default:
+        return 0;
+    }
+    link_emu_set_params(&intf->link->emu, &params);
+    return 0;
+}
+
 #pragma GCC diagnostic pop
 /**
  * Validation functions
@@ -81,6 +560,28 @@ validate_node_name_callback(char *node_name){
     return VALIDATION_SUCCESS; // VALIDATION_FAILED
 }
 
+static int
+validate_percent_callback(char *percent){
+    char *end = NULL;
+    double val = strtod(percent, &end);
+    if(end == percent || *end != '\0' || val < 0 || val > 100){
+        printf("%s is not a percentage between 0 and 100\n", percent);
+        return VALIDATION_FAILED;
+    }
+    return VALIDATION_SUCCESS;
+}
+
+static int
+validate_uint_callback(char *number){
+    char *end = NULL;
+    long long val = strtoll(number, &end, 10);
+    if(end == number || *end != '\0' || val < 0 || val > UINT32_MAX){
+        printf("%s is not a number between 0 and %u\n", number, UINT32_MAX);
+        return VALIDATION_FAILED;
+    }
+    return VALIDATION_SUCCESS;
+}
+
 static int
 validate_ip_callback(char *ip_address){
      if(is_valid_ipv4(ip_address) < 0){
@@ -119,6 +620,67 @@ void nw_init_cli(){
         libcli_register_param(show, &topology);
     }
 
+    //CMD: show rx-shards
+    {
+        static param_t rx_shards;
+        init_param(&rx_shards, CMD, "rx-shards", show_rx_shards_callback, 0, INVALID, 0, "Show node to RX shard mapping and shard load");
+        set_param_cmd_code(&rx_shards, CMDCODE_SHOW_RX_SHARDS);
+        libcli_register_param(show, &rx_shards);
+    }
+
+    //CMD: show pkt-buf-pool
+    {
+        static param_t pkt_buf_pool;
+        init_param(&pkt_buf_pool, CMD, "pkt-buf-pool", show_pkt_buf_pool_callback, 0, INVALID, 0, "Show packet buffer pool occupancy");
+        set_param_cmd_code(&pkt_buf_pool, CMDCODE_SHOW_PKT_BUF_POOL);
+        libcli_register_param(show, &pkt_buf_pool);
+    }
+
+    //CMD: show arp
+    {
+        static param_t arp;
+        init_param(&arp, CMD, "arp", show_arp_callback, 0, INVALID, 0, "Show ARP tables and resolution counters");
+        set_param_cmd_code(&arp, CMDCODE_SHOW_ARP);
+        libcli_register_param(show, &arp);
+    }
+
+    //CMD: show mac
+    {
+        static param_t mac;
+        init_param(&mac, CMD, "mac", show_mac_callback, 0, INVALID, 0, "Show MAC tables and switching counters");
+        set_param_cmd_code(&mac, CMDCODE_SHOW_MAC);
+        libcli_register_param(show, &mac);
+    }
+
+    //CMD: show interface statistics
+    {
+        static param_t interface;
+        init_param(&interface, CMD, "interface", 0, 0, INVALID, 0, "Help: interface");
+        libcli_register_param(show, &interface);
+        {
+            static param_t statistics;
+            init_param(&statistics, CMD, "statistics", show_intf_stats_callback, 0, INVALID, 0, "Show packet, byte and drop counters of nodes and interfaces");
+            set_param_cmd_code(&statistics, CMDCODE_SHOW_INTF_STATS);
+            libcli_register_param(&interface, &statistics);
+        }
+    }
+
+    //CMD: show latency
+    {
+        static param_t latency;
+        init_param(&latency, CMD, "latency", latency_callback, 0, INVALID, 0, "Show latency percentiles of nodes and links");
+        set_param_cmd_code(&latency, CMDCODE_SHOW_LATENCY);
+        libcli_register_param(show, &latency);
+    }
+
+    //CMD: clear latency
+    {
+        static param_t latency;
+        init_param(&latency, CMD, "latency", latency_callback, 0, INVALID, 0, "Reset the latency histograms");
+        set_param_cmd_code(&latency, CMDCODE_CLEAR_LATENCY);
+        libcli_register_param(clear, &latency);
+    }
+
     //CMD: run node <node-name> resolve-arp <ip-address>
     {
         // Add node param as suboption of run param
@@ -146,10 +708,256 @@ void nw_init_cli(){
                     set_param_cmd_code(&ip_address, CMDCODE_RUN_NODE_RESOLVE_ARP); // Completed constructing the entire command
                 }
             }
+
+            // run node <node-name> interface <if-name> capture ...
+            {
+                static param_t interface;
+                init_param(&interface, CMD, "interface", 0, 0, INVALID, 0, "Help: interface");
+                libcli_register_param(&node_name, &interface);
+
+                static param_t if_name;
+                init_param(&if_name, LEAF, 0, 0, 0, STRING, "if_name", "Help: interface name");
+                libcli_register_param(&interface, &if_name);
+
+                static param_t capture;
+                init_param(&capture, CMD, "capture", 0, 0, INVALID, 0, "Capture the packets of the interface to a pcap file");
+                libcli_register_param(&if_name, &capture);
+
+                // capture start <file> [snaplen <bytes>] [count <packets>]
+                static param_t start, file;
+                init_param(&start, CMD, "start", 0, 0, INVALID, 0, "start <file>");
+                libcli_register_param(&capture, &start);
+                init_param(&file, LEAF, 0, run_capture_callback, 0, STRING, "file", "pcap file to write");
+                libcli_register_param(&start, &file);
+                set_param_cmd_code(&file, CMDCODE_RUN_CAPTURE_START);
+
+                static param_t snaplen, snaplen_val;
+                init_param(&snaplen, CMD, "snaplen", 0, 0, INVALID, 0, "snaplen <bytes>");
+                libcli_register_param(&file, &snaplen);
+                init_param(&snaplen_val, LEAF, 0, run_capture_callback, validate_uint_callback, INT, "snaplen", "Bytes kept of each packet");
+                libcli_register_param(&snaplen, &snaplen_val);
+                set_param_cmd_code(&snaplen_val, CMDCODE_RUN_CAPTURE_START);
+
+                // count may follow the file or the snap length
+                static param_t count, count_val, snaplen_count, snaplen_count_val;
+                init_param(&count, CMD, "count", 0, 0, INVALID, 0, "count <packets>");
+                libcli_register_param(&file, &count);
+                init_param(&count_val, LEAF, 0, run_capture_callback, validate_uint_callback, INT, "count", "Packets to capture");
+                libcli_register_param(&count, &count_val);
+                set_param_cmd_code(&count_val, CMDCODE_RUN_CAPTURE_START);
+                init_param(&snaplen_count, CMD, "count", 0, 0, INVALID, 0, "count <packets>");
+                libcli_register_param(&snaplen_val, &snaplen_count);
+                init_param(&snaplen_count_val, LEAF, 0, run_capture_callback, validate_uint_callback, INT, "count", "Packets to capture");
+                libcli_register_param(&snaplen_count, &snaplen_count_val);
+                set_param_cmd_code(&snaplen_count_val, CMDCODE_RUN_CAPTURE_START);
+
+                static param_t stop;
+                init_param(&stop, CMD, "stop", run_capture_callback, 0, INVALID, 0, "Stop the capture");
+                libcli_register_param(&capture, &stop);
+                set_param_cmd_code(&stop, CMDCODE_RUN_CAPTURE_STOP);
+            }
+
+            // run node <node-name> traffic-gen start|stop
+            {
+                static param_t traffic_gen;
+                init_param(&traffic_gen, CMD, "traffic-gen", 0, 0, INVALID, 0, "Generate traffic from the node");
+                libcli_register_param(&node_name, &traffic_gen);
+
+                static param_t start;
+                init_param(&start, CMD, "start", run_traffic_gen_callback, 0, INVALID, 0, "Start sending with the configured settings");
+                libcli_register_param(&traffic_gen, &start);
+                set_param_cmd_code(&start, CMDCODE_RUN_TGEN_START);
+
+                static param_t stop;
+                init_param(&stop, CMD, "stop", run_traffic_gen_callback, 0, INVALID, 0, "Stop sending and report the rates");
+                libcli_register_param(&traffic_gen, &stop);
+                set_param_cmd_code(&stop, CMDCODE_RUN_TGEN_STOP);
+            }
         }
     }
 
 
+    //CMD: config node <node-name> interface <if-name> link <impairment> <value>
+    {
+        static param_t node;
+        init_param(&node, CMD, "node", 0, 0, INVALID, 0, "Help: node");
+        libcli_register_param(config, &node);
+        {
+            static param_t node_name;
+            init_param(&node_name, LEAF, 0, 0, validate_node_name_callback, STRING, "node_name", "Help: node name");
+            libcli_register_param(&node, &node_name);
+            {
+                static param_t interface;
+                init_param(&interface, CMD, "interface", 0, 0, INVALID, 0, "Help: interface");
+                libcli_register_param(&node_name, &interface);
+                {
+                    static param_t if_name;
+                    init_param(&if_name, LEAF, 0, 0, 0, STRING, "if_name", "Help: interface name");
+                    libcli_register_param(&interface, &if_name);
+                    {
+                        // Impairments of the link attached to the interface
+                        static param_t link;
+                        init_param(&link, CMD, "link", 0, 0, INVALID, 0, "Emulate impairments on the link of the interface");
+                        libcli_register_param(&if_name, &link);
+
+                        static param_t delay, delay_us;
+                        init_param(&delay, CMD, "delay", 0, 0, INVALID, 0, "delay <usec>");
+                        libcli_register_param(&link, &delay);
+                        init_param(&delay_us, LEAF, 0, config_link_emu_callback, validate_uint_callback, INT, "delay_us", "Propagation delay in microseconds");
+                        libcli_register_param(&delay, &delay_us);
+                        set_param_cmd_code(&delay_us, CMDCODE_CONFIG_LINK_DELAY);
+
+                        static param_t bandwidth, bandwidth_kbps;
+                        init_param(&bandwidth, CMD, "bandwidth", 0, 0, INVALID, 0, "bandwidth <kbps>");
+                        libcli_register_param(&link, &bandwidth);
+                        init_param(&bandwidth_kbps, LEAF, 0, config_link_emu_callback, validate_uint_callback, INT, "bandwidth_kbps", "Bandwidth in kbit/s, 0 for unlimited");
+                        libcli_register_param(&bandwidth, &bandwidth_kbps);
+                        set_param_cmd_code(&bandwidth_kbps, CMDCODE_CONFIG_LINK_BANDWIDTH);
+
+                        static param_t loss, loss_percent;
+                        init_param(&loss, CMD, "loss", 0, 0, INVALID, 0, "loss <percent>");
+                        libcli_register_param(&link, &loss);
+                        init_param(&loss_percent, LEAF, 0, config_link_emu_callback, validate_percent_callback, FLOAT, "loss_percent", "Percentage of packets lost");
+                        libcli_register_param(&loss, &loss_percent);
+                        set_param_cmd_code(&loss_percent, CMDCODE_CONFIG_LINK_LOSS);
+
+                        static param_t reorder, reorder_percent;
+                        init_param(&reorder, CMD, "reorder", 0, 0, INVALID, 0, "reorder <percent>");
+                        libcli_register_param(&link, &reorder);
+                        init_param(&reorder_percent, LEAF, 0, config_link_emu_callback, validate_percent_callback, FLOAT, "reorder_percent", "Percentage of packets overtaking the packets in flight");
+                        libcli_register_param(&reorder, &reorder_percent);
+                        set_param_cmd_code(&reorder_percent, CMDCODE_CONFIG_LINK_REORDER);
+
+                        static param_t duplicate, duplicate_percent;
+                        init_param(&duplicate, CMD, "duplicate", 0, 0, INVALID, 0, "duplicate <percent>");
+                        libcli_register_param(&link, &duplicate);
+                        init_param(&duplicate_percent, LEAF, 0, config_link_emu_callback, validate_percent_callback, FLOAT, "duplicate_percent", "Percentage of packets delivered twice");
+                        libcli_register_param(&duplicate, &duplicate_percent);
+                        set_param_cmd_code(&duplicate_percent, CMDCODE_CONFIG_LINK_DUPLICATE);
+
+                        static param_t seed, seed_val;
+                        init_param(&seed, CMD, "seed", 0, 0, INVALID, 0, "seed <number>");
+                        libcli_register_param(&link, &seed);
+                        init_param(&seed_val, LEAF, 0, config_link_emu_callback, validate_uint_callback, INT, "seed", "Seed of the random impairments");
+                        libcli_register_param(&seed, &seed_val);
+                        set_param_cmd_code(&seed_val, CMDCODE_CONFIG_LINK_SEED);
+                    }
+                    {
+                        // config node <node-name> interface <if-name> l2-mode access
+                        static param_t l2_mode, access;
+                        init_param(&l2_mode, CMD, "l2-mode", 0, 0, INVALID, 0, "L2 switch mode of the interface");
+                        libcli_register_param(&if_name, &l2_mode);
+                        init_param(&access, CMD, "access", config_intf_l2_mode_callback, 0, INVALID, 0, "Make the interface a port of the node's L2 switch, clears its IP address");
+                        libcli_register_param(&l2_mode, &access);
+                        set_param_cmd_code(&access, CMDCODE_CONFIG_INTF_L2_MODE);
+                    }
+                }
+            }
+            {
+                // ARP table limits and aging of the node
+                static param_t arp;
+                init_param(&arp, CMD, "arp", 0, 0, INVALID, 0, "ARP table limits and aging");
+                libcli_register_param(&node_name, &arp);
+
+                static param_t max_entries, max_entries_val;
+                init_param(&max_entries, CMD, "max-entries", 0, 0, INVALID, 0, "max-entries <entries>");
+                libcli_register_param(&arp, &max_entries);
+                init_param(&max_entries_val, LEAF, 0, config_arp_callback, validate_uint_callback, INT, "max_entries", "Most entries, the least recently refreshed is evicted past it");
+                libcli_register_param(&max_entries, &max_entries_val);
+                set_param_cmd_code(&max_entries_val, CMDCODE_CONFIG_ARP_MAX_ENTRIES);
+
+                static param_t reachable, reachable_val;
+                init_param(&reachable, CMD, "reachable-time", 0, 0, INVALID, 0, "reachable-time <msec>");
+                libcli_register_param(&arp, &reachable);
+                init_param(&reachable_val, LEAF, 0, config_arp_callback, validate_uint_callback, INT, "reachable_ms", "Entries are used as is for this long after a refresh");
+                libcli_register_param(&reachable, &reachable_val);
+                set_param_cmd_code(&reachable_val, CMDCODE_CONFIG_ARP_REACHABLE);
+
+                static param_t expire, expire_val;
+                init_param(&expire, CMD, "expire-time", 0, 0, INVALID, 0, "expire-time <msec>");
+                libcli_register_param(&arp, &expire);
+                init_param(&expire_val, LEAF, 0, config_arp_callback, validate_uint_callback, INT, "expire_ms", "Entries are removed this long after a refresh");
+                libcli_register_param(&expire, &expire_val);
+                set_param_cmd_code(&expire_val, CMDCODE_CONFIG_ARP_EXPIRE);
+            }
+            {
+                // MAC table limits and aging of the node's L2 switch
+                static param_t mac;
+                init_param(&mac, CMD, "mac", 0, 0, INVALID, 0, "MAC table limits and aging");
+                libcli_register_param(&node_name, &mac);
+
+                static param_t max_entries, max_entries_val;
+                init_param(&max_entries, CMD, "max-entries", 0, 0, INVALID, 0, "max-entries <entries>");
+                libcli_register_param(&mac, &max_entries);
+                init_param(&max_entries_val, LEAF, 0, config_mac_callback, validate_uint_callback, INT, "max_entries", "Most entries, the least recently refreshed is evicted past it");
+                libcli_register_param(&max_entries, &max_entries_val);
+                set_param_cmd_code(&max_entries_val, CMDCODE_CONFIG_MAC_MAX_ENTRIES);
+
+                static param_t age, age_val;
+                init_param(&age, CMD, "age-time", 0, 0, INVALID, 0, "age-time <msec>");
+                libcli_register_param(&mac, &age);
+                init_param(&age_val, LEAF, 0, config_mac_callback, validate_uint_callback, INT, "age_ms", "Entries are removed this long after the last frame from the MAC address");
+                libcli_register_param(&age, &age_val);
+                set_param_cmd_code(&age_val, CMDCODE_CONFIG_MAC_AGE);
+            }
+            {
+                // Settings of the node's traffic generator
+                static param_t traffic_gen;
+                init_param(&traffic_gen, CMD, "traffic-gen", 0, 0, INVALID, 0, "Settings of the node's traffic generator");
+                libcli_register_param(&node_name, &traffic_gen);
+
+                static param_t size, size_val;
+                init_param(&size, CMD, "size", 0, 0, INVALID, 0, "size <bytes>");
+                libcli_register_param(&traffic_gen, &size);
+                init_param(&size_val, LEAF, 0, config_traffic_gen_callback, validate_uint_callback, INT, "size", "Bytes of each data link packet");
+                libcli_register_param(&size, &size_val);
+                set_param_cmd_code(&size_val, CMDCODE_CONFIG_TGEN_SIZE);
+
+                static param_t pps, pps_val;
+                init_param(&pps, CMD, "pps", 0, 0, INVALID, 0, "pps <packets/s>");
+                libcli_register_param(&traffic_gen, &pps);
+                init_param(&pps_val, LEAF, 0, config_traffic_gen_callback, validate_uint_callback, INT, "pps", "Rate in packets per second, 0 for unlimited");
+                libcli_register_param(&pps, &pps_val);
+                set_param_cmd_code(&pps_val, CMDCODE_CONFIG_TGEN_PPS);
+
+                static param_t bps, bps_val;
+                init_param(&bps, CMD, "bps", 0, 0, INVALID, 0, "bps <bits/s>");
+                libcli_register_param(&traffic_gen, &bps);
+                init_param(&bps_val, LEAF, 0, config_traffic_gen_callback, validate_uint_callback, INT, "bps", "Rate in bits per second, 0 for unlimited");
+                libcli_register_param(&bps, &bps_val);
+                set_param_cmd_code(&bps_val, CMDCODE_CONFIG_TGEN_BPS);
+
+                static param_t duration, duration_val;
+                init_param(&duration, CMD, "duration", 0, 0, INVALID, 0, "duration <sec>");
+                libcli_register_param(&traffic_gen, &duration);
+                init_param(&duration_val, LEAF, 0, config_traffic_gen_callback, validate_uint_callback, INT, "duration", "Seconds to send for");
+                libcli_register_param(&duration, &duration_val);
+                set_param_cmd_code(&duration_val, CMDCODE_CONFIG_TGEN_DURATION);
+
+                static param_t burst, burst_val;
+                init_param(&burst, CMD, "burst", 0, 0, INVALID, 0, "burst <packets>");
+                libcli_register_param(&traffic_gen, &burst);
+                init_param(&burst_val, LEAF, 0, config_traffic_gen_callback, validate_uint_callback, INT, "burst", "Packets sent back to back");
+                libcli_register_param(&burst, &burst_val);
+                set_param_cmd_code(&burst_val, CMDCODE_CONFIG_TGEN_BURST);
+
+                static param_t interface, if_name;
+                init_param(&interface, CMD, "interface", 0, 0, INVALID, 0, "interface <if-name>");
+                libcli_register_param(&traffic_gen, &interface);
+                init_param(&if_name, LEAF, 0, config_traffic_gen_callback, 0, STRING, "tgen_if_name", "Interface to send out of");
+                libcli_register_param(&interface, &if_name);
+                set_param_cmd_code(&if_name, CMDCODE_CONFIG_TGEN_INTERFACE);
+
+                static param_t ip, ip_address;
+                init_param(&ip, CMD, "ip", 0, 0, INVALID, 0, "ip <ip-address>");
+                libcli_register_param(&traffic_gen, &ip);
+                init_param(&ip_address, LEAF, 0, config_traffic_gen_callback, validate_ip_callback, IPV4, "ip_address", "Destination IP, the interface in its subnet is sent out of");
+                libcli_register_param(&ip, &ip_address);
+                set_param_cmd_code(&ip_address, CMDCODE_CONFIG_TGEN_IP);
+            }
+        }
+    }
+
     /**
      * Do not add any param in command config tree after here
      *
@@ -7,6 +7,36 @@
  */
 #define CMDCODE_SHOW_TOPOLOGY 1 ///< Show the topology of the network
 #define CMDCODE_RUN_NODE_RESOLVE_ARP 2 ///< ARP resolution (IP to MAC address) on a node
+#define CMDCODE_SHOW_RX_SHARDS 3 ///< Show node to RX shard mapping and shard load
+#define CMDCODE_SHOW_PKT_BUF_POOL 4 ///< Show packet buffer pool occupancy
+#define CMDCODE_CONFIG_LINK_DELAY 5 ///< Propagation delay of a link
+#define CMDCODE_CONFIG_LINK_BANDWIDTH 6 ///< Bandwidth of a link
+#define CMDCODE_CONFIG_LINK_LOSS 7 ///< Packet loss rate of a link
+#define CMDCODE_CONFIG_LINK_REORDER 8 ///< Packet reordering rate of a link
+#define CMDCODE_CONFIG_LINK_DUPLICATE 9 ///< Packet duplication rate of a link
+#define CMDCODE_CONFIG_LINK_SEED 10 ///< Seed of a link's random impairments
+#define CMDCODE_SHOW_INTF_STATS 11 ///< Show packet, byte and drop counters
+#define CMDCODE_SHOW_LATENCY 12 ///< Show latency percentiles of nodes and links
+#define CMDCODE_CLEAR_LATENCY 13 ///< Reset the latency histograms
+#define CMDCODE_RUN_CAPTURE_START 14 ///< Start a pcap capture on an interface
+#define CMDCODE_RUN_CAPTURE_STOP 15 ///< Stop the pcap capture of an interface
+#define CMDCODE_CONFIG_TGEN_SIZE 16 ///< Packet size of a node's traffic generator
+#define CMDCODE_CONFIG_TGEN_PPS 17 ///< Rate of a traffic generator in packets/s
+#define CMDCODE_CONFIG_TGEN_BPS 18 ///< Rate of a traffic generator in bits/s
+#define CMDCODE_CONFIG_TGEN_DURATION 19 ///< Duration of a traffic generator run
+#define CMDCODE_CONFIG_TGEN_BURST 20 ///< Packets a traffic generator sends back to back
+#define CMDCODE_CONFIG_TGEN_INTERFACE 21 ///< Interface a traffic generator sends on
+#define CMDCODE_CONFIG_TGEN_IP 22 ///< Destination IP of a traffic generator
+#define CMDCODE_RUN_TGEN_START 23 ///< Start a node's traffic generator
+#define CMDCODE_RUN_TGEN_STOP 24 ///< Stop a node's traffic generator
+#define CMDCODE_SHOW_ARP 25 ///< Show ARP tables and resolution counters
+#define CMDCODE_CONFIG_ARP_MAX_ENTRIES 26 ///< Most entries of a node's ARP table
+#define CMDCODE_CONFIG_ARP_REACHABLE 27 ///< Time ARP entries stay reachable
+#define CMDCODE_CONFIG_ARP_EXPIRE 28 ///< Time after which ARP entries expire
+#define CMDCODE_CONFIG_INTF_L2_MODE 29 ///< Make an interface a port of the node's L2 switch
+#define CMDCODE_CONFIG_MAC_MAX_ENTRIES 30 ///< Most entries of a node's MAC table
+#define CMDCODE_CONFIG_MAC_AGE 31 ///< Time after which MAC entries age out
+#define CMDCODE_SHOW_MAC 32 ///< Show MAC tables and switching counters
 
 extern void nw_init_cli();
 
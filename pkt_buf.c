@@ -0,0 +1,217 @@
+/**
+ * @file pkt_buf.c
+ * @author Abishek Ramdas
+ * @brief Fixed size pool of packet buffers with per-thread caches
+ */
+
+#include "pkt_buf.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * The pool is one slab of buffers allocated up front and a shared free
+ * list. Every thread keeps a small cache of free buffers and only takes
+ * the pool lock to move PKT_BUF_CACHE_BATCH buffers at a time between
+ * its cache and the shared free list.
+ */
+typedef struct pkt_buf_pool_ {
+    pthread_mutex_t lock;
+    pkt_buf_t *descs;   ///< descriptor of every buffer
+    char *slab;         ///< storage of every buffer
+    pkt_buf_t *free_list;
+    uint32_t n_total;
+    uint32_t n_free;
+    uint32_t n_held_peak;
+    uint64_t n_exhausted;
+} pkt_buf_pool_t;
+
+static pkt_buf_pool_t pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+typedef struct pkt_buf_cache_ {
+    pkt_buf_t *list;
+    uint32_t n;
+} pkt_buf_cache_t;
+
+static __thread pkt_buf_cache_t cache = { NULL, 0 };
+
+/**
+ * @brief Allocate the buffers of the pool, pool lock held.
+ */
+static int _pkt_buf_pool_alloc(uint32_t n_bufs){
+    pool.descs = calloc(n_bufs, sizeof(pkt_buf_t));
+    pool.slab = calloc(n_bufs, PKT_BUF_SIZE);
+    if(pool.descs == NULL || pool.slab == NULL){
+        perror("calloc");
+        free(pool.descs);
+        free(pool.slab);
+        pool.descs = NULL;
+        pool.slab = NULL;
+        return -1;
+    }
+
+    for(uint32_t i=0; i<n_bufs; i++){
+        pkt_buf_t *pb = &pool.descs[i];
+        pkt_buf_init(pb, pool.slab + (size_t)i * PKT_BUF_SIZE, PKT_BUF_SIZE);
+        pb->next = pool.free_list;
+        pool.free_list = pb;
+    }
+    pool.n_total = n_bufs;
+    pool.n_free = n_bufs;
+    return 0;
+}
+
+/**
+ * @brief Allocate the buffers of the pool.
+ *
+ * Must be called before the first pkt_buf_alloc to get a pool size other
+ * than PKT_BUF_POOL_DEFAULT_SIZE.
+ *
+ * @param  n_bufs: number of buffers in the pool
+ * @return 0: Success
+ *        -1: Fail
+ */
+int pkt_buf_pool_init(uint32_t n_bufs){
+    int ret;
+
+    pthread_mutex_lock(&pool.lock);
+    if(pool.n_total != 0){
+        printf("Packet buffer pool is already initialized\n");
+        ret = -1;
+    } else {
+        ret = _pkt_buf_pool_alloc(n_bufs);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return ret;
+}
+
+/**
+ * @brief Refill the calling thread's cache from the shared free list.
+ */
+static void pkt_buf_cache_refill(void){
+    pthread_mutex_lock(&pool.lock);
+    if(pool.n_total == 0){
+        _pkt_buf_pool_alloc(PKT_BUF_POOL_DEFAULT_SIZE);
+    }
+    for(int i=0; i<PKT_BUF_CACHE_BATCH && pool.free_list != NULL; i++){
+        pkt_buf_t *pb = pool.free_list;
+        pool.free_list = pb->next;
+        pool.n_free--;
+        pb->next = cache.list;
+        cache.list = pb;
+        cache.n++;
+    }
+    if(pool.n_total - pool.n_free > pool.n_held_peak){
+        pool.n_held_peak = pool.n_total - pool.n_free;
+    }
+    if(cache.n == 0){
+        pool.n_exhausted++;
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * @brief Give a batch of buffers of the calling thread's cache back to the pool.
+ */
+static void pkt_buf_cache_flush(void){
+    pthread_mutex_lock(&pool.lock);
+    for(int i=0; i<PKT_BUF_CACHE_BATCH && cache.list != NULL; i++){
+        pkt_buf_t *pb = cache.list;
+        cache.list = pb->next;
+        cache.n--;
+        pb->next = pool.free_list;
+        pool.free_list = pb;
+        pool.n_free++;
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * @brief Give every buffer cached by the calling thread back to the pool.
+ *
+ * Must be called by threads that used packet buffers before they exit,
+ * the buffers of their cache are lost to the pool otherwise.
+ */
+void pkt_buf_cache_release(void){
+    while(cache.list != NULL){
+        pkt_buf_cache_flush();
+    }
+}
+
+/**
+ * @brief Get an empty packet buffer from the pool.
+ *
+ * The buffer has PKT_BUF_HEADROOM bytes of headroom and room for
+ * PKT_BUF_DATA_SIZE bytes of packet data plus PKT_BUF_TAILROOM.
+ *
+ * @return pointer to the buffer
+ *         NULL if the pool is exhausted
+ */
+pkt_buf_t *pkt_buf_alloc(void){
+    if(cache.list == NULL){
+        pkt_buf_cache_refill();
+        if(cache.list == NULL){
+            return NULL;
+        }
+    }
+    pkt_buf_t *pb = cache.list;
+    cache.list = pb->next;
+    cache.n--;
+
+    pb->data = pb->head + PKT_BUF_HEADROOM;
+    pb->len = 0;
+    pb->tx_ns = 0;
+    memset(&pb->l2, 0, sizeof(pb->l2));
+    pb->next = NULL;
+    return pb;
+}
+
+/**
+ * @brief Give a buffer obtained with pkt_buf_alloc back to the pool.
+ *
+ * A buffer may be freed by a different thread than the one that
+ * allocated it.
+ *
+ * @param  pb: pointer to the buffer, may be NULL
+ */
+void pkt_buf_free(pkt_buf_t *pb){
+    if(pb == NULL){
+        return;
+    }
+    pb->next = cache.list;
+    cache.list = pb;
+    cache.n++;
+    if(cache.n >= 2 * PKT_BUF_CACHE_BATCH){
+        pkt_buf_cache_flush();
+    }
+}
+
+/**
+ * @brief Get a snapshot of the pool occupancy.
+ *
+ * @param  stats: filled in with the pool counters
+ */
+void pkt_buf_pool_get_stats(pkt_buf_pool_stats_t *stats){
+    pthread_mutex_lock(&pool.lock);
+    stats->n_total = pool.n_total;
+    stats->n_free = pool.n_free;
+    stats->n_held = pool.n_total - pool.n_free;
+    stats->n_held_peak = pool.n_held_peak;
+    stats->n_exhausted = pool.n_exhausted;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+void dump_pkt_buf_pool(void){
+    pkt_buf_pool_stats_t stats;
+    pkt_buf_pool_get_stats(&stats);
+    printf("Packet buffer pool:\n");
+    printf("\tBuffer size: %d (headroom %d, data %d, tailroom %d)\n", PKT_BUF_SIZE,
+           PKT_BUF_HEADROOM, PKT_BUF_DATA_SIZE, PKT_BUF_TAILROOM);
+    printf("\tTotal buffers: %u\n", stats.n_total);
+    printf("\tFree in pool: %u\n", stats.n_free);
+    printf("\tHeld by threads (in use or cached): %u\n", stats.n_held);
+    printf("\tPeak held: %u\n", stats.n_held_peak);
+    printf("\tExhaustion events: %lu\n", (unsigned long)stats.n_exhausted);
+}
@@ -0,0 +1,164 @@
+/**
+ * @file pkt_buf.h
+ * @author Abishek Ramdas
+ * @brief Packet buffers with headroom and tailroom, and the pool they come from
+ */
+
+#ifndef __MY_PKT_BUF_H
+#define __MY_PKT_BUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Layout of a packet buffer:
+// | headroom | packet data ... | tailroom |
+// Headers are pushed into the headroom and trailers (FCS) are put into
+// the tailroom, so the packet data is never moved to add them.
+#define PKT_BUF_HEADROOM 128
+#define PKT_BUF_DATA_SIZE 2048 ///< largest packet, a full comm packet
+#define PKT_BUF_TAILROOM 32
+#define PKT_BUF_SIZE (PKT_BUF_HEADROOM + PKT_BUF_DATA_SIZE + PKT_BUF_TAILROOM)
+
+#define PKT_BUF_POOL_DEFAULT_SIZE 4096 ///< buffers in the pool unless set otherwise
+#define PKT_BUF_CACHE_BATCH 32 ///< buffers moved between pool and thread caches at a time
+
+/**
+ * L2 addresses, ethertype and 802.1Q tag of a packet, carried in the
+ * ethernet header behind the comm header.
+ * MAC addresses are packed like mac_addr_t. A zero MAC address stands
+ * for the MAC of the interface the packet is sent out of (source) or
+ * of the interface across the link (destination).
+ */
+typedef struct pkt_l2_ {
+    uint64_t dst_mac;
+    uint64_t src_mac;
+    uint16_t ethertype; ///< ethertype of an L2 frame, 0 for a data link packet
+    uint16_t vlan_tci;  ///< 802.1Q tag of the ethernet frame, 0 if untagged
+} pkt_l2_t;
+
+/**
+ * Descriptor of a packet buffer. It either describes a buffer of the
+ * pool or wraps memory owned by someone else (a receive buffer or a ring
+ * slot), which lets the RX path process packets in place.
+ */
+typedef struct pkt_buf_ {
+    char *head;    ///< start of the buffer
+    char *data;    ///< start of the packet data
+    uint32_t len;  ///< bytes of packet data
+    uint32_t size; ///< bytes of the buffer starting at head
+    uint64_t tx_ns; ///< CLOCK_MONOTONIC time the packet was sent, 0 if unknown
+    pkt_l2_t l2; ///< L2 addresses the packet was received or is sent with
+    struct pkt_buf_ *next; ///< free list link while the buffer is free
+} pkt_buf_t;
+
+/**
+ * Pool occupancy
+ */
+typedef struct pkt_buf_pool_stats_ {
+    uint32_t n_total;     ///< buffers in the pool
+    uint32_t n_free;      ///< buffers in the shared free list
+    uint32_t n_held;      ///< buffers in use or cached by threads
+    uint32_t n_held_peak; ///< highest n_held seen
+    uint64_t n_exhausted; ///< allocations that failed, pool was empty
+} pkt_buf_pool_stats_t;
+
+int pkt_buf_pool_init(uint32_t n_bufs);
+pkt_buf_t *pkt_buf_alloc(void);
+void pkt_buf_free(pkt_buf_t *pb);
+void pkt_buf_cache_release(void);
+void pkt_buf_pool_get_stats(pkt_buf_pool_stats_t *stats);
+void dump_pkt_buf_pool(void);
+
+/**
+ * @brief Describe memory owned by the caller as an empty packet buffer.
+ *
+ * @param  pb: descriptor to fill in
+ * @param  buf: start of the memory, PKT_BUF_HEADROOM bytes are kept free
+ * @param  size: bytes of memory
+ */
+static inline void
+pkt_buf_init(pkt_buf_t *pb, char *buf, uint32_t size){
+    pb->head = buf;
+    pb->data = buf + PKT_BUF_HEADROOM;
+    pb->len = 0;
+    pb->size = size;
+    pb->tx_ns = 0;
+    memset(&pb->l2, 0, sizeof(pb->l2));
+    pb->next = NULL;
+}
+
+static inline uint32_t
+pkt_buf_headroom(pkt_buf_t *pb){
+    return (uint32_t)(pb->data - pb->head);
+}
+
+static inline uint32_t
+pkt_buf_tailroom(pkt_buf_t *pb){
+    return pb->size - pkt_buf_headroom(pb) - pb->len;
+}
+
+/**
+ * @brief Prepend len bytes to the packet, in the headroom.
+ *
+ * @return pointer to the new start of the packet
+ *         NULL if there is not enough headroom
+ */
+static inline char *
+pkt_buf_push(pkt_buf_t *pb, uint32_t len){
+    if(len > pkt_buf_headroom(pb)){
+        return NULL;
+    }
+    pb->data -= len;
+    pb->len += len;
+    return pb->data;
+}
+
+/**
+ * @brief Remove len bytes from the start of the packet.
+ *
+ * @return pointer to the new start of the packet
+ *         NULL if the packet is shorter than len
+ */
+static inline char *
+pkt_buf_pull(pkt_buf_t *pb, uint32_t len){
+    if(len > pb->len){
+        return NULL;
+    }
+    pb->data += len;
+    pb->len -= len;
+    return pb->data;
+}
+
+/**
+ * @brief Append len bytes to the packet, in the tailroom.
+ *
+ * @return pointer to the appended bytes
+ *         NULL if there is not enough tailroom
+ */
+static inline char *
+pkt_buf_put(pkt_buf_t *pb, uint32_t len){
+    if(len > pkt_buf_tailroom(pb)){
+        return NULL;
+    }
+    char *tail = pb->data + pb->len;
+    pb->len += len;
+    return tail;
+}
+
+/**
+ * @brief Remove len bytes from the end of the packet.
+ *
+ * @return 0: Success
+ *        -1: Fail, packet is shorter than len
+ */
+static inline int
+pkt_buf_trim(pkt_buf_t *pb, uint32_t len){
+    if(len > pb->len){
+        return -1;
+    }
+    pb->len -= len;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * @file spsc_ring.c
+ * @author Abishek Ramdas
+ * @brief Allocation of single-producer/single-consumer packet rings
+ */
+
+#include "spsc_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @brief Create an empty ring.
+ *
+ * Slots are allocated with calloc so large rings that are never filled
+ * do not commit memory for their unused slots.
+ *
+ * @param  n_slots: number of slots, must be a power of 2
+ * @param  slot_size: max bytes of packet data in a slot
+ * @return pointer to heap allocated ring
+ *         NULL on failure
+ */
+spsc_ring_t *spsc_ring_create(uint32_t n_slots, uint32_t slot_size){
+    if(n_slots == 0 || (n_slots & (n_slots - 1)) != 0){
+        printf("Ring size %u is not a power of 2\n", n_slots);
+        return NULL;
+    }
+
+    spsc_ring_t *ring = NULL;
+    if(posix_memalign((void **)&ring, 64, sizeof(spsc_ring_t)) != 0){
+        perror("posix_memalign");
+        return NULL;
+    }
+    ring->n_slots = n_slots;
+    ring->slot_mask = n_slots - 1;
+    ring->slot_size = slot_size;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->slots = calloc(n_slots, sizeof(spsc_slot_hdr_t) + slot_size);
+    if(ring->slots == NULL){
+        perror("calloc");
+        free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+/**
+ * @brief Free a ring and its slots.
+ *
+ * @param  ring: pointer to the ring, may be NULL
+ */
+void spsc_ring_destroy(spsc_ring_t *ring){
+    if(ring == NULL){
+        return;
+    }
+    free(ring->slots);
+    free(ring);
+}
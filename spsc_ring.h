@@ -0,0 +1,102 @@
+/**
+ * @file spsc_ring.h
+ * @author Abishek Ramdas
+ * @brief Lock-free single-producer/single-consumer ring of packet buffers
+ */
+
+#ifndef __MY_SPSC_RING_H
+#define __MY_SPSC_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * A ring of fixed size packet slots shared by exactly one producer thread
+ * and one consumer thread. The producer copies a packet into the slot it
+ * reserved and publishes it, the consumer processes the packet in place
+ * and then releases the slot. head is only written by the producer and
+ * tail only by the consumer, each on its own cache line.
+ */
+typedef struct spsc_ring_ {
+    uint32_t n_slots;   ///< number of slots, power of 2
+    uint32_t slot_mask; ///< n_slots - 1
+    uint32_t slot_size; ///< bytes of packet data per slot
+    char *slots;        ///< n_slots * (sizeof(spsc_slot_hdr_t) + slot_size)
+    uint32_t head __attribute__((aligned(64))); ///< next slot to produce
+    uint32_t tail __attribute__((aligned(64))); ///< next slot to consume
+} spsc_ring_t;
+
+typedef struct spsc_slot_hdr_ {
+    uint32_t len; ///< bytes of packet data in the slot
+} spsc_slot_hdr_t;
+
+spsc_ring_t *spsc_ring_create(uint32_t n_slots, uint32_t slot_size);
+void spsc_ring_destroy(spsc_ring_t *ring);
+
+static inline spsc_slot_hdr_t *
+spsc_ring_slot(spsc_ring_t *ring, uint32_t idx){
+    size_t stride = sizeof(spsc_slot_hdr_t) + ring->slot_size;
+    return (spsc_slot_hdr_t *)(ring->slots + (size_t)(idx & ring->slot_mask) * stride);
+}
+
+/**
+ * @brief Reserve the next free slot of the ring (producer side).
+ *
+ * @param  ring: pointer to the ring
+ * @return pointer to slot_size bytes to write the packet into
+ *         NULL if the ring is full
+ */
+static inline char *
+spsc_ring_reserve(spsc_ring_t *ring){
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if(head - tail == ring->n_slots){
+        return NULL; // full
+    }
+    return (char *)(spsc_ring_slot(ring, head) + 1);
+}
+
+/**
+ * @brief Publish the slot returned by spsc_ring_reserve (producer side).
+ *
+ * @param  ring: pointer to the ring
+ * @param  len: bytes written into the slot
+ */
+static inline void
+spsc_ring_commit(spsc_ring_t *ring, uint32_t len){
+    uint32_t head = ring->head;
+    spsc_ring_slot(ring, head)->len = len;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Get the oldest published slot of the ring (consumer side).
+ *
+ * @param  ring: pointer to the ring
+ * @param  len: set to the bytes of packet data in the slot
+ * @return pointer to the packet data, valid until spsc_ring_release
+ *         NULL if the ring is empty
+ */
+static inline char *
+spsc_ring_peek(spsc_ring_t *ring, uint32_t *len){
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if(head == tail){
+        return NULL; // empty
+    }
+    spsc_slot_hdr_t *slot = spsc_ring_slot(ring, tail);
+    *len = slot->len;
+    return (char *)(slot + 1);
+}
+
+/**
+ * @brief Hand the slot returned by spsc_ring_peek back to the producer.
+ *
+ * @param  ring: pointer to the ring
+ */
+static inline void
+spsc_ring_release(spsc_ring_t *ring){
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,316 @@
+/**
+ * @file timer.c
+ * @author Abishek Ramdas
+ * @brief Timer queue: min-heap of timed callbacks driven by a timerfd
+ */
+
+#include "timer.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+/**
+ * @brief Create an empty timer queue and its timerfd.
+ *
+ * @param  tq: pointer to the queue to initialize
+ * @param  capacity: initial number of events the heap holds
+ * @return 0: Success
+ *        -1: Fail
+ */
+int timer_queue_init(timer_queue_t *tq, uint32_t capacity){
+    memset(tq, 0, sizeof(*tq));
+    tq->timer_fd = -1;
+    if(capacity == 0){
+        capacity = 1;
+    }
+    tq->heap = calloc(capacity, sizeof(timer_event_t));
+    if(tq->heap == NULL){
+        perror("calloc");
+        return -1;
+    }
+    tq->capacity = capacity;
+    tq->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(tq->timer_fd < 0){
+        perror("timerfd_create");
+        free(tq->heap);
+        tq->heap = NULL;
+        return -1;
+    }
+    pthread_mutex_init(&tq->remote_lock, NULL);
+    return 0;
+}
+
+/**
+ * @brief Free a timer queue. Pending events are dropped without running.
+ *
+ * @param  tq: pointer to the queue
+ */
+void timer_queue_destroy(timer_queue_t *tq){
+    if(tq->timer_fd >= 0){
+        close(tq->timer_fd);
+        pthread_mutex_destroy(&tq->remote_lock);
+    }
+    free(tq->heap);
+    free(tq->remote);
+    memset(tq, 0, sizeof(*tq));
+    tq->timer_fd = -1;
+}
+
+static void timer_queue_take_remote(timer_queue_t *tq);
+
+/**
+ * @brief Remove every pending event without running it.
+ *
+ * @param  tq: pointer to the queue
+ * @param  cancel_cb: optional, called on each event to release what it holds
+ */
+void timer_queue_cancel_all(timer_queue_t *tq, timer_cancel_cb_t cancel_cb){
+    timer_queue_take_remote(tq);
+    for(uint32_t i=0; i<tq->n_events; i++){
+        if(cancel_cb != NULL){
+            cancel_cb(&tq->heap[i]);
+        }
+    }
+    tq->n_events = 0;
+}
+
+static inline int timer_event_before(timer_event_t *a, timer_event_t *b){
+    if(a->expire_ns != b->expire_ns){
+        return a->expire_ns < b->expire_ns;
+    }
+    return a->seq < b->seq;
+}
+
+/**
+ * @brief Add a callback to run once expire_ns is reached.
+ *
+ * The timerfd is not re-armed here, call timer_queue_arm once done
+ * adding events.
+ *
+ * @param  tq: pointer to the queue
+ * @param  expire_ns: CLOCK_MONOTONIC time the callback is due
+ * @param  cb: callback, called as cb(arg, data)
+ * @return 0: Success
+ *        -1: Fail
+ */
+int timer_queue_add(timer_queue_t *tq, uint64_t expire_ns,
+                    timer_cb_t cb, void *arg, void *data){
+    if(tq->n_events == tq->capacity){
+        timer_event_t *heap = realloc(tq->heap, 2 * tq->capacity * sizeof(timer_event_t));
+        if(heap == NULL){
+            perror("realloc");
+            return -1;
+        }
+        tq->heap = heap;
+        tq->capacity *= 2;
+    }
+
+    timer_event_t ev = {
+        .expire_ns = expire_ns,
+        .seq = tq->next_seq++,
+        .cb = cb,
+        .arg = arg,
+        .data = data,
+    };
+
+    // Sift up
+    uint32_t i = tq->n_events++;
+    while(i > 0){
+        uint32_t parent = (i - 1) / 2;
+        if(!timer_event_before(&ev, &tq->heap[parent])){
+            break;
+        }
+        tq->heap[i] = tq->heap[parent];
+        i = parent;
+    }
+    tq->heap[i] = ev;
+    return 0;
+}
+
+/**
+ * @brief Add a callback to a queue owned by another thread.
+ *
+ * The event is put in the inbox of the queue and the timerfd is fired
+ * right away, the owner moves the event to its heap when it wakes up
+ * and arms the timerfd for it. The timerfd is set under the inbox
+ * lock, so the owner cannot arm it for a later time without seeing
+ * the event.
+ *
+ * @param  tq: pointer to the queue
+ * @param  expire_ns: CLOCK_MONOTONIC time the callback is due
+ * @param  cb: callback, called as cb(arg, data) on the owner thread
+ * @return 0: Success
+ *        -1: Fail
+ */
+int timer_queue_add_remote(timer_queue_t *tq, uint64_t expire_ns,
+                           timer_cb_t cb, void *arg, void *data){
+    int ret = 0;
+    pthread_mutex_lock(&tq->remote_lock);
+    if(tq->n_remote == tq->remote_capacity){
+        uint32_t capacity = tq->remote_capacity ? 2 * tq->remote_capacity : 16;
+        timer_event_t *remote = realloc(tq->remote, capacity * sizeof(timer_event_t));
+        if(remote == NULL){
+            perror("realloc");
+            pthread_mutex_unlock(&tq->remote_lock);
+            return -1;
+        }
+        tq->remote = remote;
+        tq->remote_capacity = capacity;
+    }
+    tq->remote[tq->n_remote] = (timer_event_t){
+        .expire_ns = expire_ns,
+        .cb = cb,
+        .arg = arg,
+        .data = data,
+    };
+    __atomic_store_n(&tq->n_remote, tq->n_remote + 1, __ATOMIC_RELEASE);
+
+    // An absolute time in the past fires at once
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = 1;
+    if(timerfd_settime(tq->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0){
+        perror("timerfd_settime");
+        ret = -1;
+    }
+    pthread_mutex_unlock(&tq->remote_lock);
+    return ret;
+}
+
+/**
+ * @brief Move the events added by other threads to the heap, the
+ *        inbox lock must be held.
+ */
+static void timer_queue_take_remote_locked(timer_queue_t *tq){
+    for(uint32_t i=0; i<tq->n_remote; i++){
+        timer_event_t *ev = &tq->remote[i];
+        if(timer_queue_add(tq, ev->expire_ns, ev->cb, ev->arg, ev->data) < 0){
+            // Kept in the inbox for the next try
+            memmove(tq->remote, ev, (tq->n_remote - i) * sizeof(timer_event_t));
+            tq->n_remote -= i;
+            return;
+        }
+    }
+    __atomic_store_n(&tq->n_remote, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Move the events added by other threads to the heap.
+ *
+ * Only takes the inbox lock if the inbox is not empty.
+ */
+static void timer_queue_take_remote(timer_queue_t *tq){
+    if(__atomic_load_n(&tq->n_remote, __ATOMIC_ACQUIRE) == 0){
+        return;
+    }
+    pthread_mutex_lock(&tq->remote_lock);
+    timer_queue_take_remote_locked(tq);
+    pthread_mutex_unlock(&tq->remote_lock);
+}
+
+/**
+ * @brief Remove the earliest event from the heap.
+ */
+static void timer_queue_pop(timer_queue_t *tq){
+    timer_event_t last = tq->heap[--tq->n_events];
+    uint32_t i = 0;
+
+    // Sift down
+    while(1){
+        uint32_t child = 2 * i + 1;
+        if(child >= tq->n_events){
+            break;
+        }
+        if(child + 1 < tq->n_events &&
+           timer_event_before(&tq->heap[child + 1], &tq->heap[child])){
+            child++;
+        }
+        if(!timer_event_before(&tq->heap[child], &last)){
+            break;
+        }
+        tq->heap[i] = tq->heap[child];
+        i = child;
+    }
+    tq->heap[i] = last;
+}
+
+/**
+ * @brief Run every event due at or before now_ns.
+ *
+ * Callbacks may add new events to the queue.
+ *
+ * @param  tq: pointer to the queue
+ * @param  now_ns: current CLOCK_MONOTONIC time
+ * @return number of events run
+ */
+unsigned int timer_queue_run(timer_queue_t *tq, uint64_t now_ns){
+    unsigned int n_run = 0;
+    timer_queue_take_remote(tq);
+    while(tq->n_events > 0 && tq->heap[0].expire_ns <= now_ns){
+        timer_event_t ev = tq->heap[0];
+        timer_queue_pop(tq);
+        ev.cb(ev.arg, ev.data);
+        n_run++;
+    }
+    return n_run;
+}
+
+/**
+ * @brief Arm the timerfd for the earliest event.
+ *
+ * Only calls into the kernel when the earliest event is due before
+ * the time the timerfd is already armed for. Events added by other
+ * threads in the meantime are taken in under the inbox lock first.
+ *
+ * @param  tq: pointer to the queue
+ * @return 0: Success
+ *        -1: Fail
+ */
+int timer_queue_arm(timer_queue_t *tq){
+    int ret = 0;
+    timer_queue_take_remote(tq);
+    if(tq->n_events == 0){
+        return 0;
+    }
+    if(tq->armed_ns != 0 && tq->armed_ns <= tq->heap[0].expire_ns){
+        return 0;
+    }
+
+    pthread_mutex_lock(&tq->remote_lock);
+    timer_queue_take_remote_locked(tq);
+    uint64_t expire_ns = tq->heap[0].expire_ns;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = expire_ns / 1000000000ULL;
+    its.it_value.tv_nsec = expire_ns % 1000000000ULL;
+    if(timerfd_settime(tq->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0){
+        perror("timerfd_settime");
+        ret = -1;
+    } else {
+        tq->armed_ns = expire_ns;
+    }
+    pthread_mutex_unlock(&tq->remote_lock);
+    return ret;
+}
+
+/**
+ * @brief Handle the timerfd becoming readable.
+ *
+ * Runs the expired events and re-arms the timerfd for the next one.
+ *
+ * @param  tq: pointer to the queue
+ * @return number of events run
+ */
+unsigned int timer_queue_fired(timer_queue_t *tq){
+    uint64_t n_expirations;
+    if(read(tq->timer_fd, &n_expirations, sizeof(n_expirations)) < 0 && errno != EAGAIN){
+        perror("timerfd read");
+    }
+    tq->armed_ns = 0;
+    unsigned int n_run = timer_queue_run(tq, timer_now_ns());
+    timer_queue_arm(tq);
+    return n_run;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file timer.h
+ * @author Abishek Ramdas
+ * @brief Timer queue: min-heap of timed callbacks driven by a timerfd
+ */
+
+#ifndef __MY_TIMER_H
+#define __MY_TIMER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef void (*timer_cb_t)(void *arg, void *data);
+typedef struct timer_event_ timer_event_t;
+typedef void (*timer_cancel_cb_t)(timer_event_t *ev);
+
+/**
+ * A callback due at expire_ns. Events expiring at the same time run in
+ * the order they were added.
+ */
+struct timer_event_ {
+    uint64_t expire_ns; ///< CLOCK_MONOTONIC time the event is due
+    uint64_t seq;       ///< order of insertion, breaks ties
+    timer_cb_t cb;
+    void *arg;
+    void *data;
+};
+
+/**
+ * Timer queue owned by one thread. The thread polls timer_fd, which is
+ * armed for the earliest event, and runs the expired events when it
+ * becomes readable. Events are stored by value in the heap, adding one
+ * only allocates when the heap has to grow.
+ *
+ * Other threads add events with timer_queue_add_remote: they go to an
+ * inbox under remote_lock and fire timer_fd, the owner moves them to
+ * the heap before running or arming.
+ */
+typedef struct timer_queue_ {
+    timer_event_t *heap;
+    uint32_t n_events;
+    uint32_t capacity;
+    uint64_t next_seq;
+    int timer_fd;      ///< timerfd armed for the earliest event
+    uint64_t armed_ns; ///< expiry timer_fd is armed for, 0 if not armed
+    pthread_mutex_t remote_lock;
+    timer_event_t *remote; ///< events added by other threads
+    uint32_t n_remote;
+    uint32_t remote_capacity;
+} timer_queue_t;
+
+int timer_queue_init(timer_queue_t *tq, uint32_t capacity);
+void timer_queue_destroy(timer_queue_t *tq);
+void timer_queue_cancel_all(timer_queue_t *tq, timer_cancel_cb_t cancel_cb);
+int timer_queue_add(timer_queue_t *tq, uint64_t expire_ns,
+                    timer_cb_t cb, void *arg, void *data);
+int timer_queue_add_remote(timer_queue_t *tq, uint64_t expire_ns,
+                           timer_cb_t cb, void *arg, void *data);
+unsigned int timer_queue_run(timer_queue_t *tq, uint64_t now_ns);
+int timer_queue_arm(timer_queue_t *tq);
+unsigned int timer_queue_fired(timer_queue_t *tq);
+
+/**
+ * @brief Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+static inline uint64_t
+timer_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#endif
@@ -39,6 +39,7 @@
  *
  * @param  None
  * @return pointer to graph
+ *         NULL: fail
  *
  */
 graph_t * build_first_topo() {
@@ -46,10 +47,17 @@ graph_t * build_first_topo() {
     node_t *R0_re = create_graph_node(topo, "R0_re");
     node_t *R1_re = create_graph_node(topo, "R1_re");
     node_t *R2_re = create_graph_node(topo, "R2_re");
+    if(R0_re == NULL || R1_re == NULL || R2_re == NULL){
+        destroy_graph(topo);
+        return NULL;
+    }
 
-    insert_link_between_two_nodes(R0_re, R1_re, "eth0", "eth1", 5);
-    insert_link_between_two_nodes(R1_re, R2_re, "eth2", "eth3", 4);
-    insert_link_between_two_nodes(R0_re, R2_re, "eth4", "eth5", 9);
+    if(insert_link_between_two_nodes(R0_re, R1_re, "eth0", "eth1", 5) == NULL ||
+       insert_link_between_two_nodes(R1_re, R2_re, "eth2", "eth3", 4) == NULL ||
+       insert_link_between_two_nodes(R0_re, R2_re, "eth4", "eth5", 9) == NULL){
+        destroy_graph(topo);
+        return NULL;
+    }
 
     // Configure the loop back IPs of each node
     if(node_set_loopback_address(R0_re, "122.1.1.0") < 0){
@@ -98,8 +106,61 @@ graph_t * build_first_topo() {
 
 
     char *message = "This is a test message\n";
-    //send_pkt_flood(R0_re, R0_re->interfaces[0], message, strlen(message));
+    //send_pkt_flood(R0_re, R0_re->interfaces[0], message, strlen(message), NULL);
     send_pkt_out(message, strlen(message), R0_re->interfaces[0]);
 
     return topo;
 }
+
+/**
+ * @brief Create a chain of nodes for scale runs.
+ *
+ * Node N<i> is linked to node N<i+1> through its interface eth1 and
+ * the other node's eth0. Link i gets its own /30 subnet in 10.0.0.0/8:
+ * N<i> eth1 has the first address and N<i+1> eth0 the second.
+ * Receiver threads are not started.
+ *
+ * @param  n_nodes: number of nodes, at most 4194304
+ * @return pointer to graph
+ *         NULL: fail
+ */
+graph_t * build_linear_topo(unsigned int n_nodes) {
+    char name[NODE_NAME_SIZE];
+    char ip[24];
+
+    if(n_nodes == 0 || n_nodes > (1U << 22)){
+        printf("Linear topology must have between 1 and %u nodes\n", 1U << 22);
+        return NULL;
+    }
+    graph_t *topo = create_new_graph("linear_topo");
+    if(topo == NULL){
+        return NULL;
+    }
+
+    node_t *prev = NULL;
+    for(unsigned int i=0; i<n_nodes; i++){
+        snprintf(name, sizeof(name), "N%u", i);
+        node_t *node = create_graph_node(topo, name);
+        if(node == NULL){
+            destroy_graph(topo);
+            return NULL;
+        }
+        if(prev == NULL){
+            prev = node;
+            continue;
+        }
+        if(insert_link_between_two_nodes(prev, node, "eth1", "eth0", 1) == NULL){
+            destroy_graph(topo);
+            return NULL;
+        }
+        // Link number i-1 owns 10.x.y.z/30 with z = 4 * ((i-1) % 64)
+        unsigned int link = i - 1;
+        unsigned int a = link >> 14, b = (link >> 6) & 0xff, c = (link & 0x3f) << 2;
+        snprintf(ip, sizeof(ip), "10.%u.%u.%u", a, b, c + 1);
+        node_set_intf_ip_address(prev, "eth1", ip, 30);
+        snprintf(ip, sizeof(ip), "10.%u.%u.%u", a, b, c + 2);
+        node_set_intf_ip_address(node, "eth0", ip, 30);
+        prev = node;
+    }
+    return topo;
+}
@@ -0,0 +1,327 @@
+/**
+ * @file traffic_gen.c
+ * @author Abishek Ramdas
+ * @brief Traffic generator sending packets out of a node at a set rate
+ *
+ * The generator thread sends one packet buffer over and over, only
+ * updating the sequence number in its header, so the cost measured is
+ * the cost of comm.c and layer2.c. The receiving node spots generated
+ * packets by their header once they are encapsulated into an ethernet
+ * frame, counts them against the generator and drops them.
+ */
+
+#include "traffic_gen.h"
+#include "comm.h"
+#include "layer2.h"
+#include "pkt_buf.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+// Largest data link packet that still fits an ethernet frame
+#define TRAFFIC_GEN_MAX_SIZE (ETH_FRAME_MTU - sizeof(ethernet_hdr_t) - sizeof(fcs_t))
+
+// Time the receiver gets to catch up once the last packet is sent
+#define TRAFFIC_GEN_DRAIN_NS 200000000ULL
+
+// Running generators, looked up by the receivers through the slot in
+// the packet header
+static traffic_gen_t *running_gens[TRAFFIC_GEN_MAX];
+static uint32_t next_run_id = 1;
+
+void traffic_gen_set_defaults(traffic_gen_params_t *params){
+    memset(params, 0, sizeof(*params));
+    params->pkt_size = TRAFFIC_GEN_DEFAULT_SIZE;
+    params->duration_s = TRAFFIC_GEN_DEFAULT_DURATION_S;
+    params->burst = TRAFFIC_GEN_DEFAULT_BURST;
+}
+
+/**
+ * @brief Get the traffic generator of a node, creating it with default
+ * settings on first use.
+ *
+ * @return generator, NULL if it could not be allocated
+ */
+traffic_gen_t *traffic_gen_get(node_t *node){
+    if(node->traffic_gen != NULL){
+        return node->traffic_gen;
+    }
+    traffic_gen_t *gen = aligned_alloc(64, sizeof(traffic_gen_t));
+    if(gen == NULL){
+        perror("aligned_alloc");
+        return NULL;
+    }
+    memset(gen, 0, sizeof(*gen));
+    traffic_gen_set_defaults(&gen->params);
+    gen->node = node;
+    node->traffic_gen = gen;
+    return gen;
+}
+
+/**
+ * @brief Account a received packet to its generator.
+ *
+ * Called by the receiver threads for every data link packet.
+ *
+ * @param  pkt: data link packet
+ * @param  len: bytes of the packet
+ * @return 1: the packet was generated and is consumed
+ *         0: not a generated packet
+ */
+int traffic_gen_rx(const char *pkt, uint32_t len){
+    const traffic_gen_hdr_t *hdr = (const traffic_gen_hdr_t *)pkt;
+    if(len < sizeof(*hdr) || hdr->magic != TRAFFIC_GEN_MAGIC){
+        return 0;
+    }
+    if(hdr->slot >= TRAFFIC_GEN_MAX){
+        return 1;
+    }
+    traffic_gen_t *gen = __atomic_load_n(&running_gens[hdr->slot], __ATOMIC_ACQUIRE);
+    if(gen == NULL || gen->run_id != hdr->run_id){
+        // Left over from an earlier run
+        return 1;
+    }
+    // All packets of a run reach the same node, its receiver thread is
+    // the only writer.
+    __atomic_store_n(&gen->rx_pkts, gen->rx_pkts + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&gen->rx_bytes, gen->rx_bytes + len, __ATOMIC_RELAXED);
+    if(hdr->seq < gen->rx_next_seq){
+        __atomic_store_n(&gen->rx_reordered, gen->rx_reordered + 1, __ATOMIC_RELAXED);
+    } else {
+        gen->rx_next_seq = hdr->seq + 1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Sleep until a CLOCK_MONOTONIC time.
+ */
+static void traffic_gen_sleep_until(uint64_t t_ns){
+    struct timespec ts = {
+        .tv_sec = t_ns / 1000000000ULL,
+        .tv_nsec = t_ns % 1000000000ULL,
+    };
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0){
+        ;
+    }
+}
+
+/**
+ * @brief Print the outcome of the last run of a generator.
+ */
+void dump_traffic_gen(node_t *node){
+    traffic_gen_t *gen = node->traffic_gen;
+    if(gen == NULL || gen->run_id == 0){
+        printf("No traffic generated on node %s\n", node->node_name);
+        return;
+    }
+    uint64_t end_ns = __atomic_load_n(&gen->running, __ATOMIC_ACQUIRE) ?
+        timer_now_ns() : gen->end_ns;
+    double secs = (double)(end_ns - gen->start_ns) / 1e9;
+    uint64_t tx_pkts = __atomic_load_n(&gen->tx_pkts, __ATOMIC_RELAXED);
+    uint64_t tx_bytes = __atomic_load_n(&gen->tx_bytes, __ATOMIC_RELAXED);
+    uint64_t rx_pkts = __atomic_load_n(&gen->rx_pkts, __ATOMIC_RELAXED);
+    uint64_t rx_bytes = __atomic_load_n(&gen->rx_bytes, __ATOMIC_RELAXED);
+    if(secs <= 0){
+        secs = 1e-9;
+    }
+
+    printf("Traffic generator on node %s, interface %s, %u byte packets, %.3f s\n",
+           node->node_name, gen->out_if->interface_name, gen->params.pkt_size, secs);
+    printf("\tTX %lu packets, %.0f pkts/s, %.3f Mbit/s, %lu errors\n",
+           (unsigned long)tx_pkts, tx_pkts / secs, tx_bytes * 8 / secs / 1e6,
+           (unsigned long)__atomic_load_n(&gen->tx_errors, __ATOMIC_RELAXED));
+    printf("\tRX %lu packets, %.0f pkts/s, %.3f Mbit/s, %lu reordered, %.3f%% lost\n",
+           (unsigned long)rx_pkts, rx_pkts / secs, rx_bytes * 8 / secs / 1e6,
+           (unsigned long)__atomic_load_n(&gen->rx_reordered, __ATOMIC_RELAXED),
+           tx_pkts ? (double)(tx_pkts - (rx_pkts < tx_pkts ? rx_pkts : tx_pkts)) * 100 / tx_pkts : 0.0);
+}
+
+static void *traffic_gen_thread(void *arg){
+    traffic_gen_t *gen = (traffic_gen_t *)arg;
+    traffic_gen_params_t *p = &gen->params;
+
+    pkt_buf_t *pb = pkt_buf_alloc();
+    if(pb == NULL){
+        printf("Traffic generator: packet buffer pool exhausted\n");
+        goto done;
+    }
+    char *pkt = pkt_buf_put(pb, p->pkt_size);
+    memset(pkt, 0, p->pkt_size);
+    traffic_gen_hdr_t *hdr = (traffic_gen_hdr_t *)pkt;
+    hdr->magic = TRAFFIC_GEN_MAGIC;
+    hdr->run_id = gen->run_id;
+    hdr->slot = gen->slot;
+
+    uint64_t pps = p->pps;
+    if(pps == 0 && p->bps != 0){
+        pps = p->bps / ((uint64_t)p->pkt_size * 8);
+        if(pps == 0){
+            pps = 1;
+        }
+    }
+    // Bursts go out every burst_ns, unpaced if no rate is set
+    uint64_t burst_ns = pps ? (uint64_t)p->burst * 1000000000ULL / pps : 0;
+    uint64_t now_ns = timer_now_ns();
+    uint64_t end_ns = now_ns + (uint64_t)p->duration_s * 1000000000ULL;
+    uint64_t next_ns = now_ns;
+    uint32_t seq = 0;
+
+    while(!__atomic_load_n(&gen->stop, __ATOMIC_RELAXED)){
+        if(burst_ns != 0){
+            if(next_ns > now_ns){
+                traffic_gen_sleep_until(next_ns);
+            } else if(now_ns - next_ns > 10 * burst_ns){
+                // Fell far behind, do not try to make up for it in one go
+                next_ns = now_ns;
+            }
+            next_ns += burst_ns;
+        }
+        for(uint32_t i=0; i<p->burst; i++){
+            hdr->seq = seq++;
+            int rc = gen->dst_ip_n ? arp_send_pkt(gen->node, gen->dst_ip_n, pkt, p->pkt_size) :
+                                     send_pkt_buf_out(pb, gen->out_if);
+            if(rc < 0){
+                __atomic_store_n(&gen->tx_errors, gen->tx_errors + 1, __ATOMIC_RELAXED);
+            } else {
+                __atomic_store_n(&gen->tx_pkts, gen->tx_pkts + 1, __ATOMIC_RELAXED);
+                __atomic_store_n(&gen->tx_bytes, gen->tx_bytes + p->pkt_size, __ATOMIC_RELAXED);
+            }
+        }
+        now_ns = timer_now_ns();
+        if(now_ns >= end_ns){
+            break;
+        }
+    }
+    gen->end_ns = now_ns;
+    pkt_buf_free(pb);
+    pkt_buf_cache_release();
+
+    // Let the receiver take in the packets still in flight
+    uint64_t drain_end_ns = timer_now_ns() + TRAFFIC_GEN_DRAIN_NS;
+    while(__atomic_load_n(&gen->rx_pkts, __ATOMIC_RELAXED) < gen->tx_pkts &&
+          timer_now_ns() < drain_end_ns){
+        traffic_gen_sleep_until(timer_now_ns() + 1000000);
+    }
+
+done:
+    __atomic_store_n(&running_gens[gen->slot], NULL, __ATOMIC_RELEASE);
+    __atomic_store_n(&gen->running, 0, __ATOMIC_RELEASE);
+    if(gen->end_ns == 0){
+        gen->end_ns = timer_now_ns();
+    }
+    dump_traffic_gen(gen->node);
+    return NULL;
+}
+
+/**
+ * @brief Start the traffic generator of a node with its current settings.
+ *
+ * Returns once the generator thread is started, the thread prints the
+ * achieved rates when the run ends.
+ *
+ * @param  node: node to send from
+ * @return 0: Success
+ *        -1: Fail
+ */
+int traffic_gen_start(node_t *node){
+    traffic_gen_t *gen = traffic_gen_get(node);
+    if(gen == NULL){
+        return -1;
+    }
+    if(__atomic_load_n(&gen->running, __ATOMIC_ACQUIRE)){
+        printf("Traffic generator already running on node %s\n", node->node_name);
+        return -1;
+    }
+    if(gen->joinable){
+        pthread_join(gen->thread, NULL);
+        gen->joinable = 0;
+    }
+    if(!node->comm_local){
+        printf("Node %s runs in partition %u, start its generator there\n",
+               node->node_name, node->comm_partition);
+        return -1;
+    }
+
+    traffic_gen_params_t *p = &gen->params;
+    if(p->pkt_size < sizeof(traffic_gen_hdr_t) || p->pkt_size > TRAFFIC_GEN_MAX_SIZE){
+        printf("Packet size must be between %zu and %zu\n",
+               sizeof(traffic_gen_hdr_t), TRAFFIC_GEN_MAX_SIZE);
+        return -1;
+    }
+    interface_t *out_if = NULL;
+    uint32_t dst_ip_n = 0;
+    if(p->if_name[0] != '\0'){
+        out_if = get_node_if_by_name(node, p->if_name);
+    } else if(p->dst_ip[0] != '\0' && inet_pton(AF_INET, p->dst_ip, &dst_ip_n) == 1){
+        // Resolved with ARP, the packets may cross an L2 switch
+        out_if = node_get_matching_subnet_interface(node, p->dst_ip);
+    }
+    if(out_if == NULL || out_if->link == NULL){
+        printf("No interface of node %s to send on, configure an interface or a destination IP\n",
+               node->node_name);
+        return -1;
+    }
+
+    uint32_t slot;
+    for(slot=0; slot<TRAFFIC_GEN_MAX; slot++){
+        if(running_gens[slot] == NULL){
+            break;
+        }
+    }
+    if(slot == TRAFFIC_GEN_MAX){
+        printf("Only %d traffic generators can run at the same time\n", TRAFFIC_GEN_MAX);
+        return -1;
+    }
+
+    gen->out_if = out_if;
+    gen->dst_ip_n = dst_ip_n;
+    gen->run_id = next_run_id++;
+    gen->slot = slot;
+    gen->stop = 0;
+    gen->tx_pkts = gen->tx_bytes = gen->tx_errors = 0;
+    gen->rx_pkts = gen->rx_bytes = gen->rx_reordered = 0;
+    gen->rx_next_seq = 0;
+    gen->start_ns = timer_now_ns();
+    gen->end_ns = 0;
+    gen->running = 1;
+    __atomic_store_n(&running_gens[slot], gen, __ATOMIC_RELEASE);
+
+    if(pthread_create(&gen->thread, NULL, traffic_gen_thread, gen) != 0){
+        perror("pthread_create");
+        running_gens[slot] = NULL;
+        gen->running = 0;
+        return -1;
+    }
+    gen->joinable = 1;
+    return 0;
+}
+
+/**
+ * @brief Stop the traffic generator of a node and wait for its report.
+ *
+ * @return 0: Success
+ *        -1: Fail, no generator is running on the node
+ */
+int traffic_gen_stop(node_t *node){
+    traffic_gen_t *gen = node->traffic_gen;
+    if(gen == NULL || !gen->joinable){
+        return -1;
+    }
+    __atomic_store_n(&gen->stop, 1, __ATOMIC_RELAXED);
+    pthread_join(gen->thread, NULL);
+    gen->joinable = 0;
+    return 0;
+}
+
+/**
+ * @brief Stop and free the traffic generator of a node being destroyed.
+ */
+void traffic_gen_destroy(node_t *node){
+    traffic_gen_stop(node);
+    free(node->traffic_gen);
+    node->traffic_gen = NULL;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file traffic_gen.h
+ * @author Abishek Ramdas
+ * @brief Traffic generator sending packets out of a node at a set rate
+ */
+
+#ifndef __MY_TRAFFIC_GEN_H
+#define __MY_TRAFFIC_GEN_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "graph.h"
+
+#define TRAFFIC_GEN_MAX 16 ///< generators running at the same time
+#define TRAFFIC_GEN_DEFAULT_SIZE 64
+#define TRAFFIC_GEN_DEFAULT_DURATION_S 10
+#define TRAFFIC_GEN_DEFAULT_BURST 32
+#define TRAFFIC_GEN_MAX_BURST 1024
+#define TRAFFIC_GEN_MAGIC 0x54474e31 ///< "TGN1"
+
+/**
+ * Header at the start of every generated packet. It lets the receiving
+ * node recognize the packet and account it to its generator.
+ */
+typedef struct traffic_gen_hdr_ {
+    uint32_t magic;
+    uint32_t run_id; ///< run of the generator the packet belongs to
+    uint32_t slot;   ///< slot of the generator while it runs
+    uint32_t seq;    ///< packet number within the run
+} traffic_gen_hdr_t;
+
+/**
+ * Generator settings. Rate is given either in packets or in bits per
+ * second, with neither set the generator sends as fast as it can.
+ */
+typedef struct traffic_gen_params_ {
+    uint32_t pkt_size;    ///< bytes of each data link packet
+    uint64_t pps;         ///< packets per second, 0 if not set
+    uint64_t bps;         ///< bits per second, 0 if not set
+    uint32_t duration_s;
+    uint32_t burst;       ///< packets sent back to back between rate checks
+    char if_name[IF_NAME_SIZE]; ///< interface to send out of, or
+    char dst_ip[16];      ///< destination IP to pick the interface by subnet
+} traffic_gen_params_t;
+
+/**
+ * Traffic generator of a node. Runs on its own thread; the packets it
+ * sends are counted by the receiver thread of the node across the link.
+ */
+typedef struct traffic_gen_ {
+    traffic_gen_params_t params;
+    node_t *node;
+    interface_t *out_if;
+    uint32_t dst_ip_n;    ///< IP address packets are sent to with arp_send_pkt,
+                          ///< 0 to send them to the interface across the link
+    uint32_t run_id;
+    uint32_t slot;
+    int running;          ///< set while the generator thread sends
+    int stop;             ///< set to end the run early
+    int joinable;         ///< thread has been started and not joined
+    pthread_t thread;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t tx_pkts;
+    uint64_t tx_bytes;
+    uint64_t tx_errors;
+    // Written by the receiver thread of the destination node
+    uint64_t rx_pkts __attribute__((aligned(64)));
+    uint64_t rx_bytes;
+    uint64_t rx_reordered; ///< packets arriving after a later packet
+    uint32_t rx_next_seq;  ///< sequence number expected next
+} traffic_gen_t;
+
+traffic_gen_t *traffic_gen_get(node_t *node);
+void traffic_gen_set_defaults(traffic_gen_params_t *params);
+int traffic_gen_start(node_t *node);
+int traffic_gen_stop(node_t *node);
+void traffic_gen_destroy(node_t *node);
+int traffic_gen_rx(const char *pkt, uint32_t len);
+void dump_traffic_gen(node_t *node);
+
+#endif
@@ -0,0 +1,262 @@
+/**
+ * @file uring.c
+ * @author Abishek Ramdas
+ * @brief Setup and submission of io_uring instances using the raw system calls
+ */
+
+#include "uring.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p){
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags){
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args){
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief Create an io_uring instance and map its rings.
+ *
+ * @param  ring: pointer to the ring to initialize
+ * @param  entries: number of submission queue entries
+ * @return 0: Success
+ *        -1: Fail
+ */
+int uring_init(uring_t *ring, unsigned entries){
+    struct io_uring_params p;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&p, 0, sizeof(p));
+    ring->ring_fd = sys_io_uring_setup(entries, &p);
+    if(ring->ring_fd < 0){
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    ring->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        // Both rings share one mapping
+        if(ring->cq_map_size > ring->sq_map_size){
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = ring->sq_map_size;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    if(ring->sq_ptr == MAP_FAILED){
+        perror("mmap sq ring");
+        close(ring->ring_fd);
+        return -1;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+        if(ring->cq_ptr == MAP_FAILED){
+            perror("mmap cq ring");
+            munmap(ring->sq_ptr, ring->sq_map_size);
+            close(ring->ring_fd);
+            return -1;
+        }
+    }
+
+    ring->sqes_map_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED){
+        perror("mmap sqes");
+        uring_exit(ring);
+        return -1;
+    }
+
+    char *sq = (char *)ring->sq_ptr;
+    char *cq = (char *)ring->cq_ptr;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->sq_entries = p.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+/**
+ * @brief Unmap the rings and close an io_uring instance.
+ *
+ * @param  ring: pointer to the ring
+ */
+void uring_exit(uring_t *ring){
+    if(ring->sqes != NULL && ring->sqes != MAP_FAILED){
+        munmap(ring->sqes, ring->sqes_map_size);
+    }
+    if(ring->cq_ptr != NULL && ring->cq_ptr != ring->sq_ptr){
+        munmap(ring->cq_ptr, ring->cq_map_size);
+    }
+    if(ring->sq_ptr != NULL){
+        munmap(ring->sq_ptr, ring->sq_map_size);
+    }
+    if(ring->ring_fd >= 0){
+        close(ring->ring_fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->ring_fd = -1;
+}
+
+/**
+ * @brief Get a zeroed submission queue entry to fill in.
+ *
+ * @param  ring: pointer to the ring
+ * @return pointer to the SQE
+ *         NULL if the submission queue is full
+ */
+struct io_uring_sqe *uring_get_sqe(uring_t *ring){
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if(ring->sqe_tail - head >= ring->sq_entries){
+        return NULL;
+    }
+    unsigned idx = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    ring->sqe_tail++;
+    return sqe;
+}
+
+/**
+ * @brief Submit all pending SQEs and optionally wait for completions.
+ *
+ * Submission and waiting are a single io_uring_enter system call.
+ *
+ * @param  ring: pointer to the ring
+ * @param  wait_nr: number of completions to wait for, 0 to not wait
+ * @return number of SQEs submitted
+ *        -1: Fail
+ */
+int uring_submit_and_wait(uring_t *ring, unsigned wait_nr){
+    unsigned to_submit = uring_sq_pending(ring);
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    if(to_submit == 0 && wait_nr == 0){
+        return 0;
+    }
+
+    int ret;
+    do {
+        ret = sys_io_uring_enter(ring->ring_fd, to_submit, wait_nr,
+                                 wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    } while(ret < 0 && errno == EINTR);
+    if(ret < 0){
+        perror("io_uring_enter");
+        return -1;
+    }
+    return ret;
+}
+
+/**
+ * @brief Create a provided buffer ring and register it with an io_uring.
+ *
+ * All buffers are handed to the kernel right away.
+ *
+ * @param  ring: io_uring the buffers are used with
+ * @param  bring: pointer to the buffer ring to initialize
+ * @param  bgid: buffer group id to register the buffers under
+ * @param  entries: number of buffers, power of 2
+ * @param  buf_size: size in bytes of each buffer
+ * @param  headroom: bytes kept free at the start of each buffer, the
+ *                   kernel fills the remaining buf_size - headroom bytes
+ * @return 0: Success
+ *        -1: Fail
+ */
+int uring_buf_ring_init(uring_t *ring, uring_buf_ring_t *bring, uint16_t bgid,
+                        unsigned entries, unsigned buf_size, unsigned headroom){
+    struct io_uring_buf_reg reg;
+
+    memset(bring, 0, sizeof(*bring));
+    if(entries == 0 || (entries & (entries - 1)) != 0){
+        printf("Buffer ring size %u is not a power of 2\n", entries);
+        return -1;
+    }
+    if(headroom >= buf_size){
+        printf("Buffer headroom %u leaves no room in buffers of %u bytes\n",
+               headroom, buf_size);
+        return -1;
+    }
+
+    // The ring itself must be page aligned
+    bring->br_map_size = entries * sizeof(struct io_uring_buf);
+    bring->br = mmap(NULL, bring->br_map_size, PROT_READ | PROT_WRITE,
+                     MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(bring->br == MAP_FAILED){
+        perror("mmap buf ring");
+        bring->br = NULL;
+        return -1;
+    }
+    bring->bufs = calloc(entries, buf_size);
+    if(bring->bufs == NULL){
+        perror("calloc");
+        munmap(bring->br, bring->br_map_size);
+        bring->br = NULL;
+        return -1;
+    }
+    bring->entries = entries;
+    bring->mask = entries - 1;
+    bring->bgid = bgid;
+    bring->buf_size = buf_size;
+    bring->headroom = headroom;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)bring->br;
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+    if(sys_io_uring_register(ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0){
+        perror("io_uring_register pbuf ring");
+        free(bring->bufs);
+        munmap(bring->br, bring->br_map_size);
+        memset(bring, 0, sizeof(*bring));
+        return -1;
+    }
+
+    for(unsigned i=0; i<entries; i++){
+        uring_buf_ring_add(bring, i);
+    }
+    uring_buf_ring_advance(bring);
+    return 0;
+}
+
+/**
+ * @brief Unregister and free a provided buffer ring.
+ *
+ * @param  ring: io_uring the buffers were registered with
+ * @param  bring: pointer to the buffer ring
+ */
+void uring_buf_ring_exit(uring_t *ring, uring_buf_ring_t *bring){
+    struct io_uring_buf_reg reg;
+
+    if(bring->br == NULL){
+        return;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = bring->bgid;
+    sys_io_uring_register(ring->ring_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    free(bring->bufs);
+    munmap(bring->br, bring->br_map_size);
+    memset(bring, 0, sizeof(*bring));
+}
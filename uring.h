@@ -0,0 +1,130 @@
+/**
+ * @file uring.h
+ * @author Abishek Ramdas
+ * @brief Minimal io_uring wrapper on top of the raw system calls
+ */
+
+#ifndef __MY_URING_H
+#define __MY_URING_H
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * An io_uring instance: submission and completion rings mapped from
+ * the kernel. A ring must only be used by one thread at a time.
+ */
+typedef struct uring_ {
+    int ring_fd;
+    // Submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned sqe_tail;   ///< next SQE handed out, not yet visible to kernel
+    struct io_uring_sqe *sqes;
+    // Completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    // Mappings
+    void *sq_ptr;
+    size_t sq_map_size;
+    void *cq_ptr;
+    size_t cq_map_size;
+    size_t sqes_map_size;
+} uring_t;
+
+/**
+ * A provided buffer ring: a group of equally sized buffers the kernel
+ * picks from for receives issued with IOSQE_BUFFER_SELECT.
+ */
+typedef struct uring_buf_ring_ {
+    struct io_uring_buf_ring *br;
+    size_t br_map_size;
+    unsigned entries;  ///< number of buffers, power of 2
+    unsigned mask;
+    uint16_t bgid;     ///< buffer group id
+    uint16_t tail;     ///< local tail, published by uring_buf_ring_advance
+    unsigned buf_size;
+    unsigned headroom; ///< bytes at the start of each buffer the kernel does not fill
+    char *bufs;        ///< entries * buf_size bytes
+} uring_buf_ring_t;
+
+int uring_init(uring_t *ring, unsigned entries);
+void uring_exit(uring_t *ring);
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+int uring_submit_and_wait(uring_t *ring, unsigned wait_nr);
+int uring_buf_ring_init(uring_t *ring, uring_buf_ring_t *bring, uint16_t bgid,
+                        unsigned entries, unsigned buf_size, unsigned headroom);
+void uring_buf_ring_exit(uring_t *ring, uring_buf_ring_t *bring);
+
+/**
+ * @brief Get the oldest unconsumed completion.
+ *
+ * @param  ring: pointer to the ring
+ * @return pointer to the CQE, valid until uring_cqe_seen
+ *         NULL if there are no completions
+ */
+static inline struct io_uring_cqe *
+uring_peek_cqe(uring_t *ring){
+    unsigned head = *ring->cq_head;
+    if(head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)){
+        return NULL;
+    }
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+/**
+ * @brief Mark the CQE returned by uring_peek_cqe as consumed.
+ *
+ * @param  ring: pointer to the ring
+ */
+static inline void
+uring_cqe_seen(uring_t *ring){
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Number of SQEs handed out and not yet submitted.
+ */
+static inline unsigned
+uring_sq_pending(uring_t *ring){
+    return ring->sqe_tail - *ring->sq_tail;
+}
+
+/**
+ * @brief Give a buffer back to a provided buffer ring.
+ *
+ * The buffer becomes visible to the kernel after uring_buf_ring_advance.
+ *
+ * @param  bring: pointer to the buffer ring
+ * @param  bid: id of the buffer to give back
+ */
+static inline void
+uring_buf_ring_add(uring_buf_ring_t *bring, uint16_t bid){
+    struct io_uring_buf *buf = &bring->br->bufs[bring->tail & bring->mask];
+    char *addr = bring->bufs + (size_t)bid * bring->buf_size + bring->headroom;
+    buf->addr = (uint64_t)(uintptr_t)addr;
+    buf->len = bring->buf_size - bring->headroom;
+    buf->bid = bid;
+    bring->tail++;
+}
+
+static inline void
+uring_buf_ring_advance(uring_buf_ring_t *bring){
+    __atomic_store_n(&bring->br->tail, bring->tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Get the start of a buffer, including its headroom.
+ */
+static inline char *
+uring_buf_ring_buf(uring_buf_ring_t *bring, uint16_t bid){
+    return bring->bufs + (size_t)bid * bring->buf_size;
+}
+
+#endif
@@ -31,7 +31,8 @@ int apply_mask(char *prefix, int mask, char *str_prefix){
     uint32_t prefix_f[4];     //< 4 fields of input IP addr
     uint32_t str_prefix_f[4]; //< 4 fields of masked output IP addr
     char copy_prefix[16];
-    strncpy(copy_prefix, prefix, 16);
+    strncpy(copy_prefix, prefix, sizeof(copy_prefix) - 1);
+    copy_prefix[sizeof(copy_prefix) - 1] = '\0';
 
     // if mask is 24, bit_mask is ff ff ff 00
     // using unsigned long to account for mask 32
@@ -98,7 +99,8 @@ unsigned int convert_ip_from_str_to_int(char *ip_addr){
     uint32_t ip_num = 0;
     uint32_t ip_addr_f[4];
     char copy_ip_addr[16];
-    strncpy(copy_ip_addr, ip_addr, 16); // strtok modifies the original array
+    strncpy(copy_ip_addr, ip_addr, sizeof(copy_ip_addr) - 1);
+    copy_ip_addr[sizeof(copy_ip_addr) - 1] = '\0'; // strtok modifies the original array
 
     // if IP address is A.B.C.D
     // Ip_addr_f[0] = A, [1] = B, [2] = C, [3] = D
@@ -152,7 +154,8 @@ int is_valid_ipv4(const char *ip) {
     const char *ptr;
     // strtok modifies the original string so create a copy
     char copy_ip[16];
-    strncpy(copy_ip, ip, 16); // strtok modifies the original array
+    strncpy(copy_ip, ip, sizeof(copy_ip) - 1);
+    copy_ip[sizeof(copy_ip) - 1] = '\0'; // strtok modifies the original array
 
     // Check if the IP address is empty
     if (*copy_ip == '\0') {